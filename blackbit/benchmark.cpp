@@ -1,21 +1,32 @@
 #include "benchmark.hpp"
 
 #include "bot_state.hpp"
+#include "dyn_pcp.hpp"
 #include "engine.hpp"
+#include "engine_core.hpp"
 #include "experiment_framework.hpp"
 #include "game_result.hpp"
+#include "memory_budget.hpp"
+#include "move_history.hpp"
+#include "mpv_search.hpp"
+#include "pcp.hpp"
 #include "random.hpp"
 #include "rules.hpp"
+#include "search_limits.hpp"
 #include "statistics.hpp"
+#include "transposition_table.hpp"
 
 #include "bee/file_reader.hpp"
+#include "bee/file_writer.hpp"
 #include "bee/format_vector.hpp"
 #include "bee/queue.hpp"
 #include "bee/time.hpp"
 #include "bee/util.hpp"
 #include "command/command_builder.hpp"
 
+#include <atomic>
 #include <sstream>
+#include <thread>
 
 using bee::format;
 using bee::print_line;
@@ -23,6 +34,7 @@ using bee::Queue;
 using bee::Span;
 using bee::Time;
 using std::make_shared;
+using std::make_unique;
 using std::optional;
 using std::shared_ptr;
 using std::string;
@@ -49,7 +61,8 @@ Experiment create_exp(bool test_mode)
 
 void run_worker(
   bool test_mode,
-  Span time_to_think,
+  const SearchLimits& limits,
+  size_t hash_size,
   shared_ptr<Queue<string>> fen_queue,
   shared_ptr<Queue<Result>> result_queue)
 {
@@ -57,7 +70,7 @@ void run_worker(
     create_exp(test_mode),
     EvalParameters::default_params(),
     nullptr,
-    1 << 30,
+    hash_size,
     true);
 
   for (string fen : *fen_queue) {
@@ -70,7 +83,7 @@ void run_worker(
     }
 
     auto start = Time::monotonic();
-    auto result = engine->find_best_move(board, 30, time_to_think, nullptr);
+    auto result = engine->find_best_move(board, limits, nullptr);
     auto span = Time::monotonic().diff(start);
 
     if (result.is_error()) {
@@ -87,9 +100,10 @@ void run_worker(
 
 bee::OrError<bee::Unit> run_benchmark(
   const string& positions_file,
-  Span time_to_think,
+  const SearchLimits& limits,
   optional<int> num_positions_opt,
   optional<int> num_workers_opt,
+  const optional<string>& memory_str,
   bool test_mode)
 {
   bail(
@@ -102,10 +116,23 @@ bee::OrError<bee::Unit> run_benchmark(
   auto result_queue = make_shared<Queue<Result>>();
 
   int num_workers = num_workers_opt.value_or(16);
+  size_t hash_size = 1 << 30;
+  if (memory_str.has_value()) {
+    bail(memory, MemoryBudget::parse(*memory_str));
+    bail_assign(hash_size, memory.table_bytes(num_workers, num_workers));
+    print_line(
+      "Memory budget:$ table size:$",
+      MemoryBudget::format_bytes(memory.total_bytes()),
+      MemoryBudget::format_bytes(hash_size));
+  }
+
+  print_line("Search limits: $", limits);
+
   vector<std::thread> workers;
   for (int i = 0; i < num_workers; i++) {
-    workers.emplace_back(
-      [=] { run_worker(test_mode, time_to_think, fen_queue, result_queue); });
+    workers.emplace_back([=] {
+      run_worker(test_mode, limits, hash_size, fen_queue, result_queue);
+    });
   }
 
   auto rng = Random::create(0);
@@ -153,25 +180,554 @@ bee::OrError<bee::Unit> run_benchmark(
   return bee::unit;
 }
 
-bee::OrError<bee::Unit> run_benchmark_mpv()
+bee::OrError<bee::Unit> run_benchmark_mpv(int num_workers)
 {
   Board board;
   board.set_initial();
   Span sum_ellapsed = Span::zero();
   const int repeat = 100;
-  auto engine = Engine::create(
-    Experiment::base(),
-    EvalParameters::default_params(),
-    nullptr,
-    1ull << 31,
-    true);
+  auto hash_table = make_shared<TranspositionTable>(1ull << 31);
+  auto should_stop = make_shared<std::atomic_bool>(false);
+  MpvSearchStats stats;
+  vector<MpvSearchStats::Worker> totals(num_workers);
   for (int i = 0; i < repeat; i++) {
+    hash_table->clear();
     auto start_time = Time::monotonic();
-    engine->find_best_moves_mpv(
-      board, 8, 1, 16, Span::of_seconds(10), [](auto&&) {});
+    bail_unit(MpvSearch::search(
+      make_unique<Board>(board),
+      {.depth = 8},
+      1,
+      num_workers,
+      hash_table,
+      make_shared<MoveHistory>(),
+      should_stop,
+      Experiment::base(),
+      EvalParameters::default_params(),
+      [](auto&&) {},
+      &stats));
     sum_ellapsed += Time::monotonic() - start_time;
+    for (int w = 0; w < num_workers; w++) {
+      totals[w].busy += stats.workers[w].busy;
+      totals[w].idle += stats.workers[w].idle;
+      totals[w].tasks += stats.workers[w].tasks;
+      totals[w].steals += stats.workers[w].steals;
+    }
   }
   print_line("Average time: $", sum_ellapsed / repeat);
+  for (int w = 0; w < num_workers; w++) {
+    const auto& t = totals[w];
+    print_line(
+      "worker:$ busy:$ idle:$ utilisation:$% tasks:$ steals:$",
+      w,
+      t.busy / repeat,
+      t.idle / repeat,
+      int(t.busy.to_float_seconds() * 100.0 /
+          std::max((t.busy + t.idle).to_float_seconds(), 1e-9)),
+      t.tasks / repeat,
+      t.steals / repeat);
+  }
+  return bee::unit;
+}
+
+// Nodes and time to reach a depth in single process mpv search, the way pcp
+// generation searches
+const vector<string> mpv_sp_positions = {
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+  "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+  "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P3/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+};
+
+bee::OrError<bee::Unit> run_benchmark_mpv_sp(int depth, int max_pvs)
+{
+  uint64_t total_nodes = 0;
+  Span total_time = Span::zero();
+  for (const auto& fen : mpv_sp_positions) {
+    Board board;
+    bail_unit(board.set_fen(fen));
+    auto engine = Engine::create(
+      Experiment::base(),
+      EvalParameters::default_params(),
+      nullptr,
+      1ull << 28,
+      true);
+    auto start_time = Time::monotonic();
+    bail(
+      results,
+      engine->find_best_moves_mpv_sp(
+        board, {.depth = depth}, max_pvs, [](auto&&) {}));
+    auto ellapsed = Time::monotonic() - start_time;
+    if (results.empty()) { return bee::Error("Search returned no results"); }
+    auto nodes = results.front()->nodes;
+    print_line("nodes:$ time:$ fen:$", nodes, ellapsed, fen);
+    total_nodes += nodes;
+    total_time += ellapsed;
+  }
+  print_line("Total nodes:$ time:$", total_nodes, total_time);
+  return bee::unit;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Repetition benchmark
+//
+
+// Endgames where both sides can shuffle pieces around for a long time without
+// making irreversible moves
+const vector<string> shuffling_endgames = {
+  "8/8/4k3/3p1p2/3P1P2/4K3/8/R7 w - - 0 1",
+  "4k3/8/3n4/2p1p3/2P1P3/3N4/8/4K3 w - - 0 1",
+  "8/8/2b1k3/1p1p4/1P1P4/2B1K3/8/8 w - - 0 1",
+  "2r3k1/5p2/4p1p1/3pP1P1/3P4/8/5K2/2R5 w - - 0 1",
+  "8/3k4/2p1p3/1pP1P1n1/1P6/3B4/3K4/8 w - - 0 1",
+};
+
+vector<Move> reversible_moves(const Board& board)
+{
+  auto scratch = Rules::make_scratch(board);
+  MoveVector moves;
+  Rules::list_moves(board, scratch, moves);
+  vector<Move> out;
+  for (const auto& m : moves) {
+    if (board[m.d].type != PieceType::CLEAR) { continue; }
+    if (board[m.o].type == PieceType::PAWN) { continue; }
+    if (!Rules::is_legal_move(board, scratch, m)) { continue; }
+    out.push_back(m);
+  }
+  return out;
+}
+
+// Plays random reversible moves, stopping short of the 50 moves rule
+void shuffle(Board& board, Random& rng, int plies)
+{
+  for (int i = 0; i < plies; i++) {
+    auto moves = reversible_moves(board);
+    if (moves.empty()) { break; }
+    board.move(moves[rng.rand64() % moves.size()]);
+  }
+}
+
+bee::OrError<bee::Unit> run_benchmark_repetition(int walks, int depth)
+{
+  auto rng = Random::create(0);
+  auto engine = EngineInProcess::create(
+    Experiment::base(),
+    EvalParameters::default_params(),
+    nullptr,
+    1 << 26,
+    true);
+
+  Span total_check_time = Span::zero();
+  uint64_t total_checks = 0;
+  uint64_t total_nodes = 0;
+  Span total_search_time = Span::zero();
+  for (const auto& fen : shuffling_endgames) {
+    Board board;
+    bail_unit(board.set_fen(fen));
+    shuffle(board, *rng, 96);
+    const int root = board.history.size();
+
+    // Random walks from the shuffled position, checking for draws at every
+    // node like the search does
+    uint64_t checks = 0;
+    uint64_t draws = 0;
+    auto start = Time::monotonic();
+    for (int w = 0; w < walks; w++) {
+      vector<std::pair<Move, MoveInfo>> played;
+      for (int ply = 0; ply < 8; ply++) {
+        auto moves = reversible_moves(board);
+        if (moves.empty()) { break; }
+        auto m = moves[rng->rand64() % moves.size()];
+        played.emplace_back(m, board.move(m));
+        for (int i = 0; i < 64; i++) {
+          checks++;
+          if (Rules::is_draw_without_stalemate(board, root)) { draws++; }
+        }
+      }
+      while (!played.empty()) {
+        board.undo(played.back().first, played.back().second);
+        played.pop_back();
+      }
+    }
+    auto check_time = Time::monotonic() - start;
+
+    bail(result, engine->find_best_move(board, {.depth = depth}, nullptr));
+
+    print_line(
+      "fen:$ history:$ checks:$ draws:$ ns/check:$ nodes:$ search_time:$ "
+      "knodes/s:$",
+      board.to_fen(),
+      board.history.size(),
+      checks,
+      draws,
+      check_time.to_float_seconds() * 1e9 / checks,
+      result->nodes,
+      result->think_time,
+      result->nodes / result->think_time.to_float_seconds() / 1000.0);
+
+    total_check_time += check_time;
+    total_checks += checks;
+    total_nodes += result->nodes;
+    total_search_time += result->think_time;
+  }
+
+  print_line(
+    "total: ns/check:$ nodes:$ search_time:$ knodes/s:$",
+    total_check_time.to_float_seconds() * 1e9 / total_checks,
+    total_nodes,
+    total_search_time,
+    total_nodes / total_search_time.to_float_seconds() / 1000.0);
+
+  return bee::unit;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PCP benchmark
+//
+
+bee::OrError<int64_t> resident_memory_kb()
+{
+  bail(
+    status,
+    bee::FileReader::open(bee::FilePath::of_string("/proc/self/status")));
+  while (!status->is_eof()) {
+    bail(line, status->read_line());
+    if (line.starts_with("VmRSS:")) { return std::stoll(line.substr(6)); }
+  }
+  return bee::Error("VmRSS not found in /proc/self/status");
+}
+
+vector<Move> legal_moves(const Board& board)
+{
+  auto scratch = Rules::make_scratch(board);
+  MoveVector moves;
+  Rules::list_moves(board, scratch, moves);
+  vector<Move> out;
+  for (const auto& m : moves) {
+    if (Rules::is_legal_move(board, scratch, m)) { out.push_back(m); }
+  }
+  return out;
+}
+
+bee::OrError<bee::Unit> run_benchmark_pcp(
+  const string& pcp_file, bool in_memory, int walks)
+{
+  auto filename = bee::FilePath::of_string(pcp_file);
+  bail(rss_before, resident_memory_kb());
+  auto start = Time::monotonic();
+  bail(
+    pcp,
+    in_memory ? PCP::open_in_memory(filename) : PCP::open_on_disk(filename));
+  auto open_time = Time::monotonic() - start;
+  bail(rss_after, resident_memory_kb());
+  print_line("open_time:$ rss_kb:$", open_time, rss_after - rss_before);
+
+  // Random walks from the initial position, probing every position on the way
+  // like the search does at the first plies
+  auto rng = Random::create(0);
+  uint64_t probes = 0;
+  uint64_t hits = 0;
+  Span probe_time = Span::zero();
+  for (int w = 0; w < walks; w++) {
+    Board board;
+    board.set_initial();
+    for (int ply = 0; ply < 16; ply++) {
+      auto probe_start = Time::monotonic();
+      auto probe = pcp->probe(board.hash_key());
+      probe_time += Time::monotonic() - probe_start;
+      probes++;
+      if (!probe.has_value()) { break; }
+      hits++;
+
+      auto moves = legal_moves(board);
+      if (moves.empty()) { break; }
+      // Mostly follow the book move, so the walks stay inside the book
+      if (rng->rand64() % 4 != 0) {
+        board.move(probe->best_move);
+      } else {
+        board.move(moves[rng->rand64() % moves.size()]);
+      }
+    }
+  }
+
+  bail(rss_end, resident_memory_kb());
+  print_line(
+    "probes:$ hits:$ ns/probe:$ rss_kb_after_probes:$",
+    probes,
+    hits,
+    probe_time.to_float_seconds() * 1e9 / probes,
+    rss_end - rss_before);
+
+  return bee::unit;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// DynPCP contention benchmark
+//
+
+bee::OrError<bee::Unit> run_benchmark_dyn_pcp(
+  int num_workers, int num_positions, int probes_per_worker)
+{
+  // Positions from random walks, all of them in the table
+  auto rng = Random::create(0);
+  vector<PCP::entry> entries;
+  vector<uint64_t> keys;
+  while (std::ssize(entries) < num_positions) {
+    Board board;
+    board.set_initial();
+    for (int ply = 0; ply < 16 && std::ssize(entries) < num_positions; ply++) {
+      auto moves = legal_moves(board);
+      if (moves.empty()) { break; }
+      auto move = moves[rng->rand64() % moves.size()];
+      gr::MoveInfo best{
+        .move = move,
+        .pv = {move},
+        .evaluation = Score::of_milli_pawns(rng->rand64() % 1000),
+        .depth = 20,
+      };
+      auto now = Time::now();
+      entries.push_back(PCP::entry{
+        .fen = board.to_fen(),
+        .think_time = Span::of_seconds(1),
+        .frequency = 1,
+        .ply = ply,
+        .best_moves = {best},
+        .last_update = now,
+        .last_start = now,
+      });
+      keys.push_back(board.hash_key());
+      board.move(move);
+    }
+  }
+
+  auto pcp = make_shared<DynPCP>();
+  for (const auto& e : entries) { pcp->update(e.fen, e); }
+
+  // Workers probe like the search does, while the table keeps being updated
+  // like pcp generation does
+  std::atomic<bool> done = false;
+  std::atomic<uint64_t> hits = 0;
+  int updates = 0;
+  std::thread writer([&] {
+    auto rng = Random::create(1);
+    while (!done.load()) {
+      const auto& e = entries[rng->rand64() % entries.size()];
+      pcp->update(e.fen, e);
+      updates++;
+    }
+  });
+
+  auto start = Time::monotonic();
+  vector<std::thread> workers;
+  for (int w = 0; w < num_workers; w++) {
+    workers.emplace_back([&, w] {
+      auto rng = Random::create(w + 2);
+      uint64_t worker_hits = 0;
+      for (int i = 0; i < probes_per_worker; i++) {
+        auto probe = pcp->probe(keys[rng->rand64() % keys.size()]);
+        if (probe.has_value()) {
+          worker_hits++;
+          if (i % 16 == 0) { pcp->probe_pv(*probe); }
+        }
+      }
+      hits += worker_hits;
+    });
+  }
+  for (auto& t : workers) { t.join(); }
+  auto elapsed = Time::monotonic() - start;
+  done = true;
+  writer.join();
+
+  uint64_t probes = uint64_t(num_workers) * probes_per_worker;
+  print_line(
+    "workers:$ probes:$ hits:$ updates:$ elapsed:$ probes/s:$",
+    num_workers,
+    probes,
+    hits.load(),
+    updates,
+    elapsed,
+    probes / elapsed.to_float_seconds());
+
+  return bee::unit;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Engine core setup benchmark
+//
+
+// Time per root move task, the way mpv search runs them, when each task
+// creates its own core versus when a single core is moved around
+bee::OrError<bee::Unit> run_benchmark_engine_core(int repeat, int depth)
+{
+  Board board;
+  board.set_initial();
+  auto moves = legal_moves(board);
+  auto hash_table = make_shared<TranspositionTable>(1 << 20);
+  auto move_history = make_shared<MoveHistory>();
+  auto should_stop = make_shared<std::atomic_bool>(false);
+  auto create_core = [&](const Board& board) {
+    return EngineCore::create(
+      board,
+      hash_table,
+      move_history,
+      nullptr,
+      false,
+      should_stop,
+      Experiment::base(),
+      EvalParameters::default_params());
+  };
+
+  auto fresh = [&] {
+    for (auto m : moves) {
+      auto mi = board.move(m);
+      auto core = create_core(board);
+      board.undo(m, mi);
+      must(r, core->search_one_depth(depth, Score::min(), Score::max()));
+      assert(r.has_value());
+    }
+  };
+
+  auto core = create_core(board);
+  auto reused = [&] {
+    for (auto m : moves) {
+      core->move(m);
+      must(r, core->search_one_depth(depth, Score::min(), Score::max()));
+      assert(r.has_value());
+      core->undo();
+    }
+  };
+
+  auto time_tasks = [&](const string& name, auto&& run) {
+    hash_table->clear();
+    auto start = Time::monotonic();
+    for (int i = 0; i < repeat; i++) { run(); }
+    auto elapsed = Time::monotonic() - start;
+    print_line("$: $ per task", name, elapsed / (repeat * int(moves.size())));
+  };
+  time_tasks("fresh", fresh);
+  time_tasks("reused", reused);
+
+  return bee::unit;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Bench
+//
+
+// Fixed positions for the bench signature, from openings to endgames.
+// Changing them changes the signature.
+const vector<string> bench_positions = {
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+  "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+  "rnbqkb1r/pp1p1ppp/4pn2/2p5/2PP4/2N5/PP2PPPP/R1BQKBNR w KQkq - 0 4",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPPPNnPP/RNBQK2R w KQ - 1 8",
+  "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P3/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+  "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+  "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+  "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+  "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+  "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+  "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+  "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+  "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+  "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+  "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+  "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+  "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+  "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+  "2r2rk1/pp1bqpp1/2nppn1p/2p3N1/1bP5/1PN3P1/PBQPPPBP/3R1RK1 w - - 0 1",
+  "r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+  "4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+  "5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+  "3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+  "4k3/3q1r2/1N2r1b1/3ppN2/2nPP3/1B1R2n1/2R1Q3/3K4 w - - 5 1",
+  "6k1/3b3r/1p1p4/p1n2p2/1PPNpP1q/P3Q1p1/1R1RB1P1/5K2 b - - 0 1",
+  "r2r1n2/pp2bk2/2p1p2p/3q4/3PN1QP/2P3R1/P4PP1/5RK1 w - - 0 1",
+  "1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+  "6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+  "6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+  "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+  "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+  "3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+  "8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+  "8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+  "7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+  "8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+  "5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+  "8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124",
+  "8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+  "8/2p4P/8/kr6/6R1/8/8/1K6 w - - 0 1",
+  "2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+  "8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+  "8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+  "8/8/3P3k/8/1p6/8/1P6/1K3n2 b - - 0 1",
+  "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+  "8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+  "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+};
+
+// The table size changes the node counts, so it is not a flag
+constexpr size_t bench_hash_size = 1 << 24;
+
+// Searches every position single threaded from an empty table and with no
+// time limit, so the total node count is the same on every machine and only
+// changes when the search does. The speed is reported next to it.
+bee::OrError<bee::Unit> run_bench(int depth, const optional<string>& json_file)
+{
+  const SearchLimits limits{.depth = depth};
+  uint64_t total_nodes = 0;
+  Span total_time = Span::zero();
+  vector<uint64_t> nodes_per_position;
+  for (const auto& fen : bench_positions) {
+    Board board;
+    bail_unit(board.set_fen(fen));
+    auto engine = EngineInProcess::create(
+      Experiment::base(),
+      EvalParameters::default_params(),
+      nullptr,
+      bench_hash_size,
+      true);
+    auto start = Time::monotonic();
+    bail(result, engine->find_best_move(board, limits, nullptr));
+    auto elapsed = Time::monotonic() - start;
+    print_line(
+      "nodes:$ move:$ time:$ fen:$",
+      result->nodes,
+      result->best_move,
+      elapsed,
+      fen);
+    total_nodes += result->nodes;
+    total_time += elapsed;
+    nodes_per_position.push_back(result->nodes);
+  }
+
+  auto nps = uint64_t(total_nodes / total_time.to_float_seconds());
+  print_line("===========================");
+  print_line("Total time (ms) : $", total_time.to_millis());
+  print_line("Nodes searched  : $", total_nodes);
+  print_line("Nodes/second    : $", nps);
+
+  if (json_file.has_value()) {
+    vector<string> position_nodes;
+    for (auto n : nodes_per_position) {
+      position_nodes.push_back(format("$", n));
+    }
+    auto json = format(
+      "{\"depth\":$,\"positions\":$,\"nodes\":$,\"time_ms\":$,\"nps\":$,"
+      "\"nodes_per_position\":[$]}\n",
+      depth,
+      bench_positions.size(),
+      total_nodes,
+      total_time.to_millis(),
+      nps,
+      bee::join(position_nodes, ","));
+    bail_unit(
+      bee::FileWriter::save_file(bee::FilePath::of_string(*json_file), json));
+  }
+
   return bee::unit;
 }
 
@@ -184,15 +740,26 @@ command::Cmd Benchmark::command()
   auto positions_file = builder.required("--positions-file", string_flag);
   auto time_to_think =
     builder.optional_with_default("--search-time-secs", float_flag, 2.0);
+  auto nodes = builder.optional("--nodes", int_flag);
   auto num_positions = builder.optional("--num-positions", int_flag);
   auto num_workers = builder.optional("--num-workers", int_flag);
+  auto memory = builder.optional("--memory", string_flag);
   auto test_mode = builder.no_arg("--test-mode");
   return builder.run([=] {
+    // Searching a fixed number of nodes does the same work on every run, so
+    // that only the speed changes
+    SearchLimits limits{.depth = 30};
+    if (auto n = *nodes; n.has_value()) {
+      limits.nodes = *n;
+    } else {
+      limits.time = Span::of_seconds(*time_to_think);
+    }
     return run_benchmark(
       *positions_file,
-      Span::of_seconds(*time_to_think),
+      limits,
       *num_positions,
       *num_workers,
+      *memory,
       *test_mode);
   });
 }
@@ -201,7 +768,79 @@ command::Cmd Benchmark::command_mpv()
 {
   using namespace command::flags;
   auto builder = command::CommandBuilder("Bechmark mpv overhead");
-  return builder.run([=] { return run_benchmark_mpv(); });
+  auto num_workers =
+    builder.optional_with_default("--num-workers", int_flag, 16);
+  return builder.run([=] { return run_benchmark_mpv(*num_workers); });
+}
+
+command::Cmd Benchmark::command_mpv_sp()
+{
+  using namespace command::flags;
+  auto builder =
+    command::CommandBuilder("Bechmark nodes to depth of single process mpv");
+  auto depth = builder.optional_with_default("--depth", int_flag, 8);
+  auto max_pvs = builder.optional_with_default("--max-pvs", int_flag, 4);
+  return builder.run([=] { return run_benchmark_mpv_sp(*depth, *max_pvs); });
+}
+
+command::Cmd Benchmark::command_repetition()
+{
+  using namespace command::flags;
+  auto builder =
+    command::CommandBuilder("Bechmark repetition checks on shuffling endgames");
+  auto walks = builder.optional_with_default("--walks", int_flag, 100000);
+  auto depth = builder.optional_with_default("--depth", int_flag, 10);
+  return builder.run([=] { return run_benchmark_repetition(*walks, *depth); });
+}
+
+command::Cmd Benchmark::command_pcp()
+{
+  using namespace command::flags;
+  auto builder =
+    command::CommandBuilder("Bechmark opening and probing a pcp file");
+  auto pcp_file = builder.required("--pcp-file", string_flag);
+  auto in_memory = builder.no_arg("--in-memory");
+  auto walks = builder.optional_with_default("--walks", int_flag, 100000);
+  return builder.run(
+    [=] { return run_benchmark_pcp(*pcp_file, *in_memory, *walks); });
+}
+
+command::Cmd Benchmark::command_dyn_pcp()
+{
+  using namespace command::flags;
+  auto builder = command::CommandBuilder(
+    "Bechmark probing a pcp from many threads while it is updated");
+  auto num_workers =
+    builder.optional_with_default("--num-workers", int_flag, 32);
+  auto num_positions =
+    builder.optional_with_default("--num-positions", int_flag, 100000);
+  auto probes = builder.optional_with_default(
+    "--probes-per-worker", int_flag, 1000000);
+  return builder.run([=] {
+    return run_benchmark_dyn_pcp(*num_workers, *num_positions, *probes);
+  });
+}
+
+command::Cmd Benchmark::command_engine_core()
+{
+  using namespace command::flags;
+  auto builder = command::CommandBuilder(
+    "Bechmark the overhead of setting up engine cores for short searches");
+  auto repeat = builder.optional_with_default("--repeat", int_flag, 10000);
+  auto depth = builder.optional_with_default("--depth", int_flag, 1);
+  return builder.run(
+    [=] { return run_benchmark_engine_core(*repeat, *depth); });
+}
+
+command::Cmd Benchmark::command_bench()
+{
+  using namespace command::flags;
+  auto builder = command::CommandBuilder(
+    "Search fixed positions to a fixed depth, printing the node count "
+    "signature and the speed");
+  auto depth = builder.optional_with_default("--depth", int_flag, 9);
+  auto json_file = builder.optional("--json", string_flag);
+  return builder.run([=] { return run_bench(*depth, *json_file); });
 }
 
 } // namespace blackbit
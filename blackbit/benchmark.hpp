@@ -8,6 +8,12 @@ struct Benchmark {
  public:
   static command::Cmd command();
   static command::Cmd command_mpv();
+  static command::Cmd command_mpv_sp();
+  static command::Cmd command_repetition();
+  static command::Cmd command_pcp();
+  static command::Cmd command_dyn_pcp();
+  static command::Cmd command_engine_core();
+  static command::Cmd command_bench();
 };
 
 } // namespace blackbit
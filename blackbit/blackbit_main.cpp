@@ -20,6 +20,7 @@
 #include "eval_game.hpp"
 #include "experiment_runner.hpp"
 #include "pcp_generation.hpp"
+#include "perft.hpp"
 #include "training.hpp"
 #include "view_games.hpp"
 #include "view_positions.hpp"
@@ -53,7 +54,13 @@ bee::OrError<bee::Unit> analyse_positions(
     enable_test ? Experiment::test_with_seed(0) : Experiment::base();
 
   auto state = BotState::create(
-    writer, experiment, EvalParameters::default_params(), false, 30, nullptr);
+    writer,
+    experiment,
+    EvalParameters::default_params(),
+    false,
+    1,
+    30,
+    nullptr);
   state->set_max_time(Span::of_seconds(seconds_per_position));
   state->set_ponder(false);
   state->set_post(true);
@@ -100,10 +107,18 @@ Cmd main_command()
     .cmd("run-experiment", ExperimentRunner::command())
     .cmd("run-benchmark", Benchmark::command())
     .cmd("run-benchmark-mpv", Benchmark::command_mpv())
+    .cmd("run-benchmark-mpv-sp", Benchmark::command_mpv_sp())
+    .cmd("run-benchmark-repetition", Benchmark::command_repetition())
+    .cmd("run-benchmark-pcp", Benchmark::command_pcp())
+    .cmd("run-benchmark-dyn-pcp", Benchmark::command_dyn_pcp())
+    .cmd("run-benchmark-engine-core", Benchmark::command_engine_core())
+    .cmd("bench", Benchmark::command_bench())
+    .cmd("perft", Perft::command())
     .cmd("eval-game", EvalGame::command())
     .cmd("rl", Training::command())
     .cmd("engine-tournament", EngineTournament::command())
     .cmd("gen-pcp", PCPGeneration::command())
+    .cmd("convert-pcp", PCPGeneration::convert_command())
     .build();
 }
 
@@ -170,6 +170,7 @@ void Board::clear()
   turn = Color::White;
   _score.clear(Score::zero());
   _hash_key = 0;
+  _material_key = 0;
   for (int i = 0; i < 2; ++i) {
     for (int j = 0; j < 8; ++j) {
       bbPeca[Color(i)][PieceType(j)] = BitBoard::zero();
@@ -178,6 +179,7 @@ void Board::clear()
   history.clear();
   _base_ply = 0;
   _last_irreversible_move = 0;
+  _repetition_filter = 0;
 
   bb_blockers[Color::Black] = bb_blockers[Color::White] = BitBoard::zero();
 
@@ -512,6 +514,14 @@ bool Board::check_hash_key()
     }
   }
   if (hashk != _hash_key) { return false; }
+
+  uint64_t material_key = 0;
+  for (auto color : AllColors) {
+    for (auto type : AllPieces) {
+      material_key ^= material_hash[type][color][pieces(color, type).size()];
+    }
+  }
+  if (material_key != _material_key) { return false; }
   return true;
 }
 
@@ -540,6 +550,11 @@ void Board::erase_piece(Place place)
   /* update hahs code */
   _hash_key ^= hash_code[place][type][owner];
 
+  /* update material key */
+  int count = pieces(owner, type).size();
+  _material_key ^=
+    material_hash[type][owner][count] ^ material_hash[type][owner][count - 1];
+
   /* erase from piece list */
   erase_piece2(place);
 
@@ -568,6 +583,11 @@ void Board::insert_piece(Place place, PieceType type, Color owner)
   /* update hash code */
   _hash_key ^= hash_code[place][type][owner];
 
+  /* update material key */
+  int count = pieces(owner, type).size();
+  _material_key ^=
+    material_hash[type][owner][count] ^ material_hash[type][owner][count + 1];
+
   /* insrt to piece list */
   insert_piece2(place, type, owner);
 
@@ -628,6 +648,14 @@ void Board::set_piece_type(Place place, PieceType type)
   _hash_key ^= hash_code[place][type][owner];
   _hash_key ^= hash_code[place][prev_type][owner];
 
+  /* update material key */
+  int prev_count = pieces(owner, prev_type).size();
+  int count = pieces(owner, type).size();
+  _material_key ^= material_hash[prev_type][owner][prev_count] ^
+                   material_hash[prev_type][owner][prev_count - 1] ^
+                   material_hash[type][owner][count] ^
+                   material_hash[type][owner][count + 1];
+
   /* update list */
   erase_piece2(place);
   insert_piece2(place, type, owner);
@@ -667,8 +695,12 @@ MoveInfo Board::move(Move m)
   }
 
   mi.last_irreversible_move = _last_irreversible_move;
+  mi.repetition_filter = _repetition_filter;
   if (mi.capturou || (type == PieceType::PAWN)) {
     _last_irreversible_move = history.size();
+    _repetition_filter = 0;
+  } else {
+    _repetition_filter |= _filter_bit(history[history.size() - 1]);
   }
 
   /* faz en passan */
@@ -734,14 +766,19 @@ MoveInfo Board::move(Move m)
     if (is_castle || castle_flags.can_castle(turn)) {
       castle_flags.clear(turn);
     }
-  } else if (type == PieceType::ROOK && castle_flags.can_castle(turn)) {
+  } else if (
+    type == PieceType::ROOK && castle_flags.can_castle(turn) &&
+    m.o.line() == (turn == Color::White ? 0 : 7)) {
     if (m.o.col() == 0) {
       castle_flags.clear_queen(turn);
     } else if (m.o.col() == 7) {
       castle_flags.clear_king(turn);
     }
   }
-  if (taking_type == PieceType::ROOK && (m.d.line() == 0 || m.d.line() == 7)) {
+  // Only a rook taken on its own first line could still castle
+  if (
+    taking_type == PieceType::ROOK &&
+    m.d.line() == (op == Color::White ? 0 : 7)) {
     if (m.d.col() == 0) {
       castle_flags.clear_queen(op);
     } else if (m.d.col() == 7) {
@@ -811,6 +848,7 @@ void Board::undo(Move m, const MoveInfo& mi)
 
   history.pop_back();
   _last_irreversible_move = mi.last_irreversible_move;
+  _repetition_filter = mi.repetition_filter;
 
   ASSERT(checkBoard());
 }
@@ -820,6 +858,8 @@ MoveInfo Board::move_null()
   MoveInfo mi;
 
   /* historico */
+  mi.repetition_filter = _repetition_filter;
+  _repetition_filter |= _filter_bit(_hash_key);
   history.push_back(_hash_key);
 
   /* marca coluna de en passan */
@@ -844,6 +884,7 @@ void Board::undo_null(const MoveInfo& mi)
 
   /* historico */
   history.pop_back();
+  _repetition_filter = mi.repetition_filter;
 }
 
 int Board::moves_since_last_catpure_or_pawn_move() const
@@ -8,6 +8,7 @@
 #include "debug.hpp"
 #include "experiment_framework.hpp"
 #include "generated_board_hashes.hpp"
+#include "hash_history.hpp"
 #include "move.hpp"
 #include "piece_type_array.hpp"
 #include "pieces.hpp"
@@ -47,6 +48,7 @@ struct MoveInfo {
   bool castled = false;
   Place passan_place = Place::invalid();
   int last_irreversible_move;
+  uint64_t repetition_filter;
   Pos p;
 };
 
@@ -63,7 +65,7 @@ struct Board {
   Color turn;
   Place passan_place;
 
-  StaticVector<uint64_t, 1024> history;
+  HashHistory history;
 
   CastleFlags castle_flags = CastleFlags::none();
 
@@ -77,8 +79,6 @@ struct Board {
 
   void set_initial();
 
-  bool is_history_full() const { return history.full(); }
-
   int ply() const { return _base_ply + history.size(); }
 
   void erase_piece2(Place place);
@@ -116,13 +116,17 @@ struct Board {
 
   bool check_hash_key();
 
-  bool repeated() const
+  // Whether the current position appeared before, since the last irreversible
+  // move
+  bool repeated() const { return _find_repetition(history.size(), 1); }
+
+  // Whether the position should be scored as a draw by repetition.
+  // Repeating a position that was reached at or after history index
+  // `search_root` is enough, while positions from the game before that have to
+  // be repeated twice, as in the threefold repetition rule.
+  bool is_repetition_draw(int search_root) const
   {
-    for (auto i = history.begin() + _last_irreversible_move; i < history.end();
-         i++) {
-      if (*i == _hash_key) { return true; }
-    }
-    return false;
+    return _find_repetition(search_root, 2);
   }
 
   bee::OrError<Move> parse_xboard_move_string(
@@ -147,6 +151,10 @@ struct Board {
 
   inline uint64_t hash_key() const { return _hash_key; }
 
+  // Hash of the number of pieces of each type and color, independent of
+  // where they are
+  inline uint64_t material_key() const { return _material_key; }
+
  private:
   PieceVector& mutable_pieces(Color color, PieceType type)
   {
@@ -159,6 +167,28 @@ struct Board {
   ColorArray<PieceTypeArray<PieceVector>> _pieces_table;
   BoardArray<Pos> _squares;
   uint64_t _hash_key;
+  uint64_t _material_key;
+
+  // One bit per key pushed to the history since the last irreversible move,
+  // lets most positions skip scanning the history
+  uint64_t _repetition_filter;
+
+  static uint64_t _filter_bit(uint64_t key) { return 1ull << (key >> 58); }
+
+  bool _find_repetition(int search_root, int game_count) const
+  {
+    if ((_repetition_filter & _filter_bit(_hash_key)) == 0) { return false; }
+    // Only positions with the same side to move can repeat, and it takes at
+    // least 4 plies to get back to the same position
+    const uint64_t* keys = history.begin();
+    int count = 0;
+    for (int i = history.size() - 4; i >= _last_irreversible_move; i -= 2) {
+      if (keys[i] == _hash_key) {
+        if (i >= search_root || ++count >= game_count) { return true; }
+      }
+    }
+    return false;
+  }
 };
 
 } // namespace blackbit
@@ -108,5 +108,70 @@ TEST(blockers)
   run_test("8/8/2nNn3/2nQn3/2nnN3/8/8/8 w");
 }
 
+TEST(copy_shares_history)
+{
+  Board board;
+  board.set_initial();
+  auto play = [](Board& b, const string& m) {
+    must(move, Rules::parse_pretty_move(b, m));
+    b.move(move);
+  };
+  auto show = [](const string& name, const Board& b) {
+    print_line(
+      "$: ply:$ history:$ repeated:$",
+      name,
+      b.ply(),
+      b.history.size(),
+      b.repeated());
+  };
+  play(board, "Nf3");
+  play(board, "Nf6");
+  play(board, "Ng1");
+
+  Board copy = board;
+  play(copy, "Ng8");
+  show("original", board);
+  show("copy", copy);
+
+  play(board, "e5");
+  show("original", board);
+  show("copy", copy);
+  print_line(board.to_fen());
+  print_line(copy.to_fen());
+}
+
+TEST(repetition)
+{
+  Board board;
+  board.set_initial();
+  auto play = [&](const string& m) {
+    must(move, Rules::parse_pretty_move(board, m));
+    board.move(move);
+  };
+  auto show = [&]() {
+    print_line(
+      "ply:$ repeated:$ game_draw:$ search_draw:$",
+      board.ply(),
+      board.repeated(),
+      board.is_repetition_draw(board.history.size()),
+      board.is_repetition_draw(0));
+  };
+  show();
+  for (int i = 0; i < 2; i++) {
+    play("Nf3");
+    show();
+    play("Nf6");
+    show();
+    play("Ng1");
+    show();
+    play("Ng8");
+    show();
+  }
+  play("e4");
+  show();
+  play("e5");
+  show();
+}
+
 } // namespace
 } // namespace blackbit
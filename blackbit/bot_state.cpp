@@ -6,15 +6,23 @@
 #include "pcp.hpp"
 #include "rules.hpp"
 #include "search_result_info.hpp"
+#include "time_manager.hpp"
 
 #include "bee/format_vector.hpp"
 #include "bee/span.hpp"
+#include "bee/time.hpp"
 
+#include <mutex>
 #include <string>
+#include <utility>
 
 using bee::Span;
+using bee::Time;
+using std::make_shared;
+using std::optional;
 using std::shared_ptr;
 using std::string;
+using std::vector;
 
 namespace blackbit {
 namespace {
@@ -31,6 +39,128 @@ void send_result(
     result.make_pretty_moves(board));
 }
 
+vector<Move> legal_moves(const Board& board)
+{
+  auto scratch = Rules::make_scratch(board);
+  MoveVector moves;
+  Rules::list_moves(board, scratch, moves);
+  vector<Move> out;
+  for (const auto& m : moves) {
+    if (Rules::is_legal_move(board, scratch, m)) { out.push_back(m); }
+  }
+  return out;
+}
+
+// Decides, from the results of each iteration, when the best move is settled
+// enough to stop thinking before the time is up. The best move has to stay the
+// same for a few iterations, and either be far ahead of the second best move,
+// when that is known, or keep about the same eval for longer.
+struct SettledTracker {
+ public:
+  explicit SettledTracker(Span think_time) : _think_time(think_time) {}
+
+  void add(const SearchResultInfo& best, optional<Score> second_best)
+  {
+    if (best.depth == _last_depth) { return; }
+    _last_depth = best.depth;
+    if (best.best_move == _best_move) {
+      _stable_iterations++;
+      _min_eval = std::min(_min_eval, best.eval);
+      _max_eval = std::max(_max_eval, best.eval);
+    } else {
+      _best_move = best.best_move;
+      _stable_iterations = 0;
+      _min_eval = _max_eval = best.eval;
+    }
+    _margin = second_best.has_value()
+                ? optional<Score>(best.eval - *second_best)
+                : std::nullopt;
+    _elapsed = best.think_time;
+  }
+
+  bool is_settled() const
+  {
+    if (_last_depth < min_depth) { return false; }
+    if (
+      _margin.has_value() && *_margin >= clear_margin &&
+      _stable_iterations >= 3 && _elapsed * 10 >= _think_time) {
+      return true;
+    }
+    return _stable_iterations >= 6 && _max_eval - _min_eval <= eval_wobble &&
+           _elapsed * 3 >= _think_time;
+  }
+
+ private:
+  static constexpr int min_depth = 8;
+  static constexpr Score clear_margin = Score::of_pawns(2.0);
+  static constexpr Score eval_wobble = Score::of_pawns(0.25);
+
+  const Span _think_time;
+  int _last_depth = 0;
+  Move _best_move = Move::invalid();
+  int _stable_iterations = 0;
+  Score _min_eval = Score::zero();
+  Score _max_eval = Score::zero();
+  optional<Score> _margin;
+  Span _elapsed = Span::zero();
+};
+
+// Lets the search callback stop the search it was called from, even if it
+// gets settled before start_search returned
+template <class T> struct EarlyStop {
+ public:
+  using ptr = shared_ptr<EarlyStop>;
+
+  void set_future(const typename FutureResult<T>::ptr& future)
+  {
+    auto l = std::unique_lock(_mutex);
+    _future = future;
+    if (_settled) { _future->stop_and_forget(); }
+  }
+
+  void settled()
+  {
+    auto l = std::unique_lock(_mutex);
+    if (_settled) { return; }
+    _settled = true;
+    if (_future != nullptr) { _future->stop_and_forget(); }
+  }
+
+  bool is_settled() const
+  {
+    auto l = std::unique_lock(_mutex);
+    return _settled;
+  }
+
+ private:
+  mutable std::mutex _mutex;
+  typename FutureResult<T>::ptr _future;
+  bool _settled = false;
+};
+
+// The search started while pondering, a multi pv one when the bot searches
+// with multi pv, so that a ponder hit gets the same kind of search as a move
+// that wasn't pondered
+struct PonderSearch {
+ public:
+  FutureResult<SearchResultInfo::ptr>::ptr single;
+  FutureResult<vector<SearchResultInfo::ptr>>::ptr mpv;
+
+  void stop_and_wait()
+  {
+    if (single != nullptr) { single->stop_and_wait(); }
+    if (mpv != nullptr) { mpv->stop_and_wait(); }
+  }
+
+  bee::OrError<SearchResultInfo::ptr> wait_at_most(Span span)
+  {
+    if (single != nullptr) { return single->wait_at_most(span); }
+    bail(results, mpv->wait_at_most(span));
+    if (results.empty()) { return bee::Error("Ponder search found no moves"); }
+    return std::move(results[0]);
+  }
+};
+
 struct BotStateImpl : public BotState,
                       public std::enable_shared_from_this<BotStateImpl> {
  public:
@@ -39,6 +169,7 @@ struct BotStateImpl : public BotState,
     const Experiment& experiment,
     const EvalParameters& eval_params,
     bool use_mpv,
+    int mpv_lines,
     int cache_size,
     PCP::ptr&& pcp)
       : _engine(Engine::create(
@@ -47,6 +178,7 @@ struct BotStateImpl : public BotState,
         _logger(writer->logger()),
         _writer(writer),
         _use_mpv(use_mpv),
+        _mpv_lines(mpv_lines),
         _pcp(std::move(pcp))
   {
     _board.set_initial();
@@ -76,6 +208,10 @@ struct BotStateImpl : public BotState,
 
   virtual void reset() override
   {
+    if (_time.saved_this_game() > Span::zero()) {
+      _logger->log_line("Time saved this game: $", _time.saved_this_game());
+    }
+    _time.reset();
     _board.set_initial();
     _ponder = false;
     _post = false;
@@ -99,47 +235,29 @@ struct BotStateImpl : public BotState,
 
   virtual void set_time_control(int mps, Span base, Span inc) override
   {
-    _mps = mps;
-    _base = base;
-    _inc = inc;
+    _time.set_time_control(mps, base, inc);
   }
 
-  virtual void set_max_time(Span max_time) override { _max_time = max_time; }
+  virtual void set_max_time(Span max_time) override
+  {
+    _time.set_max_time(max_time);
+  }
 
   virtual void set_time_remaining(Span time_remaining) override
   {
-    _time_remaining = time_remaining;
+    _time.set_time_remaining(time_remaining);
   }
 
-  virtual Span get_time_remaining() const override { return _time_remaining; }
-
-  Span _get_think_time() const
+  virtual Span get_time_remaining() const override
   {
-    const Span absolute_minimum_time_to_think = Span::of_millis(50);
-    const Span time_buffer = Span::of_millis(10);
-    Span think_time = Span::of_seconds(1);
-    if (_mps > 0 && _inc == Span::zero()) {
-      think_time = _base / _mps;
-    } else if (_mps == 0 && _base > Span::zero()) {
-      think_time =
-        std::max(std::min(_time_remaining, _inc), (_time_remaining / 40));
-    } else if (_max_time > Span::zero()) {
-      think_time = _max_time;
-    }
-    if ((_time_remaining > Span::zero()) && think_time > _time_remaining) {
-      think_time = _time_remaining;
-    }
-    think_time =
-      std::max(absolute_minimum_time_to_think, think_time - time_buffer);
-    assert(think_time > Span::zero() && "Why?");
-    return think_time;
+    return _time.time_remaining();
   }
 
-  auto make_post_callback()
+  auto make_post_callback(const Board& board)
   {
     return [post = _post,
             writer = _writer,
-            board = _board,
+            board = board,
             last_result =
               shared_ptr<SearchResultInfo>(nullptr)](auto&& result) mutable {
       if (post) {
@@ -151,46 +269,126 @@ struct BotStateImpl : public BotState,
     };
   }
 
-  auto make_mpv_post_callback()
+  auto make_post_callback() { return make_post_callback(_board); }
+
+  auto make_mpv_post_callback(const Board& board)
   {
-    return [cb = make_post_callback()](auto&& results) mutable {
+    return [cb = make_post_callback(board)](auto&& results) mutable {
       if (!results.empty()) { cb(results[0]); }
     };
   }
 
+  auto make_mpv_post_callback() { return make_mpv_post_callback(_board); }
+
   bee::OrError<Move> _find_best_move(Span think_time)
   {
+    auto moves = legal_moves(_board);
+    if (moves.size() == 1) {
+      _logger->log_line("Only one legal move, not thinking");
+      return moves[0];
+    }
     if (_pcp != nullptr) {
       auto entry = _pcp->lookup(_board.to_fen());
       if (!entry.is_error() && entry->has_value()) {
         auto& e = **entry;
         send_result(*_writer, *e, _board);
+        _last_pv = e->pv;
         return e->best_move;
       }
     }
     if (_use_mpv) {
-      bail(
-        result,
-        _engine->find_best_moves_mpv(
-          _board, _max_depth, 1, 16, think_time, make_mpv_post_callback()));
+      // With a second line, the margin to the second best move is known
+      using T = vector<SearchResultInfo::ptr>;
+      auto early_stop = make_shared<EarlyStop<T>>();
+      auto future = _engine->start_mpv_search(
+        _board,
+        {.depth = _max_depth},
+        _mpv_lines,
+        16,
+        [cb = make_mpv_post_callback(),
+         tracker = SettledTracker(think_time),
+         early_stop](T&& results) mutable {
+          if (!results.empty()) {
+            tracker.add(
+              *results[0],
+              results.size() > 1 ? optional<Score>(results[1]->eval)
+                                 : std::nullopt);
+            if (tracker.is_settled()) { early_stop->settled(); }
+          }
+          cb(std::move(results));
+        });
+      early_stop->set_future(future);
+      bail(result, future->wait_at_most(think_time));
+      _log_early_stop(*early_stop);
+      _last_pv = result[0]->pv;
       return result[0]->best_move;
     } else {
-      auto weak_ptr = weak_from_this();
+      using T = SearchResultInfo::ptr;
       _current_search_id++;
-      bail(
-        res,
-        _engine->find_best_move(
-          _board, _max_depth, think_time, make_post_callback()));
+      auto early_stop = make_shared<EarlyStop<T>>();
+      auto future = _engine->start_search(
+        _board,
+        {.depth = _max_depth},
+        [cb = make_post_callback(),
+         tracker = SettledTracker(think_time),
+         early_stop](T&& result) mutable {
+          tracker.add(*result, std::nullopt);
+          if (tracker.is_settled()) { early_stop->settled(); }
+          cb(std::move(result));
+        });
+      early_stop->set_future(future);
+      bail(res, future->wait_at_most(think_time));
+      _log_early_stop(*early_stop);
+      _last_pv = res->pv;
       return res->best_move;
     }
   }
 
+  template <class T> void _log_early_stop(const EarlyStop<T>& early_stop)
+  {
+    if (early_stop.is_settled()) {
+      _logger->log_line("Best move settled, stopped thinking early");
+    }
+  }
+
+  void _log_saved_time(Span saved)
+  {
+    if (saved == Span::zero()) { return; }
+    _logger->log_line(
+      "Saved $ on this move, $ this game", saved, _time.saved_this_game());
+  }
+
+  // The search started while pondering is already on the current position,
+  // the time it has been running counts towards the time to think
+  bee::OrError<Move> _finish_ponder_search(Span think_time)
+  {
+    const Span min_wait = Span::of_millis(10);
+    auto pondered = Time::monotonic() - _ponder_start;
+    auto search = std::exchange(_ponder_search, std::nullopt);
+    _ponder_hit = false;
+
+    _logger->log_line(
+      "Ponder hit after pondering for $, hits: $ misses: $",
+      pondered,
+      _ponder_hits,
+      _ponder_misses);
+    auto wait = think_time > pondered ? think_time - pondered : Span::zero();
+    bail(res, search->wait_at_most(std::max(wait, min_wait)));
+    _last_pv = res->pv;
+    return res->best_move;
+  }
+
   virtual bee::OrError<Move> move() override
   {
-    Span think_time = _get_think_time();
+    Span think_time = _time.start_move();
 
     _logger->log_line("Going to think for $", think_time.to_string());
-    auto m_or_error = _find_best_move(think_time);
+    auto start = Time::monotonic();
+    _last_pv.clear();
+    auto m_or_error = _ponder_hit ? _finish_ponder_search(think_time)
+                                  : _find_best_move(think_time);
+    _log_saved_time(
+      _time.finish_move(think_time, Time::monotonic() - start));
     bail(m, std::move(m_or_error));
     if (!Rules::is_legal_move(_board, Rules::make_scratch(_board), m)) {
       bee::print_line("Got invalid move: $\n$", m, _board.to_string());
@@ -199,6 +397,11 @@ struct BotStateImpl : public BotState,
     auto mi = _board.move(m);
     _moves.emplace_back(m, mi);
     _logger->log_line("$", _board.to_fen());
+    _predicted_reply = std::nullopt;
+    if (_last_pv.size() >= 2 && _last_pv[0] == m) {
+      _predicted_reply = _last_pv[1];
+      _predicted_reply_key = _board.hash_key();
+    }
     _maybe_restart_search();
     return m;
   }
@@ -221,6 +424,16 @@ struct BotStateImpl : public BotState,
       _moves.emplace_back(m, mi);
       _logger->log_line("$", _board.to_fen());
     }
+    if (_ponder_move.has_value()) {
+      auto ponder_move = *std::exchange(_ponder_move, std::nullopt);
+      if (ponder_move == m) {
+        // Keep the search running, move() picks it up
+        _ponder_hits++;
+        _ponder_hit = true;
+        return bee::unit;
+      }
+      _ponder_misses++;
+    }
     _maybe_restart_search();
     return bee::unit;
   }
@@ -243,20 +456,48 @@ struct BotStateImpl : public BotState,
 
   void _stop_current_search()
   {
-    if (_move_future != nullptr) {
+    if (_ponder_search.has_value()) {
       _logger->log_line("Stopping search");
-      _move_future->stop_and_wait();
-      _move_future = nullptr;
+      _ponder_search->stop_and_wait();
+      _ponder_search = std::nullopt;
     }
+    _ponder_move = std::nullopt;
+    _ponder_hit = false;
   }
 
+  // Ponders on the position after the reply predicted by our last search, if
+  // there is one. The search runs until the opponent moves. The prediction is
+  // kept for as long as the board stays on the position it was made for, so
+  // that changing a setting restarts the ponder search.
   void _maybe_restart_search()
   {
     _stop_current_search();
-    if (_ponder) {
-      _logger->log_line("Starting search");
-      _move_future = _engine->start_search(_board, 50, make_post_callback());
+    if (
+      !_ponder || !_predicted_reply.has_value() ||
+      _predicted_reply_key != _board.hash_key() ||
+      !Rules::is_legal_move(
+        _board, Rules::make_scratch(_board), *_predicted_reply)) {
+      return;
+    }
+    auto reply = *_predicted_reply;
+    Board ponder_board = _board;
+    ponder_board.move(reply);
+    _logger->log_line("Pondering on $", reply);
+    _ponder_move = reply;
+    _ponder_start = Time::monotonic();
+    PonderSearch search;
+    if (_use_mpv) {
+      search.mpv = _engine->start_mpv_search(
+        ponder_board,
+        {.depth = _max_depth},
+        _mpv_lines,
+        16,
+        make_mpv_post_callback(ponder_board));
+    } else {
+      search.single = _engine->start_search(
+        ponder_board, {.depth = _max_depth}, make_post_callback(ponder_board));
     }
+    _ponder_search = std::move(search);
   }
 
   virtual void undo() override
@@ -271,18 +512,23 @@ struct BotStateImpl : public BotState,
  private:
   Board _board;
   Engine::ptr _engine;
-  FutureResult<SearchResultInfo::ptr>::ptr _move_future;
+  optional<PonderSearch> _ponder_search;
   bool _ponder = false;
   bool _post = false;
   int _max_depth = 50;
 
-  Span _time_remaining = Span::zero();
+  TimeManager _time;
 
-  int _mps = 0;
-  Span _base = Span::zero();
-  Span _inc = Span::zero();
+  // PV of the last search, its second move is the reply we ponder on
+  vector<Move> _last_pv;
+  optional<Move> _predicted_reply;
+  uint64_t _predicted_reply_key = 0;
 
-  Span _max_time = Span::zero();
+  optional<Move> _ponder_move;
+  Time _ponder_start;
+  bool _ponder_hit = false;
+  int _ponder_hits = 0;
+  int _ponder_misses = 0;
 
   Experiment _experiment;
 
@@ -294,6 +540,7 @@ struct BotStateImpl : public BotState,
   std::optional<std::thread> _post_thread;
 
   bool _use_mpv;
+  int _mpv_lines;
 
   bool _torn_down = false;
 
@@ -311,11 +558,18 @@ shared_ptr<BotState> BotState::create(
   const Experiment& experiment,
   const EvalParameters& eval_params,
   bool use_mpv,
+  int mpv_lines,
   int cache_size,
   PCP::ptr&& pcp)
 {
   return make_shared<BotStateImpl>(
-    writer, experiment, eval_params, use_mpv, cache_size, std::move(pcp));
+    writer,
+    experiment,
+    eval_params,
+    use_mpv,
+    mpv_lines,
+    cache_size,
+    std::move(pcp));
 }
 
 } // namespace blackbit
@@ -43,6 +43,7 @@ struct BotState {
     const Experiment& experiment,
     const EvalParameters& eval_params,
     bool use_mpv,
+    int mpv_lines,
     int cache_size,
     PCP::ptr&& pcp);
 };
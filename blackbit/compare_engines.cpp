@@ -2,10 +2,12 @@
 
 #include "engine.hpp"
 #include "generated_game_record.hpp"
+#include "memory_budget.hpp"
 #include "parallel_map.hpp"
 #include "random.hpp"
 #include "rules.hpp"
 #include "self_play.hpp"
+#include "transposition_table.hpp"
 
 #include "bee/file_reader.hpp"
 #include "bee/file_writer.hpp"
@@ -13,6 +15,7 @@
 #include "bee/sampler.hpp"
 #include "bee/span.hpp"
 #include "bee/string_util.hpp"
+#include "bee/time.hpp"
 #include "bee/time_block.hpp"
 #include "bee/util.hpp"
 #include "bif/array.hpp"
@@ -25,16 +28,23 @@
 #include <random>
 #include <sstream>
 
+#include <sys/resource.h>
+
 using bee::format;
 using bee::print_line;
 using bee::Sampler;
 using bee::Span;
+using bee::Time;
 using bee::to_vector;
 using std::function;
+using std::make_shared;
 using std::map;
 using std::mt19937;
+using std::optional;
+using std::pair;
 using std::random_device;
 using std::set;
+using std::shared_ptr;
 using std::string;
 using std::vector;
 
@@ -42,6 +52,19 @@ namespace blackbit {
 
 namespace {
 
+// CPU time used by every thread of the process so far, games per CPU hour
+// compare runs on machines with different loads
+Span process_cpu_time()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  auto to_seconds = [](const timeval& tv) {
+    return double(tv.tv_sec) + double(tv.tv_usec) / 1e6;
+  };
+  return Span::of_seconds(
+    to_seconds(usage.ru_utime) + to_seconds(usage.ru_stime));
+}
+
 template <class T> struct ExpPair {
   T base;
   T test;
@@ -96,10 +119,11 @@ struct GameInfo {
   Color test_color;
   EngineParams base_params;
   EngineParams test_params;
-  Span time_per_move;
+  SearchLimits limits;
   size_t hash_size;
-  int max_depth;
   bool clear_cache_before_move;
+  shared_ptr<TranspositionTable> base_table;
+  shared_ptr<TranspositionTable> test_table;
 };
 
 ExpGameResult run_one_game(const GameInfo& game_info)
@@ -112,10 +136,15 @@ ExpGameResult run_one_game(const GameInfo& game_info)
     .black_params = game_info.test_color == Color::Black
                     ? game_info.test_params
                     : game_info.base_params,
-    .time_per_move = game_info.time_per_move,
+    .limits = game_info.limits,
     .hash_size = game_info.hash_size,
-    .max_depth = game_info.max_depth,
     .clear_cache_before_move = game_info.clear_cache_before_move,
+    .white_table = game_info.test_color == Color::White
+                     ? game_info.test_table
+                     : game_info.base_table,
+    .black_table = game_info.test_color == Color::Black
+                     ? game_info.test_table
+                     : game_info.base_table,
   });
 
   return ExpGameResult{
@@ -190,20 +219,21 @@ bee::OrError<vector<string>> load_positions(
 
 bee::OrError<bee::Unit> CompareEngines::compare(
   const string& positions_file,
-  double seconds_per_move,
+  const SearchLimits& limits,
   const int num_rounds,
   const int num_workers,
   const int repeat_position,
-  const int max_depth,
   const string& result_filename,
   const function<EngineParams()>& create_base_params,
-  const function<EngineParams()>& create_test_params)
+  const function<EngineParams()>& create_test_params,
+  const optional<MemoryBudget>& memory,
+  bool share_tables)
 {
   randomize_seed();
 
-  auto time_per_move = Span::of_seconds(seconds_per_move);
+  print_line("Search limits: $", limits);
 
-  const size_t hash_size = 1 << 24;
+  size_t hash_size = 1 << 24;
   const bool clear_cache_before_move = true;
 
   mt19937 prng((random_device()()));
@@ -229,9 +259,8 @@ bee::OrError<bee::Unit> CompareEngines::compare(
             .test_color = test_color,
             .base_params = base_params,
             .test_params = test_params,
-            .time_per_move = time_per_move,
+            .limits = limits,
             .hash_size = hash_size,
-            .max_depth = max_depth,
             .clear_cache_before_move = clear_cache_before_move,
           };
         };
@@ -247,11 +276,54 @@ bee::OrError<bee::Unit> CompareEngines::compare(
     }
   }
 
+  // Engines on the same side with the same experiment flags can share a
+  // table, the eval parameters are the same for every game of a side
+  using TableKey = pair<bool, map<string, int>>;
+  auto base_key = [](const GameInfo& info) {
+    return TableKey(false, info.base_params.experiment.flags_to_values());
+  };
+  auto test_key = [](const GameInfo& info) {
+    return TableKey(true, info.test_params.experiment.flags_to_values());
+  };
+  map<TableKey, shared_ptr<TranspositionTable>> tables;
+  if (share_tables) {
+    for (const auto& info : game_infos) {
+      tables.emplace(base_key(info), nullptr);
+      tables.emplace(test_key(info), nullptr);
+    }
+  }
+
+  const int num_engines = num_workers * 2;
+  const int num_tables = share_tables ? tables.size() : num_engines;
+  if (memory.has_value()) {
+    bail_assign(hash_size, memory->table_bytes(num_engines, num_tables));
+    print_line(
+      "Memory budget:$ tables:$ table size:$",
+      MemoryBudget::format_bytes(memory->total_bytes()),
+      num_tables,
+      MemoryBudget::format_bytes(hash_size));
+  }
+
+  if (share_tables) {
+    for (auto& [key, table] : tables) {
+      table = make_shared<TranspositionTable>(hash_size);
+    }
+    for (auto& info : game_infos) {
+      info.base_table = tables.at(base_key(info));
+      info.test_table = tables.at(test_key(info));
+    }
+    print_line(
+      "Allocated $ for shared tables",
+      MemoryBudget::format_bytes(TranspositionTable::allocated_bytes()));
+  }
+
   ExpPair<double> result{0, 0};
   bail(
     experiment_result,
     bee::FileWriter::create(bee::FilePath::of_string(result_filename)));
   int games = 0;
+  auto start = Time::monotonic();
+  auto cpu_start = process_cpu_time();
   auto pm = parallel_map::go(game_infos, num_workers, run_one_game);
   for (auto& res : pm) {
     if (res.game_result == GameResult::NotFinished) {
@@ -263,15 +335,20 @@ bee::OrError<bee::Unit> CompareEngines::compare(
     result.test += score.score(res.test_color);
     games++;
 
+    auto hours = (Time::monotonic() - start).to_float_seconds() / 3600.0;
+    auto cpu_hours =
+      (process_cpu_time() - cpu_start).to_float_seconds() / 3600.0;
     print_line(
-      "game:$ base:$($%) test:$($%) delta:$($%)",
+      "game:$ base:$($%) test:$($%) delta:$($%) games/h:$ games/cpu-h:$",
       games,
       format_double(result.base, 1),
       format_double(result.base / games * 100.0, 1),
       format_double(result.test, 1),
       format_double(result.test / games * 100.0, 1),
       format_double(result.test - result.base, 1, true),
-      format_double((result.test - result.base) / games * 100.0, 1, true));
+      format_double((result.test - result.base) / games * 100.0, 1, true),
+      format_double(games / hours, 0),
+      format_double(games / cpu_hours, 0));
 
     if (experiment_result != nullptr) {
       vector<gr::Param> params;
@@ -307,6 +384,12 @@ bee::OrError<bee::Unit> CompareEngines::compare(
     }
   }
 
+  // Without shared tables each game allocates its own, so the total is only
+  // known once they ran
+  print_line(
+    "Allocated at most $ for tables",
+    MemoryBudget::format_bytes(TranspositionTable::peak_allocated_bytes()));
+
   return bee::unit;
 }
 
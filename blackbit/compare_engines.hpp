@@ -1,9 +1,12 @@
 #pragma once
 
 #include "bee/error.hpp"
+#include "memory_budget.hpp"
+#include "search_limits.hpp"
 #include "self_play.hpp"
 
 #include <functional>
+#include <optional>
 #include <string>
 
 namespace blackbit {
@@ -11,14 +14,15 @@ namespace blackbit {
 struct CompareEngines {
   static bee::OrError<bee::Unit> compare(
     const std::string& positions_file,
-    double seconds_per_move,
+    const SearchLimits& limits,
     const int num_rounds,
     const int num_workers,
     const int repeat_position,
-    const int max_depth,
     const std::string& result_filename,
     const std::function<EngineParams()>& create_base_params,
-    const std::function<EngineParams()>& create_test_params);
+    const std::function<EngineParams()>& create_test_params,
+    const std::optional<MemoryBudget>& memory = std::nullopt,
+    bool share_tables = false);
 };
 
 } // namespace blackbit
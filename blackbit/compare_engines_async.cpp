@@ -92,13 +92,13 @@ struct GameInfo {
 };
 
 Task<bee::OrError<ExpGameResult>> run_one_game(
-  const Span time_per_move, const GameInfo game_info)
+  const SearchLimits limits, const GameInfo game_info)
 {
   co_bail(
     result,
     co_await self_play_one_game(
       game_info.starting_fen,
-      time_per_move,
+      limits,
       game_info.get_factory(Color::White),
       game_info.get_factory(Color::Black)));
 
@@ -163,7 +163,7 @@ Deferred<bee::OrError<bee::Unit>> CompareEnginesAsync::compare(
   const string& result_filename,
   const EngineFactory& base_engine_factory,
   const EngineFactory& test_engine_factory,
-  Span time_per_move)
+  const SearchLimits& limits)
 {
   randomize_seed();
 
@@ -220,10 +220,10 @@ Deferred<bee::OrError<bee::Unit>> CompareEnginesAsync::compare(
             results,
             games,
             experiment_result,
-            time_per_move]() mutable -> Deferred<bee::OrError<bee::Unit>> {
+            limits]() mutable -> Deferred<bee::OrError<bee::Unit>> {
              auto info = game_infos->front();
              game_infos->pop();
-             return run_one_game(time_per_move, info)
+             return run_one_game(limits, info)
                .to_deferred()
                .bind(
                  [results, games, experiment_result](
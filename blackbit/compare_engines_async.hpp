@@ -17,7 +17,7 @@ struct CompareEnginesAsync {
     const std::string& result_filename,
     const EngineFactory& base_engine_factory,
     const EngineFactory& test_engine_factory,
-    bee::Span time_per_move);
+    const SearchLimits& limits);
 };
 
 } // namespace blackbit
@@ -0,0 +1,250 @@
+#include "cooperative_engine.hpp"
+
+#include "board.hpp"
+#include "engine.hpp"
+#include "engine_core.hpp"
+#include "engine_runtime.hpp"
+#include "fiber.hpp"
+#include "queue_bridge.hpp"
+
+#include "async/async.hpp"
+#include "async/scheduler_context.hpp"
+#include "bee/error.hpp"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+using namespace async;
+
+using bee::print_err_line;
+using std::function;
+using std::make_shared;
+using std::make_unique;
+using std::nullopt;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+
+namespace blackbit {
+namespace {
+
+using Callback = function<void()>;
+
+// Runs the callbacks pushed from the EngineRuntime threads on the scheduler
+// thread. There is one for all the engines, so that thousands of them don't
+// need thousands of pipes.
+bee::OrError<shared_ptr<QueueBridge<Callback>>> scheduler_bridge()
+{
+  static shared_ptr<QueueBridge<Callback>> bridge;
+  if (bridge != nullptr) { return bridge; }
+
+  bail(pipe, bee::Pipe::create());
+  auto read_fd = pipe.read_fd;
+  read_fd->set_blocking(false);
+  auto new_bridge = make_shared<QueueBridge<Callback>>(pipe.write_fd);
+  bail_unit(add_fd(read_fd, [read_fd, new_bridge]() {
+    bee::DataBuffer buffer;
+    auto res = read_fd->read_all_available(buffer);
+    if (res.is_error()) {
+      print_err_line("Failed to read from engine bridge: $", res.error());
+    }
+    while (auto callback = new_bridge->pop()) { (*callback)(); }
+  }));
+  bridge = new_bridge;
+  return bridge;
+}
+
+// One search, from its first slice until the result is back on the scheduler
+// thread
+struct SlicedSearch : public std::enable_shared_from_this<SlicedSearch> {
+ public:
+  using ptr = shared_ptr<SlicedSearch>;
+
+  SlicedSearch(
+    const shared_ptr<EngineInProcess>& engine,
+    const Board& board,
+    const SearchLimits& limits,
+    uint64_t nodes_per_slice,
+    const EngineRuntime::Strand::ptr& strand,
+    const shared_ptr<QueueBridge<Callback>>& bridge)
+      : _engine(engine),
+        _board(board),
+        _limits(limits),
+        _nodes_per_slice(nodes_per_slice),
+        _strand(strand),
+        _bridge(bridge),
+        _done(Ivar<bee::OrError<SearchResultInfo::ptr>>::create()),
+        _finished(Ivar<bee::Unit>::create())
+  {}
+
+  Task<bee::OrError<SearchResultInfo::ptr>> run()
+  {
+    auto self = shared_from_this();
+    _fiber = Fiber::create([this] { _search(); }, EngineCore::max_stack_size);
+    _strand->post([self] { self->_run_slice(); });
+    co_return co_await _done;
+  }
+
+  // The search ends at its next slice, with the best move found so far
+  void stop() { _stop.store(true); }
+
+  // Resolved on the scheduler thread once the fiber has returned
+  const Ivar<bee::Unit>::ptr& finished() const { return _finished; }
+
+ private:
+  void _search()
+  {
+    _engine->set_node_callback([this] { return _on_slice(); });
+    _result = _engine->find_best_move(_board, _limits, nullptr);
+    _engine->set_node_callback(nullptr);
+  }
+
+  uint64_t _on_slice()
+  {
+    // The first call is at the start of the search, every other one ends a
+    // slice
+    if (std::exchange(_started, true)) { _fiber->yield(); }
+    if (_stop.load()) { return 0; }
+    return _nodes_per_slice;
+  }
+
+  void _run_slice()
+  {
+    if (!_fiber->resume()) {
+      // Goes behind the other engines waiting for a thread
+      _strand->post([self = shared_from_this()] { self->_run_slice(); });
+      return;
+    }
+    _fiber = nullptr;
+    _bridge->push([self = shared_from_this()] {
+      self->_done->resolve(std::move(self->_result));
+      self->_finished->resolve(bee::Unit());
+    });
+  }
+
+  shared_ptr<EngineInProcess> _engine;
+  Board _board;
+  const SearchLimits _limits;
+  const uint64_t _nodes_per_slice;
+  EngineRuntime::Strand::ptr _strand;
+  shared_ptr<QueueBridge<Callback>> _bridge;
+
+  Fiber::ptr _fiber;
+
+  bool _started = false;
+  std::atomic_bool _stop = false;
+
+  bee::OrError<SearchResultInfo::ptr> _result =
+    bee::Error("Search didn't finish");
+  Ivar<bee::OrError<SearchResultInfo::ptr>>::ptr _done;
+  Ivar<bee::Unit>::ptr _finished;
+};
+
+struct CooperativeEngine : public EngineInterface {
+ public:
+  CooperativeEngine(
+    const CooperativeEngineParams& params,
+    const shared_ptr<QueueBridge<Callback>>& bridge)
+      : _params(params),
+        _engine(EngineInProcess::create(
+          params.experiment,
+          params.eval_params,
+          nullptr,
+          params.hash_size,
+          true)),
+        _strand(EngineRuntime::instance().create_strand()),
+        _bridge(bridge),
+        _board(make_unique<Board>()),
+        _limits{.nodes = params.nodes_per_move}
+  {
+    _board->set_initial();
+  }
+
+  ~CooperativeEngine() { assert(_closed); }
+
+  virtual bee::OrError<bee::Unit> set_fen(const string& fen) override
+  {
+    return _board->set_fen(fen);
+  }
+
+  virtual bee::OrError<bee::Unit> set_limits(
+    const SearchLimits& limits) override
+  {
+    auto own = limits;
+    own.time = nullopt;
+    if (_params.nodes_per_move.has_value()) {
+      own.nodes = _params.nodes_per_move;
+    }
+    if (!own.nodes.has_value()) {
+      return bee::Error("Cooperative engines need a node limit");
+    }
+    _limits = own;
+    return bee::ok();
+  }
+
+  virtual bee::OrError<bee::Unit> send_move(const Move& m) override
+  {
+    _board->move(m);
+    return bee::ok();
+  }
+
+  virtual Task<bee::OrError<Move>> find_move() override
+  {
+    if (!_limits.nodes.has_value()) {
+      co_return bee::Error("Cooperative engines need a node limit");
+    }
+    auto search = make_shared<SlicedSearch>(
+      _engine, *_board, _limits, _params.nodes_per_slice, _strand, _bridge);
+    _search = search;
+    auto search_result = co_await search->run();
+    _search = nullptr;
+    co_bail(result, std::move(search_result));
+    _board->move(result->best_move);
+    co_return result->best_move;
+  }
+
+  virtual Task<bee::Unit> close() override
+  {
+    _closed = true;
+    // The strand drops the slices posted once it is closed, which would leave
+    // the fiber suspended and the search never done. A running search is
+    // stopped and waited for instead, then nothing is left on the strand to
+    // block on.
+    if (auto search = _search) {
+      search->stop();
+      co_await search->finished();
+    }
+    _strand->close();
+    co_return bee::unit;
+  }
+
+ private:
+  const CooperativeEngineParams _params;
+
+  // Only used by one search at a time
+  shared_ptr<EngineInProcess> _engine;
+  EngineRuntime::Strand::ptr _strand;
+  shared_ptr<QueueBridge<Callback>> _bridge;
+
+  unique_ptr<Board> _board;
+
+  // The search find_move is waiting for
+  shared_ptr<SlicedSearch> _search;
+
+  // Never with a time limit
+  SearchLimits _limits;
+
+  bool _closed = false;
+};
+
+} // namespace
+
+bee::OrError<EngineInterface::ptr> create_cooperative_engine(
+  const CooperativeEngineParams& params)
+{
+  bail(bridge, scheduler_bridge());
+  return make_unique<CooperativeEngine>(params, bridge);
+}
+
+} // namespace blackbit
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "engine_interface.hpp"
+#include "eval.hpp"
+#include "experiment_framework.hpp"
+
+#include "bee/error.hpp"
+
+#include <cstdint>
+#include <optional>
+
+namespace blackbit {
+
+struct CooperativeEngineParams {
+  Experiment experiment;
+  EvalParameters eval_params;
+  size_t hash_size;
+
+  // Replaces the node limit set on the engine. Searches need one, time limits
+  // are ignored since the threads are shared with the other engines.
+  std::optional<uint64_t> nodes_per_move;
+
+  // Nodes searched before giving the thread to another engine
+  uint64_t nodes_per_slice = 1 << 16;
+};
+
+// In-process engine that shares the EngineRuntime threads with all the others.
+// Its searches run in slices, after each one the thread goes to the next engine
+// waiting for it, so many more games than cores can be played at once. It
+// must be created and used from the async scheduler thread.
+bee::OrError<EngineInterface::ptr> create_cooperative_engine(
+  const CooperativeEngineParams& params);
+
+} // namespace blackbit
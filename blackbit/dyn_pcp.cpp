@@ -0,0 +1,320 @@
+#include "dyn_pcp.hpp"
+
+#include "board.hpp"
+
+#include <cstring>
+#include <functional>
+
+using std::make_shared;
+using std::make_unique;
+using std::nullopt;
+using std::optional;
+using std::pair;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::unordered_map;
+using std::vector;
+
+namespace blackbit {
+
+////////////////////////////////////////////////////////////////////////////////
+// Tables
+//
+
+struct DynPCP::Version {
+  string fen;
+  entry value;
+};
+
+// Open addressing, entries are never removed. A table that gets too full is
+// replaced by a copy twice as big.
+struct DynPCP::FenTable {
+ public:
+  explicit FenTable(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+  vector<std::atomic<shared_ptr<const Version>>> slots;
+  const size_t mask;
+};
+
+// Each slot has a sequence number that is odd while the slot is being written,
+// readers retry when it changes under them. A sequence number of zero marks a
+// slot that was never written.
+struct DynPCP::ProbeTable {
+ public:
+  struct Slot {
+    std::atomic<uint64_t> seq = 0;
+    std::atomic<uint64_t> key = 0;
+    std::atomic<uint64_t> data0 = 0;
+    std::atomic<uint64_t> data1 = 0;
+  };
+
+  explicit ProbeTable(size_t capacity)
+      : slots(make_unique<Slot[]>(capacity)), mask(capacity - 1)
+  {}
+
+  static pair<uint64_t, uint64_t> pack(const PCPProbe& probe)
+  {
+    uint32_t move_bits = 0;
+    static_assert(sizeof(Move) == 3);
+    memcpy(&move_bits, &probe.best_move, sizeof(Move));
+    return {
+      uint64_t(uint32_t(probe.eval.to_milli_pawns())) |
+        (uint64_t(uint16_t(probe.depth)) << 32),
+      uint64_t(move_bits) | (uint64_t(probe.pv_handle) << 24),
+    };
+  }
+
+  static PCPProbe unpack(uint64_t data0, uint64_t data1)
+  {
+    PCPProbe probe;
+    probe.eval = Score::of_milli_pawns(int32_t(data0 & 0xffffffff));
+    probe.depth = int16_t((data0 >> 32) & 0xffff);
+    uint32_t move_bits = data1 & 0xffffff;
+    memcpy(&probe.best_move, &move_bits, sizeof(Move));
+    probe.pv_handle = uint32_t(data1 >> 24);
+    return probe;
+  }
+
+  optional<PCPProbe> find(uint64_t key) const
+  {
+    for (size_t idx = key & mask;; idx = (idx + 1) & mask) {
+      const auto& slot = slots[idx];
+      while (true) {
+        auto seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == 0) { return nullopt; }
+        if (seq & 1) { continue; }
+        auto slot_key = slot.key.load(std::memory_order_relaxed);
+        auto data0 = slot.data0.load(std::memory_order_relaxed);
+        auto data1 = slot.data1.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq) { continue; }
+        if (slot_key != key) { break; }
+        return unpack(data0, data1);
+      }
+    }
+  }
+
+  // Only called by the writer, returns whether the key is new
+  bool insert(uint64_t key, uint64_t data0, uint64_t data1)
+  {
+    size_t idx = key & mask;
+    while (true) {
+      auto& slot = slots[idx];
+      auto seq = slot.seq.load(std::memory_order_relaxed);
+      if (seq == 0 || slot.key.load(std::memory_order_relaxed) == key) {
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.key.store(key, std::memory_order_relaxed);
+        slot.data0.store(data0, std::memory_order_relaxed);
+        slot.data1.store(data1, std::memory_order_relaxed);
+        slot.seq.store(seq + 2, std::memory_order_release);
+        return seq == 0;
+      }
+      idx = (idx + 1) & mask;
+    }
+  }
+
+  unique_ptr<Slot[]> slots;
+  const size_t mask;
+};
+
+// One slot for each position, an update of a position replaces the PV in its
+// slot. Each PV is reference counted and never modified, so a reader holding
+// a handle gets either the old or the new PV of that position.
+struct DynPCP::PVStore {
+ public:
+  using Slot = std::atomic<shared_ptr<const vector<Move>>>;
+
+  PVStore() : _chunks(make_unique<std::atomic<Slot*>[]>(max_chunks)) {}
+
+  // Returns nullopt once every handle is in use
+  optional<uint32_t> push(const vector<Move>& pv)
+  {
+    if (_size >= max_chunks * chunk_size) { return nullopt; }
+    uint32_t handle = _size++;
+    auto& chunk = _chunks[handle >> chunk_bits];
+    auto slots = chunk.load(std::memory_order_relaxed);
+    if (slots == nullptr) {
+      _owned.push_back(make_unique<Slot[]>(chunk_size));
+      slots = _owned.back().get();
+      chunk.store(slots, std::memory_order_release);
+    }
+    set(handle, pv);
+    return handle;
+  }
+
+  void set(uint32_t handle, const vector<Move>& pv)
+  {
+    _slot(handle).store(make_shared<const vector<Move>>(pv));
+  }
+
+  vector<Move> get(uint32_t handle) const { return *_slot(handle).load(); }
+
+ private:
+  Slot& _slot(uint32_t handle) const
+  {
+    auto slots = _chunks[handle >> chunk_bits].load(std::memory_order_acquire);
+    return slots[handle & (chunk_size - 1)];
+  }
+
+  static constexpr size_t chunk_bits = 16;
+  static constexpr size_t chunk_size = size_t(1) << chunk_bits;
+  static constexpr size_t max_chunks = size_t(1) << (32 - chunk_bits);
+
+  unique_ptr<std::atomic<Slot*>[]> _chunks;
+  vector<unique_ptr<Slot[]>> _owned;
+  size_t _size = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// DynPCP
+//
+
+namespace {
+
+constexpr size_t initial_capacity = 1024;
+
+size_t hash_fen(const string& fen) { return std::hash<string>()(fen); }
+
+} // namespace
+
+DynPCP::DynPCP()
+    : _fens(make_shared<FenTable>(initial_capacity)),
+      _pvs(make_unique<PVStore>())
+{
+  _probe_tables.push_back(make_unique<ProbeTable>(initial_capacity));
+  _probes.store(_probe_tables.back().get());
+}
+
+DynPCP::~DynPCP() {}
+
+shared_ptr<const PCP::entry> DynPCP::find(const string& fen) const
+{
+  auto table = _fens.load();
+  for (size_t idx = hash_fen(fen) & table->mask;;
+       idx = (idx + 1) & table->mask) {
+    auto version = table->slots[idx].load();
+    if (version == nullptr) { return nullptr; }
+    if (version->fen == fen) {
+      return shared_ptr<const entry>(version, &version->value);
+    }
+  }
+}
+
+bee::OrError<optional<PCP::entry>> DynPCP::lookup_raw(const string& fen)
+{
+  auto e = find(fen);
+  if (e == nullptr) { return nullopt; }
+  return *e;
+}
+
+bee::OrError<unordered_map<string, PCP::entry>> DynPCP::read_all()
+{
+  auto table = _fens.load();
+  unordered_map<string, entry> out;
+  for (const auto& slot : table->slots) {
+    auto version = slot.load();
+    if (version != nullptr) { out.emplace(version->fen, version->value); }
+  }
+  return out;
+}
+
+optional<PCPProbe> DynPCP::probe(uint64_t hash_key) const
+{
+  return _probes.load(std::memory_order_acquire)->find(hash_key);
+}
+
+vector<Move> DynPCP::probe_pv(const PCPProbe& probe) const
+{
+  return _pvs->get(probe.pv_handle);
+}
+
+void DynPCP::update(const string& fen, const entry& e)
+{
+  Board board;
+  bool valid_fen = !board.set_fen(fen).is_error();
+  auto version = make_shared<const Version>(Version{fen, e});
+
+  std::unique_lock l(_update_lock);
+  _insert_fen(std::move(version));
+  if (!valid_fen || e.best_moves.empty()) { return; }
+
+  const auto& best = e.best_moves[0];
+  PCPProbe probe;
+  probe.eval = best.evaluation.value_or(Score::zero());
+  probe.best_move = best.move;
+  probe.depth = best.depth.value_or(0);
+  auto probes = _probes.load(std::memory_order_relaxed);
+  if (auto previous = probes->find(board.hash_key())) {
+    probe.pv_handle = previous->pv_handle;
+    _pvs->set(probe.pv_handle, best.pv);
+  } else {
+    auto handle = _pvs->push(best.pv);
+    if (!handle.has_value()) { return; }
+    probe.pv_handle = *handle;
+  }
+  _insert_probe(board.hash_key(), probe);
+}
+
+size_t DynPCP::size() const
+{
+  std::unique_lock l(_update_lock);
+  return _num_fens;
+}
+
+void DynPCP::_insert_fen(shared_ptr<const Version>&& version)
+{
+  auto table = _fens.load();
+  if ((_num_fens + 1) * 2 > table->slots.size()) {
+    auto bigger = make_shared<FenTable>(table->slots.size() * 2);
+    for (const auto& slot : table->slots) {
+      auto old = slot.load();
+      if (old == nullptr) { continue; }
+      for (size_t idx = hash_fen(old->fen) & bigger->mask;;
+           idx = (idx + 1) & bigger->mask) {
+        if (bigger->slots[idx].load() == nullptr) {
+          bigger->slots[idx].store(std::move(old));
+          break;
+        }
+      }
+    }
+    _fens.store(bigger);
+    table = std::move(bigger);
+  }
+
+  for (size_t idx = hash_fen(version->fen) & table->mask;;
+       idx = (idx + 1) & table->mask) {
+    auto& slot = table->slots[idx];
+    auto current = slot.load();
+    if (current == nullptr || current->fen == version->fen) {
+      if (current == nullptr) { _num_fens++; }
+      slot.store(std::move(version));
+      return;
+    }
+  }
+}
+
+void DynPCP::_insert_probe(uint64_t hash_key, const PCPProbe& probe)
+{
+  auto table = _probes.load(std::memory_order_relaxed);
+  if ((_num_probes + 1) * 2 > table->mask + 1) {
+    _probe_tables.push_back(make_unique<ProbeTable>((table->mask + 1) * 2));
+    auto bigger = _probe_tables.back().get();
+    for (size_t idx = 0; idx <= table->mask; idx++) {
+      const auto& slot = table->slots[idx];
+      if (slot.seq.load(std::memory_order_relaxed) == 0) { continue; }
+      bigger->insert(
+        slot.key.load(std::memory_order_relaxed),
+        slot.data0.load(std::memory_order_relaxed),
+        slot.data1.load(std::memory_order_relaxed));
+    }
+    _probes.store(bigger, std::memory_order_release);
+    table = bigger;
+  }
+
+  auto [data0, data1] = ProbeTable::pack(probe);
+  if (table->insert(hash_key, data0, data1)) { _num_probes++; }
+}
+
+} // namespace blackbit
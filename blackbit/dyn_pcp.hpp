@@ -0,0 +1,69 @@
+#pragma once
+
+#include "pcp.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace blackbit {
+
+// PCP that is updated while engines are searching with it. Readers never wait
+// on an update. Probes by hash key read fixed size slots guarded by a sequence
+// number and are lock free. Lookups by FEN and probe_pv get a reference counted
+// value that is never modified, an update publishes a new one instead. Those
+// load a std::atomic<std::shared_ptr>, which libstdc++ guards with a spin lock
+// per slot held only while taking the reference, so they can contend with
+// another reader or the writer on the same slot. Updates are serialized between
+// themselves.
+struct DynPCP final : public PCP {
+ public:
+  using ptr = std::shared_ptr<DynPCP>;
+
+  DynPCP();
+  virtual ~DynPCP();
+
+  virtual bee::OrError<std::optional<entry>> lookup_raw(
+    const std::string& fen) override;
+
+  virtual bee::OrError<std::unordered_map<std::string, entry>> read_all()
+    override;
+
+  virtual std::optional<PCPProbe> probe(uint64_t hash_key) const override;
+
+  virtual std::vector<Move> probe_pv(const PCPProbe& probe) const override;
+
+  // Doesn't copy the entry, it stays the same for as long as it is held
+  std::shared_ptr<const entry> find(const std::string& fen) const;
+
+  void update(const std::string& fen, const entry& e);
+
+  size_t size() const;
+
+ private:
+  struct Version;
+  struct FenTable;
+  struct ProbeTable;
+  struct PVStore;
+
+  void _insert_fen(std::shared_ptr<const Version>&& version);
+  void _insert_probe(uint64_t hash_key, const PCPProbe& probe);
+
+  std::atomic<std::shared_ptr<FenTable>> _fens;
+
+  // Probe tables are small, so the ones replaced by a bigger one are kept
+  // around instead of tracking which readers could still be using them
+  std::atomic<ProbeTable*> _probes;
+  std::vector<std::unique_ptr<ProbeTable>> _probe_tables;
+
+  std::unique_ptr<PVStore> _pvs;
+
+  size_t _num_fens = 0;
+  size_t _num_probes = 0;
+
+  mutable std::mutex _update_lock;
+};
+
+} // namespace blackbit
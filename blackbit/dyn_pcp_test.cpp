@@ -0,0 +1,212 @@
+#include "dyn_pcp.hpp"
+
+#include "board.hpp"
+#include "rules.hpp"
+
+#include "bee/format_vector.hpp"
+#include "bee/testing.hpp"
+
+#include <atomic>
+#include <thread>
+
+using bee::print_line;
+using bee::Span;
+using bee::Time;
+using std::string;
+using std::vector;
+
+namespace blackbit {
+namespace {
+
+const string initial_fen =
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+PCP::entry make_entry(const string& fen, const vector<string>& pv, double eval)
+{
+  gr::MoveInfo best{.move = Move::invalid()};
+  Board board;
+  must_unit(board.set_fen(fen));
+  for (const auto& m : pv) {
+    must(move, board.parse_xboard_move_string(m));
+    if (best.pv.empty()) { best.move = move; }
+    best.pv.push_back(move);
+    board.move(move);
+  }
+  best.evaluation = Score::of_pawns(eval);
+  best.depth = 20;
+
+  auto now = Time::now();
+  return PCP::entry{
+    .fen = fen,
+    .think_time = Span::of_seconds(3),
+    .frequency = 1,
+    .ply = 0,
+    .best_moves = {best},
+    .last_update = now,
+    .last_start = now,
+  };
+}
+
+void show_probe(const PCP& pcp, const string& fen)
+{
+  Board board;
+  must_unit(board.set_fen(fen));
+  auto probe = pcp.probe(board.hash_key());
+  if (!probe.has_value()) {
+    print_line("not found");
+    return;
+  }
+  print_line(
+    "eval:$ move:$ depth:$ pv:$",
+    probe->eval,
+    probe->best_move,
+    probe->depth,
+    pcp.probe_pv(*probe));
+}
+
+vector<Move> legal_moves(const Board& board)
+{
+  auto scratch = Rules::make_scratch(board);
+  MoveVector moves;
+  Rules::list_moves(board, scratch, moves);
+  vector<Move> out;
+  for (const auto& m : moves) {
+    if (Rules::is_legal_move(board, scratch, m)) { out.push_back(m); }
+  }
+  return out;
+}
+
+// Positions reached by a fixed sequence of legal moves, enough of them to make
+// the tables grow
+vector<string> many_fens(int count)
+{
+  vector<string> fens;
+  Board board;
+  board.set_initial();
+  while (std::ssize(fens) < count) {
+    fens.push_back(board.to_fen());
+    auto moves = legal_moves(board);
+    if (moves.empty()) {
+      board.set_initial();
+      continue;
+    }
+    board.move(moves[fens.size() % moves.size()]);
+  }
+  return fens;
+}
+
+TEST(update_and_lookup)
+{
+  DynPCP pcp;
+  show_probe(pcp, initial_fen);
+
+  pcp.update(initial_fen, make_entry(initial_fen, {"e2e4", "e7e5"}, 0.3));
+  show_probe(pcp, initial_fen);
+  Board board;
+  board.set_initial();
+  auto first_probe = *pcp.probe(board.hash_key());
+
+  // Entries held by a reader are not affected by later updates
+  auto held = pcp.find(initial_fen);
+  pcp.update(initial_fen, make_entry(initial_fen, {"d2d4"}, 0.2));
+  show_probe(pcp, initial_fen);
+
+  // The PV of a position is replaced in the same slot
+  print_line(
+    "same pv slot:$ old handle pv:$",
+    pcp.probe(board.hash_key())->pv_handle == first_probe.pv_handle,
+    pcp.probe_pv(first_probe));
+  auto current = pcp.find(initial_fen);
+  print_line(
+    "held:$ current:$", held->best_moves[0].move, current->best_moves[0].move);
+
+  auto no_moves = make_entry(initial_fen, {}, 0);
+  no_moves.best_moves.clear();
+  pcp.update(initial_fen, no_moves);
+  show_probe(pcp, initial_fen);
+  print_line("moves:$", pcp.find(initial_fen)->best_moves.size());
+
+  print_line("missing:$", pcp.find("8/8/8/8/8/8/8/K6k w - - 0 1") == nullptr);
+  print_line("size:$", pcp.size());
+}
+
+TEST(grows)
+{
+  DynPCP pcp;
+  auto fens = many_fens(5000);
+  for (const auto& fen : fens) { pcp.update(fen, make_entry(fen, {}, 0.1)); }
+
+  int found = 0;
+  for (const auto& fen : fens) {
+    if (pcp.find(fen) != nullptr) { found++; }
+  }
+  must(all, pcp.read_all());
+  print_line("found:$ read_all:$ size:$", found, all.size(), pcp.size());
+}
+
+TEST(concurrent_readers)
+{
+  DynPCP pcp;
+  auto fens = many_fens(2000);
+
+  // The move written for each position in each round
+  constexpr int rounds = 3;
+  vector<uint64_t> keys;
+  vector<vector<Move>> round_moves;
+  for (const auto& fen : fens) {
+    Board board;
+    must_unit(board.set_fen(fen));
+    keys.push_back(board.hash_key());
+    auto moves = legal_moves(board);
+    round_moves.emplace_back();
+    if (moves.empty()) { continue; }
+    for (int round = 1; round <= rounds; round++) {
+      round_moves.back().push_back(moves[round % moves.size()]);
+    }
+  }
+
+  // Readers check that whatever they find was written as a whole. The PV of a
+  // position can be replaced between the probe and the read of the PV, so it
+  // is from the round of the probe or a later one.
+  std::atomic<bool> done = false;
+  std::atomic<int> torn = 0;
+  vector<std::thread> readers;
+  for (int i = 0; i < 4; i++) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        for (size_t k = 0; k < keys.size(); k++) {
+          auto probe = pcp.probe(keys[k]);
+          if (!probe.has_value()) { continue; }
+          auto pv = pcp.probe_pv(*probe);
+          int round = probe->depth;
+          bool whole = round >= 1 && round <= rounds && pv.size() == 1 &&
+                       probe->best_move == round_moves[k][round - 1] &&
+                       probe->eval == Score::of_milli_pawns(round * 10);
+          bool pv_ok = false;
+          for (int r = round; whole && r <= rounds; r++) {
+            if (pv[0] == round_moves[k][r - 1]) { pv_ok = true; }
+          }
+          if (!pv_ok) { torn++; }
+        }
+      }
+    });
+  }
+
+  for (int round = 1; round <= rounds; round++) {
+    for (size_t k = 0; k < fens.size(); k++) {
+      if (round_moves[k].empty()) { continue; }
+      auto e = make_entry(fens[k], {}, 0);
+      e.best_moves[0].move = round_moves[k][round - 1];
+      e.best_moves[0].pv = {e.best_moves[0].move};
+      e.best_moves[0].depth = round;
+      e.best_moves[0].evaluation = Score::of_milli_pawns(round * 10);
+      pcp.update(fens[k], e);
+    }
+  }
+  done = true;
+  for (auto& t : readers) { t.join(); }
+  print_line("torn:$", torn.load());
+}
+
+} // namespace
+} // namespace blackbit
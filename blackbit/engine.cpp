@@ -3,19 +3,21 @@
 #include "blackbit/move.hpp"
 #include "board.hpp"
 #include "board_array.hpp"
+#include "engine_runtime.hpp"
 #include "engine_core.hpp"
 #include "eval.hpp"
 #include "move_history.hpp"
 #include "mpv_search.hpp"
 #include "rules.hpp"
+#include "search_limits.hpp"
 #include "transposition_table.hpp"
 
 #include "bee/format_optional.hpp"
 #include "bee/format_vector.hpp"
-#include "bee/queue.hpp"
 #include "bee/ref.hpp"
 #include "bee/time.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <future>
@@ -23,7 +25,6 @@
 #include <set>
 #include <variant>
 
-using bee::Queue;
 using bee::Span;
 using bee::Time;
 using std::atomic_bool;
@@ -34,7 +35,6 @@ using std::nullopt;
 using std::optional;
 using std::promise;
 using std::shared_ptr;
-using std::thread;
 using std::unique_ptr;
 using std::variant;
 using std::vector;
@@ -56,6 +56,21 @@ namespace blackbit {
 
 constexpr Score search_window = Score::of_milli_pawns(554);
 
+// Bounds two moves around a mate score. Mates are widened outward, the lower
+// bound toward the mate coming later and the upper one toward it coming
+// sooner, whichever side is mating.
+constexpr Score mate_lower_bound(Score score)
+{
+  return std::max(
+    std::min(score.inc_mate_moves(2), score.dec_mate_moves(2)), Score::min());
+}
+
+constexpr Score mate_upper_bound(Score score)
+{
+  return std::min(
+    std::max(score.inc_mate_moves(2), score.dec_mate_moves(2)), Score::max());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Request
 //
@@ -65,7 +80,7 @@ struct RequestSearch {
   shared_ptr<promise<bee::OrError<SearchResultInfo::ptr>>> movep;
 
   unique_ptr<Board> board;
-  int max_depth;
+  SearchLimits limits;
   function<void(SearchResultInfo::ptr&&)> on_update;
 };
 
@@ -74,7 +89,7 @@ struct RequestMpvSearch {
   shared_ptr<promise<bee::OrError<vector<SearchResultInfo::ptr>>>> result;
 
   unique_ptr<Board> board;
-  int max_depth;
+  SearchLimits limits;
   int max_pvs;
   optional<int> num_workers;
 
@@ -86,33 +101,52 @@ struct RequestMpvSearchSP {
   shared_ptr<promise<bee::OrError<vector<SearchResultInfo::ptr>>>> result;
 
   unique_ptr<Board> board;
-  int max_depth;
+  SearchLimits limits;
   int max_pvs;
 
   function<void(vector<SearchResultInfo::ptr>&&)> on_update;
+
+  optional<SearchResume> resume;
 };
 
 struct Request {
   template <class T> Request(T&& m) : msg(std::move(m)) {}
 
   variant<RequestSearch, RequestMpvSearch, RequestMpvSearchSP> msg;
+
+  // Set when the request starts running
+  shared_ptr<promise<void>> started = make_shared<promise<void>>();
+};
+
+// What the requests of an engine share between them
+struct EngineState {
+  const Experiment experiment;
+  const EvalParameters eval_params;
+  const PCP::ptr pcp;
+  const shared_ptr<TranspositionTable> hash_table;
+  const shared_ptr<MoveHistory> move_history;
+  const bool shared_hash_table;
+  const bool clear_cache_before_move;
 };
 
 namespace {
 bee::OrError<SearchResultInfo::ptr> pv_search(
   const Board& board,
-  int max_depth,
+  const SearchLimits& limits,
   const shared_ptr<TranspositionTable>& hash_table,
   const shared_ptr<MoveHistory>& move_history,
   const PCP::ptr& pcp,
   const shared_ptr<atomic_bool>& should_stop,
   const Experiment& experiment,
   const EvalParameters& eval_params,
-  function<void(SearchResultInfo::ptr&&)>&& on_update)
+  function<void(SearchResultInfo::ptr&&)>&& on_update,
+  EngineCore::NodeCallback node_callback = nullptr)
 {
-  assert(max_depth >= 1);
+  assert(limits.depth >= 1);
   SearchResultInfo::ptr result = nullptr;
 
+  auto limiter = SearchLimiter::create(limits, should_stop);
+
   auto start = Time::monotonic();
 
   uint64_t node_count = 0;
@@ -132,8 +166,9 @@ bee::OrError<SearchResultInfo::ptr> pv_search(
     should_stop,
     experiment,
     eval_params);
+  core->set_node_callback(limiter->node_callback(std::move(node_callback)));
 
-  for (int d = 1; d <= max_depth; ++d) {
+  for (int d = 1; d <= limits.depth; ++d) {
     auto search_once = [&](const Score lower_bound, const Score upper_bound) {
       return core->search_one_depth(d, lower_bound, upper_bound);
     };
@@ -143,8 +178,8 @@ bee::OrError<SearchResultInfo::ptr> pv_search(
       Score upper_bound = Score::max();
       if (result != nullptr) {
         if (result->eval.is_mate()) {
-          lower_bound = result->eval.dec_mate_moves(2);
-          upper_bound = result->eval.inc_mate_moves(2);
+          lower_bound = mate_lower_bound(result->eval);
+          upper_bound = mate_upper_bound(result->eval);
         } else {
           lower_bound = result->eval - search_window;
           upper_bound = result->eval + search_window;
@@ -176,18 +211,39 @@ bee::OrError<SearchResultInfo::ptr> pv_search(
       r->flip(board.turn);
       on_update(std::move(r));
     }
-    if (should_stop->load()) { break; }
+    if (should_stop->load() || limits.is_mate_reached(result->eval)) {
+      break;
+    }
   }
 
   if (result == nullptr) { return bee::Error("Failed to find a move"); }
+  // Includes the nodes of a depth that was cut short
+  if (limiter->reached_node_limit()) { result->nodes = limiter->nodes(); }
   result->flip(board.turn);
 
   return result;
 }
 
+// Stores the moves of the old PVs as entries without bounds, so they are tried
+// first but never used to prune
+void seed_hash_table(
+  const Board& root, TranspositionTable& hash_table, const SearchResume& resume)
+{
+  for (const auto& pv : resume.pvs) {
+    Board board = root;
+    int depth = resume.completed_depth;
+    for (const auto& m : pv) {
+      if (depth <= 0) { break; }
+      hash_table.insert(board, depth, Score::min(), Score::max(), m);
+      board.move(m);
+      depth--;
+    }
+  }
+}
+
 bee::OrError<vector<SearchResultInfo::ptr>> mpv_search_sp(
   const Board& board,
-  int max_depth,
+  const SearchLimits& limits,
   int max_pvs,
   const shared_ptr<TranspositionTable>& hash_table,
   const shared_ptr<MoveHistory>& move_history,
@@ -195,10 +251,19 @@ bee::OrError<vector<SearchResultInfo::ptr>> mpv_search_sp(
   const shared_ptr<atomic_bool>& should_stop,
   const Experiment& experiment,
   const EvalParameters& eval_params,
-  function<void(vector<SearchResultInfo::ptr>&&)>&& on_update)
+  function<void(vector<SearchResultInfo::ptr>&&)>&& on_update,
+  const optional<SearchResume>& resume)
 {
   vector<SearchResultInfo::ptr> results;
 
+  int start_depth = 1;
+  if (resume.has_value()) {
+    seed_hash_table(board, *hash_table, *resume);
+    start_depth = std::clamp(resume->completed_depth + 1, 1, limits.depth);
+  }
+
+  auto limiter = SearchLimiter::create(limits, should_stop);
+
   auto start = Time::monotonic();
 
   uint64_t node_count = 0;
@@ -218,17 +283,56 @@ bee::OrError<vector<SearchResultInfo::ptr>> mpv_search_sp(
     should_stop,
     experiment,
     eval_params);
+  core->set_node_callback(limiter->node_callback());
 
-  for (int d = 1; d <= max_depth; ++d) {
+  for (int d = start_depth; d <= limits.depth; ++d) {
     auto search_once = [&](Score lower_bound, Score upper_bound)
       -> bee::OrError<optional<SearchResultOneDepthMPV>> {
       return core->search_one_depth_mpv(d, max_pvs, lower_bound, upper_bound);
     };
 
+    // The window is around the scores of the previous depth, from below the
+    // k-th best to above the best. A side that fails is widened, and given
+    // up on after failing again.
     auto do_search = [&]() -> bee::OrError<optional<SearchResultOneDepthMPV>> {
       Score lower_bound = Score::min();
       Score upper_bound = Score::max();
-      return search_once(lower_bound, upper_bound);
+      if (!results.empty()) {
+        auto best = results.front()->eval;
+        upper_bound = best.is_mate() ? mate_upper_bound(best)
+                                     : best + search_window;
+        if (std::ssize(results) >= max_pvs) {
+          auto kth = results.back()->eval;
+          lower_bound = kth.is_mate() ? mate_lower_bound(kth)
+                                      : kth - search_window;
+        }
+      }
+      for (int attempt = 0;; attempt++) {
+        bail(r, search_once(lower_bound, upper_bound));
+        if (!r.has_value()) { return nullopt; }
+        bool failed_low = false;
+        bool failed_high = false;
+        for (const auto& res : r->results) {
+          if (lower_bound > Score::min() && res.score() <= lower_bound) {
+            failed_low = true;
+          }
+          if (upper_bound < Score::max() && res.score() >= upper_bound) {
+            failed_high = true;
+          }
+        }
+        if (!failed_low && !failed_high) { return std::move(r); }
+        node_count += r->nodes();
+        auto widen = [&](Score bound, Score delta, Score full) {
+          if (attempt > 0 || bound.is_mate()) { return full; }
+          return bound + delta;
+        };
+        if (failed_low) {
+          lower_bound = widen(lower_bound, -search_window * 4, Score::min());
+        }
+        if (failed_high) {
+          upper_bound = widen(upper_bound, search_window * 4, Score::max());
+        }
+      }
     };
 
     bail(r_opt, do_search());
@@ -257,73 +361,69 @@ bee::OrError<vector<SearchResultInfo::ptr>> mpv_search_sp(
       on_update(std::move(clone));
     }
     if (should_stop->load()) { break; }
+    if (!results.empty() && limits.is_mate_reached(results.front()->eval)) {
+      break;
+    }
   }
 
-  for (auto& r : results) { r->flip(board.turn); }
+  for (auto& r : results) {
+    if (limiter->reached_node_limit()) { r->nodes = limiter->nodes(); }
+    r->flip(board.turn);
+  }
 
   return results;
 }
 
-void run_background_engine(
-  Queue<Request>* queue,
-  const Experiment& experiment,
-  EvalParameters eval_params,
-  const PCP::ptr& pcp,
-  size_t cache_size,
-  bool clear_cache_before_move)
+void run_request(Request& request, EngineState& state)
 {
-  auto _hash_table = make_shared<TranspositionTable>(cache_size);
-  auto _move_history = make_shared<MoveHistory>();
-
-  while (true) {
-    auto r_opt = queue->pop();
-    if (!r_opt.has_value()) break;
-
-    visit(
-      [&]<class T>(T& msg) {
-        if (clear_cache_before_move) {
-          _hash_table->clear();
-          _move_history->clear();
-        }
-        if constexpr (std::is_same_v<T, RequestSearch>) {
-          msg.movep->set_value(pv_search(
-            *msg.board,
-            msg.max_depth,
-            _hash_table,
-            _move_history,
-            pcp,
-            msg.should_stop,
-            experiment,
-            eval_params,
-            std::move(msg.on_update)));
-        } else if constexpr (std::is_same_v<T, RequestMpvSearch>) {
-          msg.result->set_value(MpvSearch::search(
-            std::move(msg.board),
-            msg.max_depth,
-            msg.max_pvs,
-            msg.num_workers,
-            _hash_table,
-            _move_history,
-            msg.should_stop,
-            experiment,
-            eval_params,
-            std::move(msg.on_update)));
-        } else if constexpr (std::is_same_v<T, RequestMpvSearchSP>) {
-          msg.result->set_value(mpv_search_sp(
-            *msg.board,
-            msg.max_depth,
-            msg.max_pvs,
-            _hash_table,
-            _move_history,
-            pcp,
-            msg.should_stop,
-            experiment,
-            eval_params,
-            std::move(msg.on_update)));
-        }
-      },
-      r_opt->msg);
-  }
+  request.started->set_value();
+  visit(
+    [&]<class T>(T& msg) {
+      if (state.clear_cache_before_move) {
+        // Entries of a shared table are still useful to the other engines
+        if (!state.shared_hash_table) { state.hash_table->clear(); }
+        state.move_history->clear();
+      }
+      state.hash_table->new_search();
+      if constexpr (std::is_same_v<T, RequestSearch>) {
+        msg.movep->set_value(pv_search(
+          *msg.board,
+          msg.limits,
+          state.hash_table,
+          state.move_history,
+          state.pcp,
+          msg.should_stop,
+          state.experiment,
+          state.eval_params,
+          std::move(msg.on_update)));
+      } else if constexpr (std::is_same_v<T, RequestMpvSearch>) {
+        msg.result->set_value(MpvSearch::search(
+          std::move(msg.board),
+          msg.limits,
+          msg.max_pvs,
+          msg.num_workers,
+          state.hash_table,
+          state.move_history,
+          msg.should_stop,
+          state.experiment,
+          state.eval_params,
+          std::move(msg.on_update)));
+      } else if constexpr (std::is_same_v<T, RequestMpvSearchSP>) {
+        msg.result->set_value(mpv_search_sp(
+          *msg.board,
+          msg.limits,
+          msg.max_pvs,
+          state.hash_table,
+          state.move_history,
+          state.pcp,
+          msg.should_stop,
+          state.experiment,
+          state.eval_params,
+          std::move(msg.on_update),
+          msg.resume));
+      }
+    },
+    request.msg);
 }
 
 } // namespace
@@ -336,23 +436,37 @@ Engine::Engine(
   const Experiment& experiment,
   const EvalParameters& eval_params,
   const PCP::ptr& pcp,
-  size_t cache_size,
+  const shared_ptr<TranspositionTable>& hash_table,
+  bool shared_hash_table,
   bool clear_cache_before_move)
-    : _queue(make_shared<Queue<Request>>()), _experiment(experiment)
+    : _state(make_shared<EngineState>(EngineState{
+        .experiment = experiment,
+        .eval_params = eval_params,
+        .pcp = pcp,
+        .hash_table = hash_table,
+        .move_history = make_shared<MoveHistory>(),
+        .shared_hash_table = shared_hash_table,
+        .clear_cache_before_move = clear_cache_before_move,
+      })),
+      _strand(EngineRuntime::instance().create_strand()),
+      _experiment(experiment)
 {
-  Queue<Request>* q = &*_queue;
-  _worker = thread(
-    [q, experiment, eval_params, pcp, cache_size, clear_cache_before_move]() {
-      run_background_engine(
-        q, experiment, eval_params, pcp, cache_size, clear_cache_before_move);
-    });
+  if (shared_hash_table) { hash_table->add_user(); }
 }
 
 Engine::~Engine()
 {
   if (_stop_current_computation != nullptr) { _stop_current_computation(); }
-  _queue->close();
-  _worker.join();
+  _strand->close();
+  if (_state->shared_hash_table) { _state->hash_table->remove_user(); }
+}
+
+std::shared_future<void> Engine::_post(Request&& request)
+{
+  auto started = request.started->get_future().share();
+  auto r = make_shared<Request>(std::move(request));
+  _strand->post([r, state = _state]() { run_request(*r, *state); });
+  return started;
 }
 
 Engine::ptr Engine::create(
@@ -363,74 +477,86 @@ Engine::ptr Engine::create(
   bool clear_cache_before_move)
 {
   auto engine = unique_ptr<Engine>(new Engine(
-    experiment, eval_params, pcp, cache_size, clear_cache_before_move));
+    experiment,
+    eval_params,
+    pcp,
+    make_shared<TranspositionTable>(cache_size),
+    false,
+    clear_cache_before_move));
 
   return engine;
 }
 
+Engine::ptr Engine::create_with_shared_table(
+  const Experiment& experiment,
+  const EvalParameters& eval_params,
+  const PCP::ptr& pcp,
+  const shared_ptr<TranspositionTable>& hash_table,
+  bool clear_cache_before_move)
+{
+  return unique_ptr<Engine>(new Engine(
+    experiment, eval_params, pcp, hash_table, true, clear_cache_before_move));
+}
+
 bee::OrError<SearchResultInfo::ptr> Engine::find_best_move(
   const Board& board,
-  int depth,
-  optional<Span> max_time,
+  const SearchLimits& limits,
   function<void(SearchResultInfo::ptr&&)>&& on_update)
 {
-  auto movef = start_search(board, depth, std::move(on_update));
-  return movef->wait_at_most(max_time);
+  return start_search(board, limits, std::move(on_update))->wait();
 }
 
 bee::OrError<vector<SearchResultInfo::ptr>> Engine::find_best_moves_mpv_sp(
   const Board& board,
-  const int max_depth,
+  const SearchLimits& limits,
   const int max_pvs,
-  std::optional<Span> max_time,
-  std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update)
+  std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update,
+  std::optional<SearchResume>&& resume)
 {
-  auto movef =
-    start_mpv_search_sp(board, max_depth, max_pvs, std::move(on_update));
-  return movef->wait_at_most(max_time);
+  auto movef = start_mpv_search_sp(
+    board, limits, max_pvs, std::move(on_update), std::move(resume));
+  return movef->wait();
 }
 
 bee::OrError<vector<SearchResultInfo::ptr>> Engine::find_best_moves_mpv(
   const Board& board,
-  const int max_depth,
+  const SearchLimits& limits,
   const int max_pvs,
   const std::optional<int>& num_workers,
-  std::optional<Span> max_time,
   std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update)
 {
-  auto movef = start_mpv_search(
-    board, max_depth, max_pvs, num_workers, std::move(on_update));
-  return movef->wait_at_most(max_time);
+  auto movef =
+    start_mpv_search(board, limits, max_pvs, num_workers, std::move(on_update));
+  return movef->wait();
 }
 
 FutureResult<SearchResultInfo::ptr>::ptr Engine::start_search(
   const Board& board,
-  int max_depth,
+  const SearchLimits& limits,
   std::function<void(SearchResultInfo::ptr&&)>&& on_update)
 {
   if (_stop_current_computation != nullptr) { _stop_current_computation(); }
   auto should_stop = make_shared<atomic_bool>(false);
   auto movep = make_shared<promise<bee::OrError<SearchResultInfo::ptr>>>();
-  auto future = make_shared<FutureResult<SearchResultInfo::ptr>>(
-    should_stop, movep->get_future());
-
-  _stop_current_computation =
-    FutureResult<SearchResultInfo::ptr>::stop_and_forget_fn(future);
-
-  _queue->push(RequestSearch{
+  auto started = _post(RequestSearch{
     .should_stop = should_stop,
     .movep = movep,
     .board = make_unique<Board>(board),
-    .max_depth = max_depth,
+    .limits = limits,
     .on_update = std::move(on_update),
   });
 
+  auto future = make_shared<FutureResult<SearchResultInfo::ptr>>(
+    should_stop, movep->get_future(), std::move(started));
+  _stop_current_computation =
+    FutureResult<SearchResultInfo::ptr>::stop_and_forget_fn(future);
+
   return future;
 }
 
 FutureResult<vector<SearchResultInfo::ptr>>::ptr Engine::start_mpv_search(
   const Board& board,
-  const int max_depth,
+  const SearchLimits& limits,
   const int max_pvs,
   optional<int> num_workers,
   function<void(vector<SearchResultInfo::ptr>&&)>&& on_update)
@@ -439,50 +565,50 @@ FutureResult<vector<SearchResultInfo::ptr>>::ptr Engine::start_mpv_search(
   auto should_stop = make_shared<atomic_bool>(false);
   auto result =
     make_shared<promise<bee::OrError<vector<SearchResultInfo::ptr>>>>();
-  auto future = make_shared<FutureResult<vector<SearchResultInfo::ptr>>>(
-    should_stop, result->get_future());
-
-  _stop_current_computation =
-    FutureResult<vector<SearchResultInfo::ptr>>::stop_and_forget_fn(future);
-
-  _queue->push(RequestMpvSearch{
+  auto started = _post(RequestMpvSearch{
     .should_stop = should_stop,
     .result = result,
     .board = make_unique<Board>(board),
-    .max_depth = max_depth,
+    .limits = limits,
     .max_pvs = max_pvs,
     .num_workers = num_workers,
     .on_update = std::move(on_update),
   });
 
+  auto future = make_shared<FutureResult<vector<SearchResultInfo::ptr>>>(
+    should_stop, result->get_future(), std::move(started));
+  _stop_current_computation =
+    FutureResult<vector<SearchResultInfo::ptr>>::stop_and_forget_fn(future);
+
   return future;
 }
 
 FutureResult<vector<SearchResultInfo::ptr>>::ptr Engine::start_mpv_search_sp(
   const Board& board,
-  const int max_depth,
+  const SearchLimits& limits,
   const int max_pvs,
-  function<void(vector<SearchResultInfo::ptr>&&)>&& on_update)
+  function<void(vector<SearchResultInfo::ptr>&&)>&& on_update,
+  optional<SearchResume>&& resume)
 {
   if (_stop_current_computation != nullptr) { _stop_current_computation(); }
   auto should_stop = make_shared<atomic_bool>(false);
   auto result =
     make_shared<promise<bee::OrError<vector<SearchResultInfo::ptr>>>>();
-  auto future = make_shared<FutureResult<vector<SearchResultInfo::ptr>>>(
-    should_stop, result->get_future());
-
-  _stop_current_computation =
-    FutureResult<vector<SearchResultInfo::ptr>>::stop_and_forget_fn(future);
-
-  _queue->push(RequestMpvSearchSP{
+  auto started = _post(RequestMpvSearchSP{
     .should_stop = should_stop,
     .result = result,
     .board = make_unique<Board>(board),
-    .max_depth = max_depth,
+    .limits = limits,
     .max_pvs = max_pvs,
     .on_update = std::move(on_update),
+    .resume = std::move(resume),
   });
 
+  auto future = make_shared<FutureResult<vector<SearchResultInfo::ptr>>>(
+    should_stop, result->get_future(), std::move(started));
+  _stop_current_computation =
+    FutureResult<vector<SearchResultInfo::ptr>>::stop_and_forget_fn(future);
+
   return future;
 }
 
@@ -494,17 +620,24 @@ EngineInProcess::EngineInProcess(
   const Experiment& experiment,
   const EvalParameters& eval_params,
   const PCP::ptr& pcp,
-  size_t cache_size,
+  const shared_ptr<TranspositionTable>& hash_table,
+  bool shared_hash_table,
   bool clear_cache_before_move)
     : _experiment(experiment),
       _eval_params(eval_params),
-      _hash_table(make_shared<TranspositionTable>(cache_size)),
+      _hash_table(hash_table),
       _move_history(make_shared<MoveHistory>()),
       _pcp(pcp),
+      _shared_hash_table(shared_hash_table),
       _clear_cache_before_move(clear_cache_before_move)
-{}
+{
+  if (_shared_hash_table) { _hash_table->add_user(); }
+}
 
-EngineInProcess::~EngineInProcess() {}
+EngineInProcess::~EngineInProcess()
+{
+  if (_shared_hash_table) { _hash_table->remove_user(); }
+}
 
 EngineInProcess::ptr EngineInProcess::create(
   const Experiment& experiment,
@@ -514,44 +647,64 @@ EngineInProcess::ptr EngineInProcess::create(
   bool clear_cache_before_move)
 {
   return unique_ptr<EngineInProcess>(new EngineInProcess(
-    experiment, eval_params, pcp, cache_size, clear_cache_before_move));
+    experiment,
+    eval_params,
+    pcp,
+    make_shared<TranspositionTable>(cache_size),
+    false,
+    clear_cache_before_move));
+}
+
+EngineInProcess::ptr EngineInProcess::create_with_shared_table(
+  const Experiment& experiment,
+  const EvalParameters& eval_params,
+  const PCP::ptr& pcp,
+  const shared_ptr<TranspositionTable>& hash_table,
+  bool clear_cache_before_move)
+{
+  return unique_ptr<EngineInProcess>(new EngineInProcess(
+    experiment, eval_params, pcp, hash_table, true, clear_cache_before_move));
 }
 
 void EngineInProcess::set_eval_params(EvalParameters&& eval_params)
 {
   _eval_params = std::move(eval_params);
 
-  _hash_table->clear();
+  if (!_shared_hash_table) { _hash_table->clear(); }
   // _move_history->clear();
 }
 
+void EngineInProcess::set_node_callback(
+  const EngineCore::NodeCallback& callback)
+{
+  _node_callback = callback;
+}
+
 bee::OrError<SearchResultInfo::ptr> EngineInProcess::find_best_move(
   const Board& board,
-  int max_depth,
-  optional<Span> max_time,
+  const SearchLimits& limits,
   function<void(SearchResultInfo::ptr&&)>&& on_update)
 {
   auto should_stop = make_shared<atomic_bool>(false);
 
-  if (max_time.has_value()) {
-    _alarms.add_alarm(*max_time, [=]() { should_stop->store(true); });
-  };
-
   if (_clear_cache_before_move) {
-    _hash_table->clear();
+    // Entries of a shared table are still useful to the other engines
+    if (!_shared_hash_table) { _hash_table->clear(); }
     // _move_history->clear();
   }
+  _hash_table->new_search();
 
   return pv_search(
     board,
-    max_depth,
+    limits,
     _hash_table,
     _move_history,
     _pcp,
     should_stop,
     _experiment,
     _eval_params,
-    std::move(on_update));
+    std::move(on_update),
+    _node_callback);
 }
 
 } // namespace blackbit
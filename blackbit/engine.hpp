@@ -2,14 +2,14 @@
 
 #include "board.hpp"
 #include "engine_core.hpp"
+#include "engine_runtime.hpp"
 #include "eval.hpp"
 #include "experiment_framework.hpp"
 #include "move.hpp"
 #include "move_history.hpp"
+#include "search_limits.hpp"
 #include "transposition_table.hpp"
 
-#include "bee/alarms.hpp"
-#include "bee/queue.hpp"
 #include "bee/span.hpp"
 
 #include <atomic>
@@ -27,6 +27,20 @@ struct MultiPVSearchResultInfo {
   ptr clone() const;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// SearchResume
+//
+
+// What is left of a previous search of the same position. The search seeds
+// the transposition table with the old PVs and continues iterative deepening
+// after the last depth completed, instead of starting again from depth 1.
+struct SearchResume {
+  int completed_depth;
+
+  // PVs of the root moves, best first
+  std::vector<std::vector<Move>> pvs;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // FutureResult
 //
@@ -36,7 +50,8 @@ template <class T> struct FutureResult {
 
   FutureResult(
     std::shared_ptr<std::atomic_bool> should_stop,
-    std::future<bee::OrError<T>> result_fut);
+    std::future<bee::OrError<T>> result_fut,
+    std::shared_future<void> started = {});
 
   bee::OrError<T> result_now();
   bee::OrError<T> wait();
@@ -61,13 +76,17 @@ template <class T> struct FutureResult {
  private:
   std::shared_ptr<std::atomic_bool> _should_stop;
   std::future<bee::OrError<T>> _result_fut;
+  std::shared_future<void> _started;
 };
 
 template <class T>
 FutureResult<T>::FutureResult(
   std::shared_ptr<std::atomic_bool> should_stop,
-  std::future<bee::OrError<T>> result_fut)
-    : _should_stop(std::move(should_stop)), _result_fut(std::move(result_fut))
+  std::future<bee::OrError<T>> result_fut,
+  std::shared_future<void> started)
+    : _should_stop(std::move(should_stop)),
+      _result_fut(std::move(result_fut)),
+      _started(std::move(started))
 {}
 
 template <class T> bee::OrError<T> FutureResult<T>::result_now()
@@ -86,6 +105,10 @@ bee::OrError<T> FutureResult<T>::wait_at_most(std::optional<bee::Span> span)
   assert(_result_fut.valid());
 
   if (span.has_value()) {
+    // Time spent waiting for a thread to run on doesn't count, however busy
+    // the pool is. Once running, the search keeps to its own time limit, the
+    // span only bounds how long to wait for it after that.
+    if (_started.valid()) { _started.wait(); }
     auto status = _result_fut.wait_for(span->to_chrono());
     if (status == std::future_status::timeout) {
       stop_and_forget();
@@ -103,49 +126,53 @@ bee::OrError<T> FutureResult<T>::wait_at_most(std::optional<bee::Span> span)
 //
 
 struct Request;
+struct EngineState;
 
+// Runs its searches on the threads of the EngineRuntime, one at a time. Time
+// limits start counting when a search starts running, not while it waits for
+// a thread. The mpv searches with more than one worker are the only ones that
+// are not deterministic under depth and node limits.
 struct Engine {
  public:
   using ptr = std::unique_ptr<Engine>;
 
   bee::OrError<SearchResultInfo::ptr> find_best_move(
     const Board& board,
-    int depth,
-    std::optional<bee::Span> max_time,
+    const SearchLimits& limits,
     std::function<void(SearchResultInfo::ptr&&)>&& on_update);
 
   bee::OrError<std::vector<SearchResultInfo::ptr>> find_best_moves_mpv(
     const Board& board,
-    const int max_depth,
+    const SearchLimits& limits,
     const int max_pvs,
     const std::optional<int>& num_workers,
-    std::optional<bee::Span> max_time,
     std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update);
 
   bee::OrError<std::vector<SearchResultInfo::ptr>> find_best_moves_mpv_sp(
     const Board& board,
-    const int max_depth,
+    const SearchLimits& limits,
     const int max_pvs,
-    std::optional<bee::Span> max_time,
-    std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update);
+    std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update,
+    std::optional<SearchResume>&& resume = std::nullopt);
 
   FutureResult<SearchResultInfo::ptr>::ptr start_search(
     const Board& board,
-    int max_depth,
+    const SearchLimits& limits,
     std::function<void(SearchResultInfo::ptr&&)>&& on_update);
 
   FutureResult<std::vector<SearchResultInfo::ptr>>::ptr start_mpv_search(
     const Board& board,
-    const int max_depth,
+    const SearchLimits& limits,
     const int max_pvs,
     const std::optional<int> num_workers,
     std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update);
 
   FutureResult<std::vector<SearchResultInfo::ptr>>::ptr start_mpv_search_sp(
     const Board& board,
-    const int max_depth,
+    const SearchLimits& limits,
     const int max_pvs,
-    std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update);
+    std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update,
+    std::optional<SearchResume>&& resume = std::nullopt);
 
   static ptr create(
     const Experiment& experiment,
@@ -154,6 +181,16 @@ struct Engine {
     size_t cache_size,
     bool clear_cache_before_move);
 
+  // The table can be shared with other engines, which might be searching at
+  // the same time. It is aged instead of cleared before each search, so that
+  // the other engines keep their entries.
+  static ptr create_with_shared_table(
+    const Experiment& experiment,
+    const EvalParameters& eval_params,
+    const PCP::ptr& pcp,
+    const std::shared_ptr<TranspositionTable>& hash_table,
+    bool clear_cache_before_move);
+
   ~Engine();
 
  private:
@@ -161,14 +198,17 @@ struct Engine {
     const Experiment& experiment,
     const EvalParameters& eval_params,
     const PCP::ptr& pcp,
-    size_t cache_size,
+    const std::shared_ptr<TranspositionTable>& hash_table,
+    bool shared_hash_table,
     bool clear_cache_before_move);
 
+  std::shared_future<void> _post(Request&& request);
+
   std::function<void()> _stop_current_computation;
 
-  std::shared_ptr<bee::Queue<Request>> _queue;
+  std::shared_ptr<EngineState> _state;
 
-  std::thread _worker;
+  EngineRuntime::Strand::ptr _strand;
 
   const Experiment _experiment;
 };
@@ -183,8 +223,7 @@ struct EngineInProcess {
 
   bee::OrError<SearchResultInfo::ptr> find_best_move(
     const Board& board,
-    int depth,
-    std::optional<bee::Span> max_time,
+    const SearchLimits& limits,
     std::function<void(SearchResultInfo::ptr&&)>&& on_update);
 
   static ptr create(
@@ -194,8 +233,22 @@ struct EngineInProcess {
     size_t cache_size,
     bool clear_cache_before_move);
 
+  // Like Engine::create_with_shared_table, the table is aged instead of
+  // cleared
+  static ptr create_with_shared_table(
+    const Experiment& experiment,
+    const EvalParameters& eval_params,
+    const PCP::ptr& pcp,
+    const std::shared_ptr<TranspositionTable>& hash_table,
+    bool clear_cache_before_move);
+
   void set_eval_params(EvalParameters&& eval_params);
 
+  // Set on the core of every search that follows, see
+  // EngineCore::set_node_callback. The search limits are checked on top of
+  // it.
+  void set_node_callback(const EngineCore::NodeCallback& callback);
+
   ~EngineInProcess();
 
  private:
@@ -203,7 +256,8 @@ struct EngineInProcess {
     const Experiment& experiment,
     const EvalParameters& eval_params,
     const PCP::ptr& pcp,
-    size_t cache_size,
+    const std::shared_ptr<TranspositionTable>& hash_table,
+    bool shared_hash_table,
     bool clear_cache_before_move);
 
   const Experiment _experiment;
@@ -214,13 +268,9 @@ struct EngineInProcess {
 
   PCP::ptr _pcp;
 
-  struct WaitTime {
-    bee::Span wait;
-    std::function<void()> on_done;
-  };
-
-  bee::Alarms _alarms;
+  EngineCore::NodeCallback _node_callback;
 
+  const bool _shared_hash_table;
   const bool _clear_cache_before_move;
 };
 
@@ -2,6 +2,7 @@
 
 #include "board.hpp"
 #include "eval.hpp"
+#include "eval_policy.hpp"
 #include "experiment_framework.hpp"
 #include "move_history.hpp"
 #include "pcp.hpp"
@@ -13,8 +14,10 @@
 #include "bee/format_vector.hpp"
 #include "bee/nref.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <limits>
 #include <memory>
 
 using bee::nref;
@@ -110,20 +113,25 @@ struct SearchResult {
   std::unique_ptr<PV> _pv;
 };
 
+// Best max_pvs results, sorted from best to worst. Results with the same score
+// are kept in the order they were found.
 struct SearchResultMPV {
  public:
-  SearchResultMPV(int max_pvs) : _num_moves(max_pvs) {}
+  SearchResultMPV(int max_pvs) : _num_moves(max_pvs)
+  {
+    _results.reserve(max_pvs + 1);
+  }
 
   void set_score(Score score)
   {
     _results.clear();
-    _results.emplace(score, SearchResult(score));
+    _results.emplace_back(score);
   }
 
   void set_result(SearchResult&& res)
   {
     _results.clear();
-    _results.emplace(res.score(), std::move(res));
+    _results.push_back(std::move(res));
   }
 
   const auto& results() const { return _results; };
@@ -133,14 +141,11 @@ struct SearchResultMPV {
   void set_single_move(Move m, Score score)
   {
     _results.clear();
-    _results.emplace(score, SearchResult::of_single_move(m, score));
+    _results.push_back(SearchResult::of_single_move(m, score));
   }
 
-  const SearchResult& best_result() const { return _results.begin()->second; }
-  const SearchResult& worst_result() const
-  {
-    return (--_results.end())->second;
-  }
+  const SearchResult& best_result() const { return _results.front(); }
+  const SearchResult& worst_result() const { return _results.back(); }
 
   Score max_score() const
   {
@@ -155,11 +160,18 @@ struct SearchResultMPV {
 
   void update_max(Move m, SearchResult&& cand)
   {
-    _results.emplace(cand.score(), SearchResult::combine(m, std::move(cand)));
-    if (std::ssize(_results) > _num_moves) {
-      auto last = --_results.end();
-      _results.erase(last);
+    if (
+      std::ssize(_results) >= _num_moves &&
+      cand.score() <= worst_result().score()) {
+      return;
     }
+    auto it = std::upper_bound(
+      _results.begin(),
+      _results.end(),
+      cand.score(),
+      [](Score score, const SearchResult& res) { return score > res.score(); });
+    _results.insert(it, SearchResult::combine(m, std::move(cand)));
+    if (std::ssize(_results) > _num_moves) { _results.pop_back(); }
   }
 
   nref<PV> best_pv() const
@@ -172,7 +184,7 @@ struct SearchResultMPV {
   }
 
  private:
-  std::multimap<Score, SearchResult, std::greater<Score>> _results;
+  vector<SearchResult> _results;
   const int _num_moves;
 };
 
@@ -194,7 +206,7 @@ template <class T> std::optional<T> front_opt(const vector<T>& v)
   }
 }
 
-struct SearchContext final : public EngineCore {
+template <class EvalPolicy> struct SearchContext final : public EngineCore {
   using ptr = unique_ptr<SearchContext>;
 
   SearchContext(
@@ -213,14 +225,12 @@ struct SearchContext final : public EngineCore {
         _should_stop(should_stop),
         _experiment(experiment),
         _eval_params(eval_params),
-        _allow_partial(allow_partial)
+        _allow_partial(allow_partial),
+        _search_root(_board.history.size())
   {}
 
   virtual ~SearchContext() {}
 
-  bool is_test() const { return _experiment.is_test(); }
-  bool is_base() const { return _experiment.is_base(); }
-
   SearchResult search_rec_outer(
     const EvalScratch& scratch,
     const int depth,
@@ -254,12 +264,19 @@ struct SearchContext final : public EngineCore {
 
     _node_count++;
 
+    if (--_nodes_to_callback == 0) [[unlikely]] {
+      _nodes_to_callback = _node_callback();
+      if (_nodes_to_callback == 0) { _should_stop->store(true); }
+    }
+
     if (_should_stop->load() && _interruptible) {
       throw(SearchInterruptRequested());
     }
 
     if constexpr (!is_root) {
-      if (ply > 512 || Rules::is_draw_without_stalemate(_board)) {
+      if (
+        ply > max_ply ||
+        Rules::is_draw_without_stalemate(_board, _search_root)) {
         result.set_score(Score::zero());
         return result;
       }
@@ -267,11 +284,10 @@ struct SearchContext final : public EngineCore {
 
     if constexpr (!is_root) {
       if (_pcp != nullptr && ply <= 3) {
-        auto entry_opt = _pcp->lookup(_board.to_fen());
-        if (!entry_opt.is_error() && entry_opt->has_value()) {
-          auto& entry = **entry_opt;
+        if (auto probe = _pcp->probe(_board.hash_key())) {
           return Result(
-            entry->eval.flip_for_color(_board.turn), PV::of_vector(entry->pv));
+            probe->eval.flip_for_color(_board.turn),
+            PV::of_vector(_pcp->probe_pv(*probe)));
         }
       }
     }
@@ -294,12 +310,12 @@ struct SearchContext final : public EngineCore {
 
     // Don't use the cache if in quiescent mode
     Move high_pri_move = Move::invalid();
-    const TranspositionTable::hash_slot* slot = nullptr;
+    std::optional<TranspositionTable::hash_slot> slot;
     if (!is_quiescent) {
       slot = _hash_table->find(_board);
 
       // Check hash table
-      if (slot != nullptr) {
+      if (slot.has_value()) {
         if constexpr (!is_root) {
           // Only do cache pruning if not pv so we can get a nice pv sequence
           if (!is_pv) {
@@ -355,7 +371,7 @@ struct SearchContext final : public EngineCore {
           Score new_alpha = max(result.min_score(), input_alpha);
 
           auto depth_to_shorten = [&]() {
-            if (first || (slot == nullptr) || depth < 4 || mi.capturou) {
+            if (first || !slot.has_value() || depth < 4 || mi.capturou) {
               return 0;
             }
             return 2;
@@ -364,7 +380,9 @@ struct SearchContext final : public EngineCore {
           int depth_shortened = depth_to_shorten();
           bool did_pv_search = false;
           SearchResult child_result;
-          if (!first && !is_pv && depth > 1) {
+          // Until there is a score to beat, the null window probe can't
+          // prune anything
+          if (!first && !is_pv && depth > 1 && new_alpha > Score::min()) {
             child_result = search_rec_outer(
               scratch,
               depth - depth_shortened,
@@ -392,7 +410,7 @@ struct SearchContext final : public EngineCore {
           _board.undo(m, mi);
           if constexpr (is_root) {
             if (
-              !result.is_min() && slot != nullptr &&
+              !result.is_min() && slot.has_value() &&
               result.max_score() > input_alpha && _allow_partial) {
               return result;
             }
@@ -445,8 +463,9 @@ struct SearchContext final : public EngineCore {
 
   Score eval_board(const EvalScratch& scratch)
   {
-    return Evaluator::eval_for_current_player(
-      _board, scratch, _experiment, _eval_params);
+    return EvalPolicy::eval_for_white(
+             _board, scratch, _experiment, _eval_params)
+      .neg_if(_board.turn == Color::Black);
   }
 
   virtual bee::OrError<optional<SearchResultOneDepth>> search_one_depth(
@@ -499,7 +518,7 @@ struct SearchContext final : public EngineCore {
     auto& result = *result_or_none;
 
     vector<SearchResultOneDepth> results;
-    for (const auto& [_, res] : result.results()) {
+    for (const auto& res : result.results()) {
       auto pv = pv_to_vector(res.best_pv());
       optional<Move> m = front_opt(pv);
       results.emplace_back(res.score(), m, std::move(pv), _node_count);
@@ -508,6 +527,34 @@ struct SearchContext final : public EngineCore {
     return SearchResultOneDepthMPV(std::move(results));
   }
 
+  virtual void reset(const Board& board) override
+  {
+    _board = board;
+    _moves.clear();
+    _search_root = _board.history.size();
+  }
+
+  virtual void move(Move m) override
+  {
+    _moves.push_back({m, _board.move(m), _search_root});
+    _search_root = _board.history.size();
+  }
+
+  virtual void undo() override
+  {
+    assert(!_moves.empty());
+    const auto& played = _moves.back();
+    _board.undo(played.m, played.mi);
+    _search_root = played.search_root;
+    _moves.pop_back();
+  }
+
+  virtual void set_node_callback(NodeCallback&& callback) override
+  {
+    _node_callback = std::move(callback);
+    _nodes_to_callback = 1;
+  }
+
   uint64_t node_count() const { return _node_count; }
 
   const Board& board() const { return _board; }
@@ -516,6 +563,9 @@ struct SearchContext final : public EngineCore {
   Board _board;
   uint64_t _node_count = 0;
 
+  NodeCallback _node_callback;
+  uint64_t _nodes_to_callback = std::numeric_limits<uint64_t>::max();
+
   shared_ptr<TranspositionTable> _hash_table;
   shared_ptr<MoveHistory> _move_history;
 
@@ -533,6 +583,18 @@ struct SearchContext final : public EngineCore {
 
   const bool _allow_partial;
 
+  // History index of the position the search started from, repeating any
+  // position from there on is scored as a draw
+  int _search_root;
+
+  struct PlayedMove {
+    Move m;
+    MoveInfo mi;
+    int search_root;
+  };
+
+  vector<PlayedMove> _moves;
+
   // Experiments
 };
 
@@ -554,15 +616,24 @@ EngineCore::ptr EngineCore::create(
   const Experiment& experiment,
   const EvalParameters& eval_params)
 {
-  return make_unique<SearchContext>(
-    board,
-    hash_table,
-    move_history,
-    pcp,
-    allow_partial,
-    should_stop,
-    experiment,
-    eval_params);
+  auto create = [&]<class EvalPolicy>() -> EngineCore::ptr {
+    return make_unique<SearchContext<EvalPolicy>>(
+      board,
+      hash_table,
+      move_history,
+      pcp,
+      allow_partial,
+      should_stop,
+      experiment,
+      eval_params);
+  };
+  if (eval_params.custom_eval != nullptr) {
+    return create.operator()<CustomEvalPolicy>();
+  } else if (experiment.is_static_base()) {
+    return create.operator()<StaticBaseEvalPolicy>();
+  } else {
+    return create.operator()<DefaultEvalPolicy>();
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
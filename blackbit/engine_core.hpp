@@ -13,6 +13,7 @@
 #include "bee/ref.hpp"
 
 #include <atomic>
+#include <functional>
 
 namespace blackbit {
 
@@ -75,6 +76,16 @@ struct EngineCore {
   using ptr = std::unique_ptr<EngineCore>;
   virtual ~EngineCore();
 
+  // The search doesn't recurse more than this many plies from the root
+  static constexpr int max_ply = 512;
+
+  // Stack a search can need, for running it on a stack of its own. A ply
+  // takes a few hundred bytes, the extra is for what is called at the deepest
+  // one, like the eval and the node callback.
+  static constexpr size_t stack_bytes_per_ply = 4 << 10;
+  static constexpr size_t max_stack_size =
+    max_ply * stack_bytes_per_ply + (64 << 10);
+
   virtual bee::OrError<std::optional<SearchResultOneDepth>> search_one_depth(
     int depth, Score lower_bound, Score upper_bound) = 0;
 
@@ -82,6 +93,19 @@ struct EngineCore {
   search_one_depth_mpv(
     int depth, int max_pvs, Score lower_bound, Score upper_bound) = 0;
 
+  // Repositions the core in place, so that it can be reused for many searches
+  // instead of creating a new one for each. After a move the core searches as
+  // if it had been created with the board after the move.
+  virtual void reset(const Board& board) = 0;
+  virtual void move(Move m) = 0;
+  virtual void undo() = 0;
+
+  // Called from inside the search at the first node, and then again after as
+  // many nodes as it returned, counting across searches. Returning 0 stops
+  // the search as if should_stop had been set.
+  using NodeCallback = std::function<uint64_t()>;
+  virtual void set_node_callback(NodeCallback&& callback) = 0;
+
   static ptr create(
     const Board& board,
     const std::shared_ptr<TranspositionTable>& hash_table,
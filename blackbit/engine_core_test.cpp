@@ -1,11 +1,14 @@
 #include "engine_core.hpp"
 
 #include "eval.hpp"
+#include "fiber.hpp"
 #include "transposition_table.hpp"
 
 #include "bee/format_optional.hpp"
 #include "bee/testing.hpp"
 
+#include <algorithm>
+
 using bee::print_line;
 using std::atomic_bool;
 using std::make_shared;
@@ -13,10 +16,8 @@ using std::make_shared;
 namespace blackbit {
 namespace {
 
-auto make_engine()
+auto make_engine(const Board& board)
 {
-  Board board;
-  board.set_initial();
   auto hash_table = make_shared<TranspositionTable>(100);
   auto move_history = make_shared<MoveHistory>();
   auto should_stop = make_shared<atomic_bool>(false);
@@ -32,6 +33,13 @@ auto make_engine()
     EvalParameters::default_params());
 }
 
+auto make_engine()
+{
+  Board board;
+  board.set_initial();
+  return make_engine(board);
+}
+
 TEST(pv)
 {
   auto core = make_engine();
@@ -46,5 +54,65 @@ TEST(mpv)
   print_line(result);
 }
 
+TEST(reposition)
+{
+  Board board;
+  board.set_initial();
+  auto core = make_engine(board);
+  must(m, board.parse_xboard_move_string("e2e4"));
+  board.move(m);
+
+  core->move(m);
+  print_line(core->search_one_depth(3, Score::min(), Score::max()));
+  print_line(
+    make_engine(board)->search_one_depth(3, Score::min(), Score::max()));
+
+  core->undo();
+  print_line(core->search_one_depth(3, Score::min(), Score::max()));
+
+  core->reset(board);
+  print_line(core->search_one_depth(3, Score::min(), Score::max()));
+}
+
+TEST(node_callback)
+{
+  auto core = make_engine();
+  uint64_t nodes = 0;
+  uint64_t next = 1;
+  int calls = 0;
+  core->set_node_callback([&]() -> uint64_t {
+    calls++;
+    nodes += next;
+    if (nodes >= 1000) { return 0; }
+    next = std::min<uint64_t>(100, 1000 - nodes);
+    return next;
+  });
+
+  must(result, core->search_one_depth(2, Score::min(), Score::max()));
+  print_line("nodes:$ calls:$ counted:$", result->nodes(), calls, nodes);
+
+  // Counts across searches and stops at exactly 1000 nodes
+  must(stopped, core->search_one_depth(5, Score::min(), Score::max()));
+  print_line("stopped:$ calls:$ counted:$", !stopped.has_value(), calls, nodes);
+}
+
+TEST(search_on_fiber)
+{
+  // Lots of captures, so the quiescence search goes deep
+  Board board;
+  must_unit(board.set_fen(
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+  auto core = make_engine(board);
+  bool found_move = false;
+  auto fiber = Fiber::create(
+    [&] {
+      auto result = core->search_one_depth(5, Score::min(), Score::max());
+      found_move = !result.is_error() && result->has_value();
+    },
+    EngineCore::max_stack_size);
+  fiber->resume();
+  print_line("finished:$ found_move:$", fiber->finished(), found_move);
+}
+
 } // namespace
 } // namespace blackbit
@@ -4,6 +4,7 @@
 #include "bee/error.hpp"
 #include "bee/time.hpp"
 #include "move.hpp"
+#include "search_limits.hpp"
 
 #include <memory>
 
@@ -15,8 +16,8 @@ struct EngineInterface {
 
   virtual ~EngineInterface();
   virtual bee::OrError<bee::Unit> set_fen(const std::string& fen) = 0;
-  virtual bee::OrError<bee::Unit> set_time_per_move(
-    const bee::Span time_per_move) = 0;
+  // Fails for limits the engine can't follow
+  virtual bee::OrError<bee::Unit> set_limits(const SearchLimits& limits) = 0;
   virtual bee::OrError<bee::Unit> send_move(const Move& m) = 0;
   virtual async::Task<bee::OrError<Move>> find_move() = 0;
   virtual async::Task<bee::Unit> close() = 0;
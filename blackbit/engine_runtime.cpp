@@ -0,0 +1,117 @@
+#include "engine_runtime.hpp"
+
+#include <algorithm>
+
+using std::function;
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+namespace blackbit {
+
+////////////////////////////////////////////////////////////////////////////////
+// Strand
+//
+
+EngineRuntime::Strand::Strand(EngineRuntime& runtime) : _runtime(runtime) {}
+
+void EngineRuntime::Strand::post(function<void()>&& task)
+{
+  {
+    lock_guard<mutex> l(_lock);
+    if (_closed) { return; }
+    _tasks.push_back(std::move(task));
+    if (_scheduled) { return; }
+    _scheduled = true;
+  }
+  _runtime._schedule(shared_from_this());
+}
+
+void EngineRuntime::Strand::close()
+{
+  unique_lock<mutex> l(_lock);
+  _closed = true;
+  _idle.wait(l, [this] { return !_scheduled; });
+}
+
+void EngineRuntime::Strand::_run_one()
+{
+  function<void()> task;
+  {
+    lock_guard<mutex> l(_lock);
+    task = std::move(_tasks.front());
+    _tasks.pop_front();
+  }
+
+  task();
+
+  {
+    lock_guard<mutex> l(_lock);
+    if (_tasks.empty()) {
+      _scheduled = false;
+      _idle.notify_all();
+      return;
+    }
+  }
+  // Goes to the back of the line, behind the strands that were waiting
+  _runtime._schedule(shared_from_this());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// EngineRuntime
+//
+
+EngineRuntime::EngineRuntime(int num_threads)
+{
+  for (int i = 0; i < num_threads; i++) {
+    _threads.emplace_back([this] { _run_thread(); });
+  }
+}
+
+EngineRuntime::~EngineRuntime()
+{
+  {
+    lock_guard<mutex> l(_lock);
+    _closed = true;
+  }
+  _ready_cond.notify_all();
+  for (auto& t : _threads) { t.join(); }
+}
+
+EngineRuntime& EngineRuntime::instance()
+{
+  static EngineRuntime runtime(
+    std::max<int>(1, std::thread::hardware_concurrency()));
+  return runtime;
+}
+
+EngineRuntime::Strand::ptr EngineRuntime::create_strand()
+{
+  return Strand::ptr(new Strand(*this));
+}
+
+void EngineRuntime::_schedule(Strand::ptr&& strand)
+{
+  {
+    lock_guard<mutex> l(_lock);
+    _ready.push_back(std::move(strand));
+  }
+  _ready_cond.notify_one();
+}
+
+void EngineRuntime::_run_thread()
+{
+  while (true) {
+    Strand::ptr strand;
+    {
+      unique_lock<mutex> l(_lock);
+      _ready_cond.wait(l, [this] { return _closed || !_ready.empty(); });
+      if (_ready.empty()) { return; }
+      strand = std::move(_ready.front());
+      _ready.pop_front();
+    }
+    strand->_run_one();
+  }
+}
+
+} // namespace blackbit
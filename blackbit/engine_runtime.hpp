@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace blackbit {
+
+// Threads shared by all the engines of the process, as many as the hardware
+// runs at once. Each engine runs its requests on its own strand: the tasks of a
+// strand run one at a time and in the order they were posted, on whichever
+// thread is free. Strands with pending tasks take turns, one task at a time,
+// so no engine waits behind more than one task of each of the others.
+//
+// A task holds its thread until it returns, so a search that is never stopped
+// takes a thread away from all the other engines, and the turns are taken
+// between whole searches, not parts of them. The workers of an mpv search are
+// tasks too.
+//
+// Only Engine and CooperativeEngine run here. EngineInProcess searches on the
+// thread that calls it, so the drivers built on it, like compare_engines,
+// self_play and training, still use one thread per game they play at once.
+struct EngineRuntime {
+ public:
+  struct Strand : public std::enable_shared_from_this<Strand> {
+   public:
+    using ptr = std::shared_ptr<Strand>;
+
+    // Tasks posted after the strand is closed are dropped
+    void post(std::function<void()>&& task);
+
+    // Waits for the tasks that were already posted to finish
+    void close();
+
+   private:
+    friend struct EngineRuntime;
+
+    explicit Strand(EngineRuntime& runtime);
+
+    void _run_one();
+
+    EngineRuntime& _runtime;
+
+    std::mutex _lock;
+    std::condition_variable _idle;
+    std::deque<std::function<void()>> _tasks;
+
+    // Whether the strand is queued on the runtime or running a task
+    bool _scheduled = false;
+    bool _closed = false;
+  };
+
+  static EngineRuntime& instance();
+
+  Strand::ptr create_strand();
+
+  int num_threads() const { return _threads.size(); }
+
+  ~EngineRuntime();
+
+ private:
+  explicit EngineRuntime(int num_threads);
+
+  void _schedule(Strand::ptr&& strand);
+
+  void _run_thread();
+
+  std::mutex _lock;
+  std::condition_variable _ready_cond;
+  std::deque<Strand::ptr> _ready;
+  bool _closed = false;
+
+  std::vector<std::thread> _threads;
+};
+
+} // namespace blackbit
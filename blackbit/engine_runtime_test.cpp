@@ -0,0 +1,66 @@
+#include "engine_runtime.hpp"
+
+#include "bee/format_vector.hpp"
+#include "bee/testing.hpp"
+
+#include <atomic>
+
+using bee::print_line;
+using std::vector;
+
+namespace blackbit {
+namespace {
+
+TEST(strands_run_in_order)
+{
+  auto& runtime = EngineRuntime::instance();
+  const int num_strands = 8;
+  const int num_tasks = 1000;
+
+  vector<EngineRuntime::Strand::ptr> strands;
+  vector<vector<int>> ran(num_strands);
+  std::atomic<int> running = 0;
+  std::atomic<bool> overlapped = false;
+  for (int i = 0; i < num_strands; i++) {
+    strands.push_back(runtime.create_strand());
+  }
+  for (int t = 0; t < num_tasks; t++) {
+    for (int i = 0; i < num_strands; i++) {
+      strands[i]->post([&, i, t] {
+        // Only the tasks of different strands can run at the same time
+        if (running.fetch_add(1 << i) & (1 << i)) { overlapped = true; }
+        ran[i].push_back(t);
+        running.fetch_sub(1 << i);
+      });
+    }
+  }
+  for (auto& strand : strands) { strand->close(); }
+
+  bool in_order = true;
+  for (const auto& r : ran) {
+    if (std::ssize(r) != num_tasks) { in_order = false; }
+    for (int t = 0; t < std::ssize(r); t++) {
+      if (r[t] != t) { in_order = false; }
+    }
+  }
+  print_line("in_order:$ overlapped:$", in_order, overlapped.load());
+}
+
+TEST(close)
+{
+  auto strand = EngineRuntime::instance().create_strand();
+  vector<int> ran;
+  for (int i = 0; i < 3; i++) {
+    strand->post([&, i] { ran.push_back(i); });
+  }
+  strand->close();
+  print_line(ran);
+
+  // Ignored once closed
+  strand->post([&] { ran.push_back(3); });
+  strand->close();
+  print_line(ran);
+}
+
+} // namespace
+} // namespace blackbit
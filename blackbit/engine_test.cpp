@@ -42,7 +42,7 @@ void run_test_in_proc(const optional<string>& fen)
   } else {
     board.set_initial();
   }
-  must(res, engine->find_best_move(board, 2, nullopt, print_callback(board)));
+  must(res, engine->find_best_move(board, {.depth = 2}, print_callback(board)));
   auto move = res->best_move;
   assert(move.is_valid());
   print_line(pp(board, move));
@@ -65,7 +65,9 @@ TEST(basic)
       false);
     Board board;
     board.set_initial();
-    must(res, engine->find_best_move(board, 2, nullopt, print_callback(board)));
+    must(
+      res,
+      engine->find_best_move(board, {.depth = 2}, print_callback(board)));
     auto move = res->best_move;
     assert(move.is_valid());
     print_line(pp(board, move));
@@ -81,7 +83,8 @@ TEST(background)
     Experiment::base(), EvalParameters::default_params(), nullptr, 100, false);
   Board board;
   board.set_initial();
-  auto move_future = engine->start_search(board, 2, print_callback(board));
+  auto move_future =
+    engine->start_search(board, {.depth = 2}, print_callback(board));
   must(res, move_future->wait());
   auto move = res->best_move;
   assert(move.is_valid());
@@ -95,7 +98,8 @@ TEST(background_multiple_searches)
   Board board;
   board.set_initial();
   for (int i = 0; i < 4; i++) {
-    auto move_future = engine->start_search(board, 2, print_callback(board));
+    auto move_future =
+      engine->start_search(board, {.depth = 2}, print_callback(board));
     must(res, move_future->wait());
     auto move = res->best_move;
     assert(move.is_valid());
@@ -114,7 +118,7 @@ TEST(background_timed)
     Experiment::base(), EvalParameters::default_params(), nullptr, 100, false);
   Board board;
   board.set_initial();
-  auto move_future = engine->start_search(board, 1000, nullptr);
+  auto move_future = engine->start_search(board, {.depth = 1000}, nullptr);
   sleep_ms(100);
   must(res, move_future->wait_at_most(Span::zero()));
   auto move = res->best_move;
@@ -133,7 +137,9 @@ TEST(background_cache_size)
       false);
     Board board;
     board.set_initial();
-    must(res, engine->find_best_move(board, 4, nullopt, print_callback(board)));
+    must(
+      res,
+      engine->find_best_move(board, {.depth = 4}, print_callback(board)));
     auto move = res->best_move;
     assert(move.is_valid());
     print_line(pp(board, move));
@@ -149,7 +155,11 @@ TEST(multi_pv_search)
   Board board;
   board.set_initial();
   auto move_future = engine->start_mpv_search(
-    board, 1, 5, 1, [board](const vector<SearchResultInfo::ptr>& results) {
+    board,
+    {.depth = 1},
+    5,
+    1,
+    [board](const vector<SearchResultInfo::ptr>& results) {
       print_line("-------------------------------------");
       for (const auto& r : results) {
         print_line("$ $", r->eval, r->make_pretty_moves(board));
@@ -166,7 +176,11 @@ TEST(multi_pv_search_with_mate)
   board.set_fen("1k6/2p5/p2qp3/p6p/2KPb2P/1P3r2/P1R5/R7 b - - 0 42");
   vector<SearchResultInfo::ptr> last_result;
   auto move_future = engine->start_mpv_search(
-    board, 5, 10, 1, [&last_result](vector<SearchResultInfo::ptr>&& results) {
+    board,
+    {.depth = 5},
+    10,
+    1,
+    [&last_result](vector<SearchResultInfo::ptr>&& results) {
       last_result = std::move(results);
     });
   must_unit(move_future->wait());
@@ -183,7 +197,7 @@ TEST(multi_stop)
   Board board;
   board.set_initial();
   auto move_future = engine->start_mpv_search(
-    board, 100, 5, 1, [](const vector<SearchResultInfo::ptr>&) {});
+    board, {.depth = 100}, 5, 1, [](const vector<SearchResultInfo::ptr>&) {});
   sleep_ms(100);
   must_unit(move_future->result_now());
 }
@@ -195,13 +209,69 @@ TEST(multi_worker)
   Board board;
   board.set_initial();
   auto move_future = engine->start_mpv_search(
-    board, 100, 5, 10, [](const vector<SearchResultInfo::ptr>&) {});
+    board, {.depth = 100}, 5, 10, [](const vector<SearchResultInfo::ptr>&) {});
   sleep_ms(100);
   must_unit(move_future->result_now());
 }
 
 TEST(draw) { run_test_in_proc("k7/8/8/8/Kp6/8/8/8 w - - 0 42"); }
 
+TEST(node_limit)
+{
+  // Separate engines, so the second search doesn't find the table of the first
+  // one already filled
+  auto run_test = [](const SearchLimits& limits) {
+    auto engine = EngineInProcess::create(
+      Experiment::base(), EvalParameters::default_params(), nullptr, 1, true);
+    Board board;
+    board.set_initial();
+    must(res, engine->find_best_move(board, limits, nullptr));
+    print_line(
+      "limits:$ move:$ eval:$ depth:$ nodes:$",
+      limits,
+      pp(board, res->best_move),
+      res->eval,
+      res->depth,
+      res->nodes);
+  };
+  run_test({.nodes = 5000});
+  run_test({.nodes = 5000});
+  run_test({.depth = 3, .nodes = 1000000});
+}
+
+TEST(node_limit_mpv_sp)
+{
+  auto engine = Engine::create(
+    Experiment::base(), EvalParameters::default_params(), nullptr, 100, true);
+  Board board;
+  board.set_initial();
+  for (int i = 0; i < 2; i++) {
+    must(res, engine->find_best_moves_mpv_sp(board, {.nodes = 5000}, 3, {}));
+    for (const auto& r : res) {
+      print_line(
+        "move:$ eval:$ depth:$ nodes:$",
+        pp(board, r->best_move),
+        r->eval,
+        r->depth,
+        r->nodes);
+    }
+  }
+}
+
+TEST(mate_limit)
+{
+  auto engine = Engine::create(
+    Experiment::base(), EvalParameters::default_params(), nullptr, 100, true);
+  Board board;
+  board.set_fen("6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1");
+  must(res, engine->find_best_move(board, {.mate_in = 1}, nullptr));
+  print_line(
+    "move:$ eval:$ depth:$",
+    pp(board, res->best_move),
+    res->eval,
+    res->depth);
+}
+
 } // namespace
 
 } // namespace blackbit
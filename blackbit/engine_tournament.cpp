@@ -1,5 +1,6 @@
 #include "engine_tournament.hpp"
 
+#include "cooperative_engine.hpp"
 #include "external_engine_protocols.hpp"
 #include "generated_game_record.hpp"
 #include "random.hpp"
@@ -16,6 +17,8 @@
 #include "yasf/config_parser.hpp"
 #include "yasf/serializer.hpp"
 
+#include <algorithm>
+#include <cctype>
 #include <iomanip>
 #include <iostream>
 #include <memory>
@@ -120,13 +123,13 @@ struct GameInfo {
 };
 
 Task<bee::OrError<ExpGameResult>> run_one_game(
-  const Span time_per_move, const GameInfo& game_info)
+  const SearchLimits limits, const GameInfo& game_info)
 {
   co_bail(
     result,
     co_await self_play_one_game(
       game_info.starting_fen,
-      time_per_move,
+      limits,
       game_info.get_factory(Color::White),
       game_info.get_factory(Color::Black)));
 
@@ -163,7 +166,7 @@ Task<bee::OrError<bee::Unit>> run_tournament(
   int num_workers,
   const string& result_filename,
   const map<string, EngineSpec>& engine_specs,
-  Span time_per_move)
+  SearchLimits limits)
 {
   randomize_seed();
 
@@ -208,11 +211,11 @@ Task<bee::OrError<bee::Unit>> run_tournament(
   auto res = co_await repeat_parallel(
     game_infos->size(),
     num_workers,
-    [&game_infos, &results, &game_count, &time_per_move]() mutable
+    [&game_infos, &results, &game_count, &limits]() mutable
     -> Task<bee::OrError<bee::Unit>> {
       auto info = game_infos->front();
       game_infos->pop();
-      co_bail(res, co_await run_one_game(time_per_move, info));
+      co_bail(res, co_await run_one_game(limits, info));
       if (res.end_reason == GameEndReason::EngineFailed) {
         print_line(
           "Game ended because engine failed: $ ($ vs $)",
@@ -259,6 +262,23 @@ auto create_engine_factory(const string& engine_cmd, F&& create_protocol)
   };
 };
 
+// In-process engine that searches the given number of nodes per move
+bee::OrError<EngineFactory> create_cooperative_factory(const string& nodes_str)
+{
+  if (nodes_str.empty() || !std::ranges::all_of(nodes_str, ::isdigit)) {
+    shot("Invalid number of nodes: $", nodes_str);
+  }
+  uint64_t nodes = std::stoull(nodes_str);
+  return [nodes]() {
+    return create_cooperative_engine({
+      .experiment = Experiment::base(),
+      .eval_params = EvalParameters::default_params(),
+      .hash_size = 1 << 24,
+      .nodes_per_move = nodes,
+    });
+  };
+}
+
 bee::OrError<EngineFactory> create_factory(const string& cmd_exp)
 {
   if (cmd_exp.empty()) { shot("Command cannot be an empty string"); }
@@ -273,7 +293,9 @@ bee::OrError<EngineFactory> create_factory(const string& cmd_exp)
   } else if (parts.size() == 2) {
     string engine_type = parts[0];
     command = parts[1];
-    if (engine_type == "uci") {
+    if (engine_type == "blackbit") {
+      return create_cooperative_factory(command);
+    } else if (engine_type == "uci") {
       is_xboard = false;
     } else if (engine_type == "xboard") {
       is_xboard = true;
@@ -303,7 +325,8 @@ Task<bee::OrError<bee::Unit>> main(
   int num_games,
   const string& positions_file,
   const string& results_file,
-  double seconds_per_move)
+  double seconds_per_move,
+  const std::optional<int>& nodes_per_move)
 {
   co_bail(engines_config, parse_engines_config(engines_config_path));
 
@@ -313,13 +336,22 @@ Task<bee::OrError<bee::Unit>> main(
     engine_specs.emplace(name, EngineSpec{.factory = factory, .name = name});
   }
 
+  // Only engines that support node limits can play with one, but then the
+  // games are repeatable
+  SearchLimits limits;
+  if (nodes_per_move.has_value()) {
+    limits.nodes = *nodes_per_move;
+  } else {
+    limits.time = Span::of_seconds(seconds_per_move);
+  }
+
   co_return co_await run_tournament(
     positions_file,
     num_games,
     concurrent_games,
     results_file,
     engine_specs,
-    Span::of_seconds(seconds_per_move));
+    limits);
 }
 
 } // namespace
@@ -337,6 +369,7 @@ command::Cmd EngineTournament::command()
   auto results_file = builder.required("--results", string_flag);
   auto seconds_per_move =
     builder.optional_with_default("--seconds-per-move", float_flag, 1.0);
+  auto nodes_per_move = builder.optional("--nodes-per-move", int_flag);
   return run_coro(builder, [=] {
     return main(
       *engines_config,
@@ -344,7 +377,8 @@ command::Cmd EngineTournament::command()
       *num_games,
       *positions_file,
       *results_file,
-      *seconds_per_move);
+      *seconds_per_move,
+      *nodes_per_move);
   });
 }
 
@@ -62,6 +62,17 @@ struct Evaluator {
     const Experiment& experiment,
     const EvalParameters& params);
 
+  // Hand written eval, ignores EvalParameters::custom_eval
+  static Score default_eval_for_white(
+    const Board& board,
+    const EvalScratch& scratch,
+    const Experiment& experiment);
+
+  // Same as default_eval_for_white with Experiment::base(), but with every
+  // experiment flag resolved at compile time
+  static Score base_eval_for_white(
+    const Board& board, const EvalScratch& scratch);
+
   static Features features(
     const Board& board,
     const EvalScratch& scratch,
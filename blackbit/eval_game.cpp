@@ -45,7 +45,8 @@ bee::OrError<bee::Unit> eval_game_main(
   double think_time_sec, const string& games_filename)
 {
   const int cache_size = 1000 * (1 << 20); // ~1gb
-  auto think_time = Span::of_seconds(think_time_sec);
+  const SearchLimits limits{
+    .depth = 50, .time = Span::of_seconds(think_time_sec)};
 
   vector<gr::Game> games;
   bail(
@@ -77,8 +78,7 @@ bee::OrError<bee::Unit> eval_game_main(
 
     for (const auto& move : game.moves) {
       bail(
-        got_moves,
-        engine->find_best_moves_mpv(board, 50, 30, 16, think_time, nullptr));
+        got_moves, engine->find_best_moves_mpv(board, limits, 30, 16, nullptr));
       auto& best_move = *got_moves[0];
 
       auto pm = [&board](const optional<Move>& m) -> string {
@@ -253,6 +253,31 @@ TEST(custom_eval)
   eval("2r1r1k1/1b1p1p1p/p2B2p1/1p2PpP1/7P/2n4R/P1P3P1/R6K b - - 0 21");
 }
 
+TEST(static_base_eval)
+{
+  auto exp = Experiment::base();
+  print_line("base is_static_base: $", exp.is_static_base());
+  auto eval = [&](const string& fen) {
+    Board board;
+    must_unit(board.set_fen(fen));
+    auto scratch = Rules::make_scratch(board);
+    print_line(board.to_fen());
+    print_line(
+      "default_eval: $", Evaluator::default_eval_for_white(board, scratch, exp));
+    print_line("base_eval: $", Evaluator::base_eval_for_white(board, scratch));
+    print_line("--------------------------------");
+  };
+
+  eval("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  eval("rn1qkbnr/p2bpppp/8/1p6/P1pN4/4P3/1P3PPP/RNBQKB1R w KQkq - 0 7");
+  eval("2r1r1k1/1b1p1p1p/p2B2p1/1p2PpP1/7P/2n4R/P1P3P1/R6K b - - 0 21");
+
+  exp.override_flag_for_testing("king_threat_from_pieces_enabled", 1);
+  print_line("overridden is_static_base: $", exp.is_static_base());
+  print_line(
+    "test is_static_base: $", Experiment::test_with_seed(1).is_static_base());
+}
+
 } // namespace
 
 } // namespace blackbit
@@ -139,6 +139,12 @@ Experiment Experiment::test_with_seed(uint64_t seed)
 bool Experiment::is_test() const { return _side == Side::Test; }
 bool Experiment::is_base() const { return _side == Side::Base; }
 
+bool Experiment::is_static_base() const
+{
+  return is_base() &&
+         _flag_values == FlagRegister::singleton().values_for_base();
+}
+
 int Experiment::flag_value(int flag_id) const
 {
   return _flag_values.at(flag_id);
@@ -27,6 +27,10 @@ struct Experiment {
   bool is_test() const;
   bool is_base() const;
 
+  // Base side with every flag at its registered base value, i.e. equivalent to
+  // StaticBaseExperiment
+  bool is_static_base() const;
+
   int flag_value(int flag_id) const;
 
   std::map<std::string, int> flags_to_values() const;
@@ -57,4 +61,31 @@ struct ExperimentFlag {
   int _flag_id;
 };
 
+// Stands in for an Experiment that is known at compile time to be the base
+// one. Flags registered through StaticExperimentFlag resolve to constants when
+// looked up with it, so code templated on the experiment type folds the A/B
+// testing plumbing away.
+struct StaticBaseExperiment {};
+
+template <int BaseValue> struct StaticExperimentFlag {
+ public:
+  static StaticExperimentFlag register_flag(
+    const std::string& name, int min_value, int max_value)
+  {
+    return StaticExperimentFlag(
+      ExperimentFlag::register_flag(name, min_value, max_value, BaseValue));
+  }
+
+  int value(const Experiment& experiment) const
+  {
+    return _flag.value(experiment);
+  }
+
+  constexpr int value(const StaticBaseExperiment&) const { return BaseValue; }
+
+ private:
+  explicit StaticExperimentFlag(ExperimentFlag flag) : _flag(flag) {}
+  ExperimentFlag _flag;
+};
+
 } // namespace blackbit
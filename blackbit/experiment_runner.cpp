@@ -1,14 +1,18 @@
 #include "experiment_runner.hpp"
 
 #include "compare_engines.hpp"
+#include "memory_budget.hpp"
 #include "random.hpp"
+#include "search_limits.hpp"
 #include "self_play.hpp"
 
 #include "bee/span.hpp"
 #include "command/command_builder.hpp"
 
+#include <optional>
 #include <sstream>
 
+using std::optional;
 using std::string;
 
 namespace blackbit {
@@ -17,11 +21,27 @@ namespace {
 bee::OrError<bee::Unit> run_experiment_main(
   const string& positions_file,
   double seconds_per_move,
+  const optional<int>& nodes_per_move,
   int num_rounds,
   int num_workers,
   int repeat_position,
-  const string& result_filename)
+  const string& result_filename,
+  const optional<string>& memory_str,
+  bool share_tables)
 {
+  optional<MemoryBudget> memory;
+  if (memory_str.has_value()) {
+    bail_assign(memory, MemoryBudget::parse(*memory_str));
+  }
+
+  // A node limit makes the games repeatable, so it replaces the time limit
+  SearchLimits limits{.depth = 50};
+  if (nodes_per_move.has_value()) {
+    limits.nodes = *nodes_per_move;
+  } else {
+    limits.time = bee::Span::of_seconds(seconds_per_move);
+  }
+
   auto rng = Random::create(rand64());
 
   auto create_base_params = []() {
@@ -40,14 +60,15 @@ bee::OrError<bee::Unit> run_experiment_main(
 
   return CompareEngines::compare(
     positions_file,
-    seconds_per_move,
+    limits,
     num_rounds,
     num_workers,
     repeat_position,
-    50,
     result_filename,
     create_base_params,
-    create_test_params);
+    create_test_params,
+    memory,
+    share_tables);
 }
 
 } // namespace
@@ -59,6 +80,7 @@ command::Cmd ExperimentRunner::command()
   auto positions_file = builder.required("--positions-file", string_flag);
   auto seconds_per_move =
     builder.optional_with_default("--seconds-per-move", float_flag, 2.0);
+  auto nodes_per_move = builder.optional("--nodes-per-move", int_flag);
   auto num_rounds =
     builder.optional_with_default("--num-rounds", int_flag, 400);
   auto num_workers =
@@ -67,14 +89,19 @@ command::Cmd ExperimentRunner::command()
     builder.optional_with_default("--result-file", string_flag, "output.csv");
   auto repeat_position =
     builder.optional_with_default("--repeat-position", int_flag, 1);
+  auto memory = builder.optional("--memory", string_flag);
+  auto share_tables = builder.no_arg("--share-tables");
   return builder.run([=]() {
     return run_experiment_main(
       *positions_file,
       *seconds_per_move,
+      *nodes_per_move,
       *num_rounds,
       *num_workers,
       *repeat_position,
-      *result_filename);
+      *result_filename,
+      *memory,
+      *share_tables);
   });
 }
 
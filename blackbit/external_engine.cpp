@@ -16,7 +16,6 @@
 using namespace async;
 
 using bee::print_err_line;
-using bee::Span;
 using bee::SubProcess;
 using std::make_unique;
 using std::shared_ptr;
@@ -185,10 +184,10 @@ struct ExternalEngineState
     return _engine_protocol->set_fen(_board->to_fen());
   }
 
-  virtual bee::OrError<bee::Unit> set_time_per_move(
-    const Span time_per_move) override
+  virtual bee::OrError<bee::Unit> set_limits(
+    const SearchLimits& limits) override
   {
-    return _engine_protocol->set_time_per_move(time_per_move);
+    return _engine_protocol->set_limits(limits);
   }
 
   virtual bee::OrError<bee::Unit> send_move(const Move& move) override
@@ -309,10 +308,10 @@ struct SharedEngineInterfaceWrapper : public EngineInterface {
     return _engine->set_fen(fen);
   }
 
-  virtual bee::OrError<bee::Unit> set_time_per_move(
-    const Span time_per_move) override
+  virtual bee::OrError<bee::Unit> set_limits(
+    const SearchLimits& limits) override
   {
-    return _engine->set_time_per_move(time_per_move);
+    return _engine->set_limits(limits);
   }
 
   virtual bee::OrError<bee::Unit> send_move(const Move& m) override
@@ -30,8 +30,7 @@ struct EngineProtocol {
   }
 
   virtual bee::OrError<bee::Unit> set_fen(const std::string& fen) = 0;
-  virtual bee::OrError<bee::Unit> set_time_per_move(
-    const bee::Span time_per_move) = 0;
+  virtual bee::OrError<bee::Unit> set_limits(const SearchLimits& limits) = 0;
   virtual bee::OrError<bee::Unit> user_move(Move move) = 0;
   virtual bee::OrError<bee::Unit> initialize() = 0;
   virtual bee::OrError<bee::Unit> request_move() = 0;
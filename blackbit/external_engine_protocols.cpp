@@ -24,10 +24,17 @@ struct XboardEngineProtocol : public EngineProtocol {
     return _interface->send_cmd(format("setboard $", fen));
   }
 
-  virtual bee::OrError<bee::Unit> set_time_per_move(const Span time_per_move)
+  virtual bee::OrError<bee::Unit> set_limits(const SearchLimits& limits)
   {
+    if (!limits.time.has_value()) {
+      return bee::Error("Xboard engines need a time limit");
+    }
+    if (limits.nodes.has_value() || limits.mate_in.has_value()) {
+      return bee::Error("Xboard engines only support time and depth limits");
+    }
+    bail_unit(_interface->send_cmd(format("sd $", limits.depth)));
     return _interface->send_cmd(
-      format("st $", time_per_move.to_float_seconds()));
+      format("st $", limits.time->to_float_seconds()));
   }
 
   virtual bee::OrError<bee::Unit> user_move(Move move)
@@ -108,9 +115,9 @@ struct UCIEngineProtocol : public EngineProtocol {
     return bee::ok();
   }
 
-  virtual bee::OrError<bee::Unit> set_time_per_move(const Span time_per_move)
+  virtual bee::OrError<bee::Unit> set_limits(const SearchLimits& limits)
   {
-    _time_per_move = time_per_move;
+    _limits = limits;
     return bee::ok();
   }
 
@@ -125,7 +132,15 @@ struct UCIEngineProtocol : public EngineProtocol {
     string moves = bee::join(_moves, " ");
     bail_unit(
       _send_cmd(format("position fen $ moves $", _starting_fen, moves)));
-    bail_unit(_send_cmd(format("go movetime $", _time_per_move.to_millis())));
+    string go = format("go depth $", _limits.depth);
+    if (_limits.nodes.has_value()) { go += format(" nodes $", *_limits.nodes); }
+    if (_limits.time.has_value()) {
+      go += format(" movetime $", _limits.time->to_millis());
+    }
+    if (_limits.mate_in.has_value()) {
+      go += format(" mate $", *_limits.mate_in);
+    }
+    bail_unit(_send_cmd(std::move(go)));
     return bee::ok();
   }
 
@@ -186,7 +201,7 @@ struct UCIEngineProtocol : public EngineProtocol {
   vector<string> _moves;
   bool _is_engine_ready = false;
 
-  Span _time_per_move = Span::of_seconds(1.0);
+  SearchLimits _limits = {.time = Span::of_seconds(1.0)};
 
   queue<string> _commands;
 };
@@ -0,0 +1,92 @@
+#include "fiber.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using std::function;
+
+namespace blackbit {
+
+Fiber::Fiber(function<void()>&& fn, size_t stack_size) : _fn(std::move(fn))
+{
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  stack_size = (stack_size + page_size - 1) / page_size * page_size;
+  _mapping_size = stack_size + page_size;
+  _mapping = mmap(
+    nullptr,
+    _mapping_size,
+    PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+    -1,
+    0);
+  if (_mapping == MAP_FAILED) { throw std::bad_alloc(); }
+  // Stacks grow down, the guard goes below the lowest address
+  if (mprotect(_mapping, page_size, PROT_NONE) != 0) {
+    munmap(_mapping, _mapping_size);
+    throw std::bad_alloc();
+  }
+
+  getcontext(&_context);
+  _context.uc_stack.ss_sp = static_cast<char*>(_mapping) + page_size;
+  _context.uc_stack.ss_size = stack_size;
+  _context.uc_link = &_caller;
+
+  // makecontext only passes int arguments
+  auto ptr = reinterpret_cast<uintptr_t>(this);
+  makecontext(
+    &_context,
+    reinterpret_cast<void (*)()>(&Fiber::_entry),
+    2,
+    static_cast<unsigned int>(ptr >> 32),
+    static_cast<unsigned int>(ptr));
+}
+
+Fiber::~Fiber()
+{
+  assert(!_running);
+  munmap(_mapping, _mapping_size);
+}
+
+Fiber::ptr Fiber::create(function<void()>&& fn, size_t stack_size)
+{
+  return ptr(new Fiber(std::move(fn), stack_size));
+}
+
+bool Fiber::resume()
+{
+  assert(!_running && !_finished);
+  _running = true;
+  swapcontext(&_caller, &_context);
+  _running = false;
+  if (_exception != nullptr) {
+    std::rethrow_exception(std::exchange(_exception, nullptr));
+  }
+  return _finished;
+}
+
+void Fiber::yield()
+{
+  assert(_running);
+  swapcontext(&_context, &_caller);
+}
+
+void Fiber::_entry(unsigned int high, unsigned int low)
+{
+  auto fiber = reinterpret_cast<Fiber*>(
+    (static_cast<uintptr_t>(high) << 32) | static_cast<uintptr_t>(low));
+  try {
+    fiber->_fn();
+  } catch (...) {
+    fiber->_exception = std::current_exception();
+  }
+  fiber->_fn = nullptr;
+  fiber->_finished = true;
+  // Returning switches to uc_link
+}
+
+} // namespace blackbit
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+
+#include <ucontext.h>
+
+namespace blackbit {
+
+// Runs a function on a stack of its own, so that it can be suspended from
+// anywhere inside of it and resumed later, possibly from another thread. The
+// function must not yield from inside a catch block, the exception being
+// handled belongs to the thread that resumed it. Destroying a suspended fiber
+// skips the destructors of what is on its stack.
+struct Fiber {
+ public:
+  using ptr = std::unique_ptr<Fiber>;
+
+  static ptr create(
+    std::function<void()>&& fn, size_t stack_size = default_stack_size);
+
+  ~Fiber();
+
+  Fiber(const Fiber&) = delete;
+  Fiber& operator=(const Fiber&) = delete;
+
+  // Runs the function until it yields or returns, returns true once it has
+  // returned. Rethrows what the function throws.
+  bool resume();
+
+  // Only from inside the function, returns from the call to resume
+  void yield();
+
+  bool finished() const { return _finished; }
+
+  static constexpr size_t default_stack_size = 1 << 20;
+
+ private:
+  Fiber(std::function<void()>&& fn, size_t stack_size);
+
+  static void _entry(unsigned int high, unsigned int low);
+
+  std::function<void()> _fn;
+
+  // Mapped for the life of the fiber, only the pages the function reaches get
+  // touched. The lowest page is a guard, so that overflowing the stack crashes
+  // instead of writing over whatever is below it.
+  void* _mapping = nullptr;
+  size_t _mapping_size = 0;
+
+  ucontext_t _context;
+  ucontext_t _caller;
+
+  std::exception_ptr _exception;
+
+  bool _running = false;
+  bool _finished = false;
+};
+
+} // namespace blackbit
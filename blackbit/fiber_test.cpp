@@ -0,0 +1,62 @@
+#include "fiber.hpp"
+
+#include "bee/format_vector.hpp"
+#include "bee/testing.hpp"
+
+#include <stdexcept>
+#include <thread>
+
+using bee::print_line;
+using std::vector;
+
+namespace blackbit {
+namespace {
+
+int count_down(Fiber& fiber, vector<int>& seen, int n)
+{
+  if (n == 0) { return 0; }
+  seen.push_back(n);
+  if (n % 3 == 0) { fiber.yield(); }
+  return 1 + count_down(fiber, seen, n - 1);
+}
+
+TEST(yield_from_recursion)
+{
+  vector<int> seen;
+  int result = 0;
+  Fiber::ptr fiber;
+  fiber = Fiber::create([&] { result = count_down(*fiber, seen, 10); });
+  while (!fiber->resume()) { print_line("yielded seen:$", seen); }
+  print_line("finished:$ result:$ seen:$", fiber->finished(), result, seen);
+}
+
+TEST(resume_from_other_threads)
+{
+  vector<int> seen;
+  Fiber::ptr fiber;
+  fiber = Fiber::create([&] {
+    for (int i = 0; i < 4; i++) {
+      seen.push_back(i);
+      fiber->yield();
+    }
+  });
+  bool finished = false;
+  while (!finished) {
+    std::thread t([&] { finished = fiber->resume(); });
+    t.join();
+  }
+  print_line(seen);
+}
+
+TEST(exception)
+{
+  auto fiber = Fiber::create([] { throw std::runtime_error("failed"); });
+  try {
+    fiber->resume();
+  } catch (const std::runtime_error& e) {
+    print_line("caught: $ finished:$", e.what(), fiber->finished());
+  }
+}
+
+} // namespace
+} // namespace blackbit
@@ -41,6 +41,21 @@ int main()
   print_line("");
   print_line("constexpr uint64_t hash_code_turn = $ull;", rand64());
   print_line("");
+  print_line("constexpr PieceTypeArray<ColorArray<std::array<uint64_t, 11>>> "
+             "material_hash = {{");
+  for (int t = 0; t < 8; ++t) {
+    print_line("{{");
+    for (int o = 0; o < 2; ++o) {
+      print_line("{{");
+      for (int c = 0; c <= 10; ++c) {
+        print_line("$ull,", c == 0 ? 0 : rand64());
+      }
+      print_line("}},");
+    }
+    print_line("}},");
+  }
+  print_line("}};");
+  print_line("");
   print_line("}");
 
   return 0;
@@ -2231,4 +2231,232 @@ constexpr std::array<uint64_t, 16> castle_hash = {{
 
 constexpr uint64_t hash_code_turn = 4069709249518811387ull;
 
+constexpr PieceTypeArray<ColorArray<std::array<uint64_t, 11>>>
+  material_hash = {{
+  {{
+    {{
+      0ull,
+      6841544234174545616ull,
+      15370989055570787399ull,
+      10670883017517453087ull,
+      16301757737173299368ull,
+      2000580264709548978ull,
+      204255683901577926ull,
+      12890564716710031249ull,
+      4192034399994276501ull,
+      7822152926504851801ull,
+      5519268450732945601ull,
+    }},
+    {{
+      0ull,
+      5795131007639679154ull,
+      16677220202527310458ull,
+      12357412150131929062ull,
+      7666672497667187920ull,
+      4473346612212116242ull,
+      17746738387847923245ull,
+      7998411384857279866ull,
+      9498073886908410276ull,
+      11689311689978860863ull,
+      10963431396476889992ull,
+    }},
+  }},
+  {{
+    {{
+      0ull,
+      4980413565293712504ull,
+      12995256750209673850ull,
+      13452437060496785003ull,
+      9609952569271018659ull,
+      14155117577440612370ull,
+      18288550164860298138ull,
+      18140805942201207696ull,
+      15012194119997295374ull,
+      427491908989283808ull,
+      5393828847788313704ull,
+    }},
+    {{
+      0ull,
+      95665782334736034ull,
+      2592154899794117211ull,
+      12516075549573925687ull,
+      10602252242052405636ull,
+      17289803267436689579ull,
+      17642672346883535775ull,
+      13092191246105911683ull,
+      2708377772987323838ull,
+      12752718854989352278ull,
+      17607088335594946141ull,
+    }},
+  }},
+  {{
+    {{
+      0ull,
+      12712692918957528394ull,
+      10225043532440043198ull,
+      2914194845023204555ull,
+      6869559826680525654ull,
+      3923684184415439542ull,
+      17526784831355389601ull,
+      13618127392214865885ull,
+      12409040947227286957ull,
+      7639465337423931234ull,
+      10969918942323211052ull,
+    }},
+    {{
+      0ull,
+      6584295094841547668ull,
+      10442649134882525530ull,
+      7834835435644026293ull,
+      3817298200490299942ull,
+      9561861861805320915ull,
+      8271951899661155198ull,
+      13227018832147849062ull,
+      14634044213950224914ull,
+      14265151038213380615ull,
+      11580118109056630928ull,
+    }},
+  }},
+  {{
+    {{
+      0ull,
+      3360487736470715215ull,
+      6999048399823416074ull,
+      9702197001169995177ull,
+      7363096560549748027ull,
+      17342884269664428234ull,
+      14195567622323217693ull,
+      1051072730707801194ull,
+      17024515978281850379ull,
+      15893149206326260038ull,
+      1247803807162174968ull,
+    }},
+    {{
+      0ull,
+      17460699656515197691ull,
+      1150669252980690104ull,
+      13967571970342347047ull,
+      15878947721353855790ull,
+      4750109865634661420ull,
+      13997734953760639610ull,
+      18245950499758100197ull,
+      10790028491332085374ull,
+      8640438261242858556ull,
+      5945158372094319420ull,
+    }},
+  }},
+  {{
+    {{
+      0ull,
+      16556697376056709906ull,
+      6784099088253103407ull,
+      16052362690759883315ull,
+      5628587267378436273ull,
+      6241231406177691301ull,
+      17635082456550580624ull,
+      17710907511491418009ull,
+      3917354592438540072ull,
+      11601141307452832458ull,
+      5608613547171219895ull,
+    }},
+    {{
+      0ull,
+      4849792570290521756ull,
+      7643409594451151781ull,
+      15288128702011295340ull,
+      1751771154992030872ull,
+      11645219078629167773ull,
+      14597240438746909762ull,
+      4901397364561444284ull,
+      13901900795751477993ull,
+      1704173623394219977ull,
+      4374482667903975890ull,
+    }},
+  }},
+  {{
+    {{
+      0ull,
+      1178155011517095774ull,
+      17386201608290566828ull,
+      9281992980414223211ull,
+      7715010231165875685ull,
+      11705016930242806097ull,
+      9544362740947331338ull,
+      17998870046617131809ull,
+      14543832953267070469ull,
+      14343734308797484194ull,
+      13910474909649158501ull,
+    }},
+    {{
+      0ull,
+      3943521275056483131ull,
+      8109767215516919460ull,
+      3789057085187882ull,
+      6714671142903622448ull,
+      16525395961149951045ull,
+      10730574020563140871ull,
+      16063280415172433143ull,
+      14219999438024884471ull,
+      4061455076774421578ull,
+      14839917517216924517ull,
+    }},
+  }},
+  {{
+    {{
+      0ull,
+      6219145321258450451ull,
+      14006252331438925064ull,
+      8398283004441035762ull,
+      4252122298723936225ull,
+      18244176857142598545ull,
+      18043970583586990935ull,
+      8509393529715307847ull,
+      9487551135979114343ull,
+      12597840856639652032ull,
+      962996498879645744ull,
+    }},
+    {{
+      0ull,
+      17735702487501590715ull,
+      10041303880352265480ull,
+      13606543294227317825ull,
+      13101476893241586284ull,
+      3777553932063526625ull,
+      7053768334468575771ull,
+      13730919312459857952ull,
+      6939551411007898178ull,
+      7942780862307608889ull,
+      17770693333687765584ull,
+    }},
+  }},
+  {{
+    {{
+      0ull,
+      1683873326637688789ull,
+      3608515804505951088ull,
+      3336371922437273621ull,
+      7265565376344430253ull,
+      5240840669540067032ull,
+      16390855424190466236ull,
+      16445951673030061474ull,
+      1340008310336016129ull,
+      5549091411138604947ull,
+      13752422162479511609ull,
+    }},
+    {{
+      0ull,
+      463133236469034916ull,
+      1331279933749518181ull,
+      6326605870553916869ull,
+      12121517149247488935ull,
+      17596126217380205004ull,
+      9710831387104512548ull,
+      5946159568307788116ull,
+      11344972244528177221ull,
+      16357227046906787717ull,
+      10934410950631223241ull,
+    }},
+  }},
+}};
+
 } // namespace blackbit
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace blackbit {
+
+// Stack of the hash keys of the positions played so far, used for repetition
+// detection.
+//
+// The keys live in storage shared between copies, so copying a board only
+// bumps a refcount instead of copying the whole game. A copy takes its own
+// storage the first time it pushes while the storage is still shared. Popping
+// never touches the storage, so the owners that still share it are not
+// affected.
+struct HashHistory {
+ public:
+  HashHistory() {}
+
+  HashHistory(const HashHistory& other) = default;
+  HashHistory(HashHistory&& other) = default;
+
+  HashHistory& operator=(const HashHistory& other) = default;
+  HashHistory& operator=(HashHistory&& other) = default;
+
+  bool empty() const { return _size == 0; }
+
+  int size() const { return _size; }
+
+  void clear() { _size = 0; }
+
+  void push_back(uint64_t key)
+  {
+    if (_keys == nullptr || _keys.use_count() > 1) [[unlikely]] { _detach(); }
+    if (int(_keys->size()) > _size) {
+      (*_keys)[_size] = key;
+    } else {
+      _keys->push_back(key);
+    }
+    _size++;
+  }
+
+  void pop_back() { _size--; }
+
+  uint64_t operator[](int idx) const { return (*_keys)[idx]; }
+
+  const uint64_t* begin() const
+  {
+    return _keys == nullptr ? nullptr : _keys->data();
+  }
+  const uint64_t* end() const { return begin() + _size; }
+
+  std::vector<uint64_t> to_vector() const
+  {
+    return std::vector<uint64_t>(begin(), end());
+  }
+
+ private:
+  void _detach()
+  {
+    auto keys = std::make_shared<std::vector<uint64_t>>();
+    keys->reserve(std::max<size_t>(_size * 2, initial_capacity));
+    keys->insert(keys->end(), begin(), end());
+    _keys = std::move(keys);
+  }
+
+  static constexpr size_t initial_capacity = 256;
+
+  std::shared_ptr<std::vector<uint64_t>> _keys;
+  int _size = 0;
+};
+
+} // namespace blackbit
@@ -0,0 +1,236 @@
+#include "material.hpp"
+
+#include "generated_board_hashes.hpp"
+#include "piece_type_array.hpp"
+#include "pieces.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using std::vector;
+
+namespace blackbit {
+namespace {
+
+using Counts = ColorArray<PieceTypeArray<int>>;
+
+constexpr Score bishop_pair_value = Score::of_pawns(0.2);
+
+constexpr PieceTypeArray<int> phase_weight{{
+  0, // none
+  0, // pawn
+  1, // knight
+  1, // bishop
+  2, // rook
+  4, // queen
+  0, // king
+  0, // buffer
+}};
+
+// Value of the pieces other than pawns, in pawns
+constexpr PieceTypeArray<int> non_pawn_value{{
+  0, // none
+  0, // pawn
+  3, // knight
+  3, // bishop
+  5, // rook
+  9, // queen
+  0, // king
+  0, // buffer
+}};
+
+enum class PiecesLeft {
+  KingOnly,
+  KingOneKnight,
+  KingOneBishop,
+  Other,
+};
+
+// Takes the number of pieces of a type, so that pieces are only counted
+// until the answer is known
+template <class F> PiecesLeft pieces_left(F&& count)
+{
+  if (
+    count(PieceType::QUEEN) > 0 || count(PieceType::ROOK) > 0 ||
+    count(PieceType::PAWN) > 0 || count(PieceType::KING) != 1) {
+    return PiecesLeft::Other;
+  }
+
+  int knights = count(PieceType::KNIGHT);
+  int bishops = count(PieceType::BISHOP);
+  if (knights == 0 && bishops == 0) { return PiecesLeft::KingOnly; }
+  if (knights == 1 && bishops == 0) { return PiecesLeft::KingOneKnight; }
+  if (knights == 0 && bishops == 1) { return PiecesLeft::KingOneBishop; }
+  return PiecesLeft::Other;
+}
+
+// Takes the number of pieces of a color and type
+template <class F> bool is_insufficient_material(F&& count)
+{
+  auto white_left =
+    pieces_left([&](PieceType type) { return count(Color::White, type); });
+  if (white_left == PiecesLeft::Other) { return false; }
+
+  auto black_left =
+    pieces_left([&](PieceType type) { return count(Color::Black, type); });
+  if (black_left == PiecesLeft::Other) { return false; }
+
+  return white_left == PiecesLeft::KingOnly ||
+         black_left == PiecesLeft::KingOnly;
+}
+
+int non_pawn_material(const PieceTypeArray<int>& c)
+{
+  int total = 0;
+  for (auto type : AllPieces) { total += c[type] * non_pawn_value[type]; }
+  return total;
+}
+
+// Without pawns, being up to a minor piece ahead is usually not enough to win
+uint8_t scale_for(const PieceTypeArray<int>& us, const PieceTypeArray<int>& op)
+{
+  int npm_us = non_pawn_material(us);
+  int npm_op = non_pawn_material(op);
+  if (us[PieceType::PAWN] > 0 || npm_us - npm_op > 3) {
+    return MaterialInfo::scale_normal;
+  } else if (npm_us < 5) {
+    return 0;
+  } else if (npm_op <= 3) {
+    return 4;
+  } else {
+    return 14;
+  }
+}
+
+uint64_t key_of_counts(const Counts& counts)
+{
+  uint64_t key = 0;
+  for (auto color : AllColors) {
+    for (auto type : AllPieces) {
+      key ^= material_hash[type][color][counts[color][type]];
+    }
+  }
+  return key;
+}
+
+MaterialInfo compute(const Counts& counts)
+{
+  MaterialInfo info;
+  info.key = key_of_counts(counts);
+  int phase = 0;
+  for (auto color : AllColors) {
+    const auto& c = counts[color];
+    info.imbalance[color] =
+      c[PieceType::BISHOP] >= 2 ? bishop_pair_value : Score::zero();
+    info.scale[color] = scale_for(c, counts[oponent(color)]);
+    for (auto type : AllPieces) { phase += c[type] * phase_weight[type]; }
+  }
+  info.phase = std::min(phase, MaterialInfo::max_phase);
+  info.insufficient_material =
+    is_insufficient_material([&](Color color, PieceType type) {
+      return counts[color][type];
+    });
+  return info;
+}
+
+Counts counts_of_board(const Board& board)
+{
+  Counts counts;
+  for (auto color : AllColors) {
+    counts[color].clear(0);
+    for (auto type : AllPieces) {
+      counts[color][type] = board.pieces(color, type).size();
+    }
+  }
+  return counts;
+}
+
+// Open addressing table with every material configuration that can be reached
+// without promotions. A key of zero marks an empty slot, the only
+// configuration with that key is the empty board.
+struct Table {
+ public:
+  Table() : _entries(size), _mask(size - 1)
+  {
+    vector<PieceTypeArray<int>> sides;
+    PieceTypeArray<int> c;
+    c.clear(0);
+    c[PieceType::KING] = 1;
+    for (int p = 0; p <= 8; p++) {
+      for (int n = 0; n <= 2; n++) {
+        for (int b = 0; b <= 2; b++) {
+          for (int r = 0; r <= 2; r++) {
+            for (int q = 0; q <= 1; q++) {
+              c[PieceType::PAWN] = p;
+              c[PieceType::KNIGHT] = n;
+              c[PieceType::BISHOP] = b;
+              c[PieceType::ROOK] = r;
+              c[PieceType::QUEEN] = q;
+              sides.push_back(c);
+            }
+          }
+        }
+      }
+    }
+
+    for (const auto& white : sides) {
+      for (const auto& black : sides) {
+        Counts counts;
+        counts[Color::White] = white;
+        counts[Color::Black] = black;
+        _insert(compute(counts));
+      }
+    }
+  }
+
+  const MaterialInfo* find(uint64_t key) const
+  {
+    for (uint64_t idx = key & _mask;; idx = (idx + 1) & _mask) {
+      const auto& entry = _entries[idx];
+      if (entry.key == key) { return &entry; }
+      if (entry.key == 0) { return nullptr; }
+    }
+  }
+
+ private:
+  void _insert(const MaterialInfo& info)
+  {
+    uint64_t idx = info.key & _mask;
+    while (_entries[idx].key != 0) { idx = (idx + 1) & _mask; }
+    _entries[idx] = info;
+  }
+
+  // 486^2 configurations, keeps the load factor under one half
+  static constexpr size_t size = 1 << 19;
+
+  vector<MaterialInfo> _entries;
+  const uint64_t _mask;
+};
+
+const Table& table()
+{
+  static Table table;
+  return table;
+}
+
+} // namespace
+
+MaterialInfo MaterialTable::lookup(const Board& board)
+{
+  auto key = board.material_key();
+  if (key != 0) {
+    if (auto info = table().find(key)) { return *info; }
+  }
+  return compute(counts_of_board(board));
+}
+
+bool MaterialTable::is_insufficient_material(const Board& board)
+{
+  // Called at every node, most positions have a queen, a rook or a pawn and
+  // are told apart by the first list looked at
+  return blackbit::is_insufficient_material([&](Color color, PieceType type) {
+    return int(board.pieces(color, type).size());
+  });
+}
+
+} // namespace blackbit
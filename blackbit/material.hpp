@@ -0,0 +1,52 @@
+#pragma once
+
+#include "board.hpp"
+#include "color_array.hpp"
+#include "score.hpp"
+
+#include <cstdint>
+
+namespace blackbit {
+
+// Everything about a position that only depends on how many pieces of each
+// type each side has
+struct MaterialInfo {
+  static constexpr int scale_normal = 64;
+
+  uint64_t key = 0;
+
+  // Bonus for each side that depends only on its material, like the bishop pair
+  ColorArray<Score> imbalance{{Score::zero(), Score::zero()}};
+
+  // How much of the eval to keep when that side is ahead, out of
+  // scale_normal. Lower for material configurations that are hard to win.
+  ColorArray<uint8_t> scale{{scale_normal, scale_normal}};
+
+  // From 0 (only pawns and kings) to max_phase (all the pieces on the board)
+  uint8_t phase = 0;
+
+  bool insufficient_material = false;
+
+  static constexpr int max_phase = 24;
+
+  Score scale_eval(Score eval_for_white) const
+  {
+    Color strong = eval_for_white > Score::zero() ? Color::White : Color::Black;
+    return eval_for_white * int(scale[strong]) / scale_normal;
+  }
+};
+
+struct MaterialTable {
+ public:
+  // Material configurations up to the initial set of pieces are precomputed,
+  // anything else, like positions with extra promoted pieces, is computed on
+  // the fly
+  static MaterialInfo lookup(const Board& board);
+
+  // Same as lookup(board).insufficient_material, but looks at the pieces
+  // instead of probing the table, stopping as soon as a side has a queen, a
+  // rook or a pawn. For callers that need nothing else from it.
+  static bool is_insufficient_material(const Board& board);
+};
+
+} // namespace blackbit
@@ -0,0 +1,74 @@
+#include "material.hpp"
+
+#include "rules.hpp"
+
+#include "bee/testing.hpp"
+
+using bee::print_line;
+using std::string;
+
+namespace blackbit {
+namespace {
+
+void show(const Board& board)
+{
+  auto info = MaterialTable::lookup(board);
+  print_line(board.to_fen());
+  print_line(
+    "key_matches:$ phase:$ insufficient:$ imbalance:$ $ scale:$ $",
+    info.key == board.material_key(),
+    int(info.phase),
+    info.insufficient_material,
+    info.imbalance[Color::White],
+    info.imbalance[Color::Black],
+    int(info.scale[Color::White]),
+    int(info.scale[Color::Black]));
+  print_line("--------------------------------");
+}
+
+TEST(lookup)
+{
+  auto run = [](const string& fen) {
+    Board board;
+    must_unit(board.set_fen(fen));
+    show(board);
+  };
+  run("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  run("rn1qk1nr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  run("k7/8/K7/8/8/8/8/8 w - - 0 1");
+  run("k7/8/K7/8/N7/8/8/8 w - - 0 1");
+  run("k7/8/K7/8/N7/N7/8/8 w - - 0 1");
+  run("k7/8/K7/8/8/8/8/R7 w - - 0 1");
+  run("k7/8/K7/8/b7/8/8/R7 w - - 0 1");
+  run("k7/8/K7/8/b7/8/8/RB6 w - - 0 1");
+  run("k7/r7/K7/8/8/8/8/RB6 w - - 0 1");
+  run("k7/8/K7/8/8/8/8/QQQ5 w - - 0 1");
+}
+
+TEST(incremental_key)
+{
+  Board board;
+  must_unit(board.set_fen("4k3/1P6/8/8/8/8/5p2/3K2R1 b - - 0 1"));
+  auto pp = [&](const string& m) { return board.parse_xboard_move_string(m); };
+  show(board);
+
+  must(m1, pp("f2g1q"));
+  auto mi1 = board.move(m1);
+  show(board);
+
+  must(m2, pp("b7b8q"));
+  auto mi2 = board.move(m2);
+  show(board);
+
+  Board fresh;
+  must_unit(fresh.set_fen(board.to_fen()));
+  print_line(
+    "same key as fresh: $", board.material_key() == fresh.material_key());
+
+  board.undo(m2, mi2);
+  board.undo(m1, mi1);
+  show(board);
+}
+
+} // namespace
+} // namespace blackbit
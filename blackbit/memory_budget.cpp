@@ -0,0 +1,62 @@
+#include "memory_budget.hpp"
+
+#include "move_history.hpp"
+
+#include "bee/format.hpp"
+
+#include <cassert>
+#include <cctype>
+
+using std::string;
+
+namespace blackbit {
+
+namespace {
+
+// Smaller tables make the engines play much worse than with less of them
+constexpr size_t min_table_bytes = 1 << 20;
+
+} // namespace
+
+MemoryBudget::MemoryBudget(size_t total_bytes) : _total_bytes(total_bytes) {}
+
+bee::OrError<MemoryBudget> MemoryBudget::parse(const string& str)
+{
+  size_t end = 0;
+  while (end < str.size() && std::isdigit(str[end])) { end++; }
+  if (end == 0) { return bee::Error::format("Invalid memory size: $", str); }
+  size_t value = std::stoull(str.substr(0, end));
+  auto unit = str.substr(end);
+  if (unit == "" || unit == "M" || unit == "MB") {
+    return MemoryBudget(value << 20);
+  } else if (unit == "G" || unit == "GB") {
+    return MemoryBudget(value << 30);
+  } else if (unit == "K" || unit == "KB") {
+    return MemoryBudget(value << 10);
+  }
+  return bee::Error::format("Invalid memory size: $", str);
+}
+
+bee::OrError<size_t> MemoryBudget::table_bytes(
+  int num_engines, int num_tables) const
+{
+  assert(num_tables > 0);
+  size_t fixed = num_engines * sizeof(MoveHistory);
+  size_t per_table =
+    fixed < _total_bytes ? (_total_bytes - fixed) / num_tables : 0;
+  if (per_table < min_table_bytes) {
+    return bee::Error::format(
+      "Memory budget of $ is too small for $ engines and $ tables",
+      format_bytes(_total_bytes),
+      num_engines,
+      num_tables);
+  }
+  return per_table;
+}
+
+string MemoryBudget::format_bytes(size_t bytes)
+{
+  return bee::format("$MB", bytes >> 20);
+}
+
+} // namespace blackbit
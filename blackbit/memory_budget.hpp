@@ -0,0 +1,31 @@
+#pragma once
+
+#include "bee/error.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace blackbit {
+
+// Memory for all the engines of the process. Each engine has a move history of
+// a fixed size, what is left is split evenly between the transposition tables.
+// There can be fewer tables than engines when engines share them.
+struct MemoryBudget {
+ public:
+  explicit MemoryBudget(size_t total_bytes);
+
+  // Sizes like 512M or 64G, a plain number is in megabytes
+  static bee::OrError<MemoryBudget> parse(const std::string& str);
+
+  // Fails when the budget doesn't leave a usable table for each
+  bee::OrError<size_t> table_bytes(int num_engines, int num_tables) const;
+
+  size_t total_bytes() const { return _total_bytes; }
+
+  static std::string format_bytes(size_t bytes);
+
+ private:
+  size_t _total_bytes;
+};
+
+} // namespace blackbit
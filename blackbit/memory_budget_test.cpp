@@ -0,0 +1,52 @@
+#include "memory_budget.hpp"
+
+#include "bee/testing.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using bee::print_line;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace blackbit {
+namespace {
+
+TEST(parse)
+{
+  vector<string> sizes = {"512", "512M", "2G", "2GB", "4096K", "x", "1T"};
+  for (const auto& str : sizes) {
+    auto budget = MemoryBudget::parse(str);
+    if (budget.is_error()) {
+      print_line("$ -> $", str, budget.error());
+    } else {
+      print_line(
+        "$ -> $",
+        str,
+        MemoryBudget::format_bytes(budget.value().total_bytes()));
+    }
+  }
+}
+
+TEST(table_bytes)
+{
+  auto budget = MemoryBudget(1 << 30);
+  vector<pair<int, int>> cases = {{2, 2}, {32, 32}, {32, 2}, {2, 2000}};
+  for (const auto& [num_engines, num_tables] : cases) {
+    auto bytes = budget.table_bytes(num_engines, num_tables);
+    if (bytes.is_error()) {
+      print_line("$ $ -> $", num_engines, num_tables, bytes.error());
+    } else {
+      print_line(
+        "$ $ -> $",
+        num_engines,
+        num_tables,
+        MemoryBudget::format_bytes(bytes.value()));
+    }
+  }
+}
+
+} // namespace
+} // namespace blackbit
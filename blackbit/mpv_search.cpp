@@ -1,30 +1,29 @@
 #include "mpv_search.hpp"
 
 #include "engine_core.hpp"
+#include "engine_runtime.hpp"
 #include "move.hpp"
 #include "rules.hpp"
 
-#include "bee/nref.hpp"
-
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <mutex>
-#include <set>
-#include <thread>
 
 using bee::format;
-using bee::nref;
 using bee::Span;
 using bee::Time;
 using std::atomic_bool;
 using std::function;
 using std::lock_guard;
 using std::make_unique;
-using std::multiset;
 using std::mutex;
 using std::optional;
 using std::shared_ptr;
 using std::string;
-using std::thread;
 using std::unique_ptr;
 using std::variant;
 using std::vector;
@@ -102,6 +101,15 @@ struct PartialScore {
   value_type _value;
 };
 
+// What a finished search of a root move found, published for the other
+// workers to read. Never modified once published.
+struct MoveResult {
+  using ptr = std::shared_ptr<const MoveResult>;
+
+  SearchResultInfo::ptr result;
+  PartialScore score;
+};
+
 struct MoveSearchState {
   using ptr = unique_ptr<MoveSearchState>;
 
@@ -111,20 +119,45 @@ struct MoveSearchState {
   MoveSearchState& operator=(const MoveSearchState& other) = delete;
   MoveSearchState& operator=(MoveSearchState&& other) = delete;
 
-  explicit MoveSearchState(Move m) : m(m) {}
+  MoveSearchState(Move m, int max_depth)
+      : m(m), result_at_depth(max_depth + 1), score_at_depth(max_depth + 1)
+  {
+    for (auto& score : score_at_depth) { score.store(no_score); }
+  }
+
+  static constexpr int32_t no_score = std::numeric_limits<int32_t>::min();
+
   Move m;
-  bool taken = false;
-  int next_depth = 1;
 
-  SearchResultInfo::ptr last_result = nullptr;
-  PartialScore last_score = PartialScore::at_most(Score::max());
+  // Moves are only compared at a depth all of them were searched to
+  vector<std::atomic<MoveResult::ptr>> result_at_depth;
+
+  // In milli pawns, no_score until the move was searched to that depth
+  vector<std::atomic<int32_t>> score_at_depth;
+};
+
+// Searching one root move to one depth. Each root move has at most one task
+// queued or running at a time, the task for the next depth is queued when the
+// current one finishes. A move can only get max_depth_lead depths ahead of
+// the depth every move was searched to, its next task waits until the others
+// catch up.
+struct Task {
+  int move_idx;
+  int depth;
+};
+
+// Each worker takes tasks from the front of its own queue, oldest first, and
+// steals from the front of the other workers' queues when its own is empty.
+struct WorkerQueue {
+  mutex lock;
+  std::deque<Task> tasks;
 };
 
 struct MpvContext : public std::enable_shared_from_this<MpvContext> {
  public:
   MpvContext(
     unique_ptr<Board>&& board,
-    const int max_depth,
+    const SearchLimits& limits,
     const int max_pvs,
     const optional<int> num_workers_opt,
     shared_ptr<TranspositionTable> hash_table,
@@ -134,7 +167,8 @@ struct MpvContext : public std::enable_shared_from_this<MpvContext> {
     const EvalParameters& eval_params,
     function<void(vector<SearchResultInfo::ptr>&&)>&& on_update)
       : _board(std::move(board)),
-        _max_depth(max_depth),
+        _limits(limits),
+        _max_depth(limits.depth),
         _max_pvs(max_pvs),
         _num_workers(num_workers_opt.value_or(1)),
         _hash_table(hash_table),
@@ -143,51 +177,65 @@ struct MpvContext : public std::enable_shared_from_this<MpvContext> {
         _experiment(experiment),
         _eval_params(eval_params),
         _on_update(std::move(on_update)),
-        _player(_board->turn)
+        _player(_board->turn),
+        _queues(_num_workers),
+        _stats(_num_workers)
   {
     assert(_max_pvs > 0);
     assert(_max_depth > 0);
     assert(_on_update != nullptr);
   }
 
-  void sort_moves(vector<nref<MoveSearchState>>& sorted_moves)
+  static void sort_moves(vector<MoveResult::ptr>& sorted_moves)
   {
-    auto is_better_than =
-      [&](nref<MoveSearchState> rm1, nref<MoveSearchState> rm2) {
-        auto& m1 = *rm1;
-        auto& m2 = *rm2;
-
-        if (!m1.last_score.is_exact() && !m2.last_score.is_exact()) {
-          return false;
-        } else if (!m1.last_score.is_exact()) {
-          return false;
-        } else if (!m2.last_score.is_exact()) {
-          return true;
-        }
+    auto is_better_than = [&](const MoveResult::ptr& m1,
+                              const MoveResult::ptr& m2) {
+      if (m1 == nullptr || m2 == nullptr) { return m1 != nullptr; }
+
+      if (!m1->score.is_exact() && !m2->score.is_exact()) {
+        return false;
+      } else if (!m1->score.is_exact()) {
+        return false;
+      } else if (!m2->score.is_exact()) {
+        return true;
+      }
 
-        auto s1 = m1.last_score.exact_score();
-        auto s2 = m2.last_score.exact_score();
+      auto s1 = m1->score.exact_score();
+      auto s2 = m2->score.exact_score();
 
-        if (s1 != s2) {
-          return s1 > s2;
-        } else if (m1.last_result == nullptr && m2.last_result == nullptr) {
-          return false;
-        } else if (m1.last_result == nullptr) {
-          return false;
-        } else if (m2.last_result == nullptr) {
-          return true;
-        } else if (m1.last_result->depth != m2.last_result->depth) {
-          return m1.last_result->depth > m2.last_result->depth;
-        } else {
-          return m1.m < m2.m;
-        }
-      };
+      if (s1 != s2) {
+        return s1 > s2;
+      } else if (m1->result->depth != m2->result->depth) {
+        return m1->result->depth > m2->result->depth;
+      } else {
+        return m1->result->best_move < m2->result->best_move;
+      }
+    };
 
     sort(sorted_moves.begin(), sorted_moves.end(), is_better_than);
   };
 
-  void update_result(
-    Move m,
+  // Moves that can't be among the best max_pvs at this depth are only searched
+  // enough to prove it
+  Score lower_bound(int depth) const
+  {
+    vector<Score> scores;
+    for (const auto& m : _legal_moves) {
+      auto score = m->score_at_depth[depth].load();
+      if (score != MoveSearchState::no_score) {
+        scores.push_back(Score::of_milli_pawns(score));
+      }
+    }
+    if (std::ssize(scores) < _max_pvs) { return Score::min(); }
+    std::nth_element(
+      scores.begin(),
+      scores.begin() + (_max_pvs - 1),
+      scores.end(),
+      std::greater<Score>());
+    return scores[_max_pvs - 1] - Score::of_pawns(1.0);
+  }
+
+  void publish_result(
     MoveSearchState& move_state,
     SearchResultOneDepth&& result,
     Span ellapsed,
@@ -195,137 +243,245 @@ struct MpvContext : public std::enable_shared_from_this<MpvContext> {
     Score lower_bound)
   {
     auto score = result.score();
-    auto result_info = SearchResultInfo::create(
-      m, std::move(result.pv()), score, _node_count, depth, ellapsed);
-
-    move_state.last_result = std::move(result_info);
+    auto nodes = _node_count.fetch_add(result.nodes()) + result.nodes();
+    auto published = std::make_shared<MoveResult>(MoveResult{
+      .result = SearchResultInfo::create(
+        move_state.m, std::move(result.pv()), score, nodes, depth, ellapsed),
+      .score = score <= lower_bound ? PartialScore::at_most(lower_bound)
+                                    : PartialScore::exactly(score),
+    });
+    move_state.score_at_depth[depth].store(score.to_milli_pawns());
+    move_state.result_at_depth[depth].store(std::move(published));
+    _published++;
+  }
 
-    if (score <= lower_bound) {
-      move_state.last_score = PartialScore::at_most(lower_bound);
-    } else {
-      move_state.last_score = PartialScore::exactly(score);
+  // Moves ranked by their scores at the deepest depth every move was searched
+  // to, or at depth 1 among the moves searched to it until they all are, so
+  // that scores from different depths are never compared. With newest, a move
+  // already searched one depth further is shown with that result, keeping its
+  // rank.
+  vector<SearchResultInfo::ptr> best_results(bool newest) const
+  {
+    int depth = std::max(_completed_depth.load(), 1);
+    vector<MoveResult::ptr> sorted_moves;
+    for (auto& m : _legal_moves) {
+      sorted_moves.push_back(m->result_at_depth[depth].load());
     }
-
-    vector<nref<MoveSearchState>> sorted_moves;
-    for (auto& m : _legal_moves) { sorted_moves.emplace_back(m); }
     sort_moves(sorted_moves);
 
+    auto newest_result = [&](const MoveResult::ptr& ranked) {
+      if (!newest || depth >= _max_depth) { return ranked; }
+      for (auto& m : _legal_moves) {
+        if (m->m != ranked->result->best_move) { continue; }
+        auto deeper = m->result_at_depth[depth + 1].load();
+        if (deeper != nullptr && deeper->score.is_exact()) { return deeper; }
+      }
+      return ranked;
+    };
+
     vector<SearchResultInfo::ptr> results;
     results.reserve(_max_pvs);
     for (auto& m : sorted_moves) {
-      if (m->last_result == nullptr) continue;
-      if (!m->last_score.is_exact()) { continue; }
-      results.push_back(m->last_result->clone());
+      if (m == nullptr) continue;
+      if (!m->score.is_exact()) { continue; }
+      results.push_back(newest_result(m)->result->clone());
       results.back()->flip(_player);
       if (std::ssize(results) >= _max_pvs) break;
     }
-    if (!results.empty()) {
-      _latest_search_result.clear();
-      for (auto& result : results) {
-        _latest_search_result.push_back(result->clone());
-      }
+    return results;
+  }
+
+  // Only one worker reports at a time, and workers don't wait for each other
+  // to report. A worker that finds another one reporting leaves it to that
+  // one, which checks for new results after it's done.
+  void report()
+  {
+    while (true) {
+      std::unique_lock l(_report_lock, std::try_to_lock);
+      if (!l.owns_lock()) { return; }
+      auto seen = _published.load();
+      _on_update(best_results(true));
+      l.unlock();
+      if (_published.load() == seen) { return; }
     }
-    _on_update(std::move(results));
-  };
+  }
 
-  nref<MoveSearchState> select_work(bool can_bump_depth)
+  void push_task(int worker_id, Task task)
   {
-    auto is_higher_pri_than =
-      [](const MoveSearchState& s1, const MoveSearchState& s2) {
-        if (s1.last_result == nullptr && s2.last_result == nullptr) {
-          return false;
-        } else if (s1.last_result == nullptr) {
-          return true;
-        } else if (s2.last_result == nullptr) {
-          return false;
-        } else if (s1.last_result->depth != s2.last_result->depth) {
-          return s1.last_result->depth < s2.last_result->depth;
-        } else if (s1.last_result->eval != s2.last_result->eval) {
-          return s1.last_result->eval < s2.last_result->eval;
-        } else {
-          return false;
-        }
-      };
-    nref<MoveSearchState> selected_state(nullptr);
+    {
+      auto& queue = _queues[worker_id];
+      lock_guard<mutex> guard(queue.lock);
+      queue.tasks.push_back(task);
+    }
+    _queued++;
+    wake_idle_workers();
+  }
 
-    bool has_not_taken = false;
-    for (auto& m : _legal_moves) {
-      if (m->taken) continue;
-      has_not_taken = true;
-      if (m->next_depth > _current_depth) { continue; }
-      if (
-        selected_state == nullptr || is_higher_pri_than(*m, *selected_state)) {
-        selected_state = m;
-      }
+  optional<Task> pop_task(int worker_id)
+  {
+    for (int i = 0; i < _num_workers; i++) {
+      auto& queue = _queues[(worker_id + i) % _num_workers];
+      lock_guard<mutex> guard(queue.lock);
+      if (queue.tasks.empty()) { continue; }
+      auto task = queue.tasks.front();
+      queue.tasks.pop_front();
+      _queued--;
+      if (i > 0) { _stats[worker_id].steals++; }
+      return task;
+    }
+    return std::nullopt;
+  }
+
+  // Waits for a task while other workers are still searching, since they
+  // queue the next depth of their moves when they finish
+  optional<Task> next_task(int worker_id)
+  {
+    while (true) {
+      if (_should_stop->load()) { return std::nullopt; }
+      if (auto task = pop_task(worker_id)) { return task; }
+      std::unique_lock l(_idle_lock);
+      if (_queued.load() > 0) { continue; }
+      if (_outstanding.load() == 0) { return std::nullopt; }
+      // Checked with the lock held, a worker that stops notifies after
+      // taking it
+      if (_should_stop->load()) { return std::nullopt; }
+      _idle_cond.wait(l);
     }
+  }
+
+  // Whoever is waiting for a task looks again
+  void wake_idle_workers()
+  {
+    { lock_guard<mutex> guard(_idle_lock); }
+    _idle_cond.notify_all();
+  }
+
+  bool is_eligible(const Task& task) const
+  {
+    return task.depth <= _completed_depth.load() + 1 + max_depth_lead;
+  }
 
-    if (
-      selected_state == nullptr && can_bump_depth && has_not_taken &&
-      _current_depth < _max_depth) {
-      _current_depth++;
-      return select_work(false);
-    } else if (selected_state != nullptr) {
-      selected_state->taken = true;
+  // Queues the next depth of a move, or holds it back if the move is too far
+  // ahead
+  void finish_depth(int worker_id, const Task& task)
+  {
+    lock_guard<mutex> guard(_deferred_lock);
+    int num_moves = _legal_moves.size();
+    if (++_finished_at_depth[task.depth] == num_moves) {
+      int completed = _completed_depth.load();
+      while (completed < _max_depth &&
+             _finished_at_depth[completed + 1] == num_moves) {
+        completed++;
+      }
+      _completed_depth.store(completed);
     }
-    return selected_state;
+    if (task.depth < _max_depth) {
+      _outstanding++;
+      _deferred.push_back(Task{task.move_idx, task.depth + 1});
+    }
+    std::erase_if(_deferred, [&](const Task& deferred) {
+      if (!is_eligible(deferred)) { return false; }
+      push_task(worker_id, deferred);
+      return true;
+    });
   }
 
-  nref<MoveSearchState> select_work()
+  void finish_task()
   {
-    lock_guard<mutex> guard(_mutex_critical_part);
-    return select_work(true);
+    if (--_outstanding == 0) { wake_idle_workers(); }
   }
 
-  void run_worker()
+  void run_worker(int worker_id)
   {
-    Board board = *_board;
+    // Each worker keeps one core for the whole search, positioned at the root
+    // between tasks
+    auto core = EngineCore::create(
+      *_board,
+      _hash_table,
+      _move_history,
+      nullptr,
+      false,
+      _should_stop,
+      _experiment,
+      _eval_params);
+    core->set_node_callback(_limiter->node_callback());
+    auto& stats = _stats[worker_id];
     while (true) {
-      if (_should_stop->load() || _current_depth > _max_depth) { break; }
-      auto move_state = select_work();
-      if (move_state == nullptr) { break; }
-      Move m = move_state->m;
-      int depth = move_state->next_depth;
-      Score lower_bound = _lower_bound.at(depth);
-      move_state->next_depth++;
-      auto mi = board.move(m);
-      auto core = EngineCore::create(
-        board,
-        _hash_table,
-        _move_history,
-        nullptr,
-        false,
-        _should_stop,
-        _experiment,
-        _eval_params);
-      board.undo(m, mi);
-      must(r, core->search_one_depth(depth, Score::min(), -lower_bound));
-      if (!r.has_value()) { break; }
+      auto wait_start = Time::monotonic();
+      auto task = next_task(worker_id);
+      auto work_start = Time::monotonic();
+      stats.idle += work_start - wait_start;
+      if (!task.has_value()) { break; }
+
+      auto& move_state = *_legal_moves[task->move_idx];
+      Move m = move_state.m;
+      int depth = task->depth;
+      Score bound = lower_bound(depth);
+      core->move(m);
+      must(r, core->search_one_depth(depth, Score::min(), -bound));
+      core->undo();
+      if (!r.has_value()) {
+        finish_task();
+        break;
+      }
       auto& result = r.value();
       result.flip();
       result.prepend_move(m);
       Span ellapsed = Time::monotonic().diff(_start);
-      {
-        lock_guard<mutex> guard(_mutex_critical_part);
-        move_state->taken = false;
-        _node_count += result.nodes();
-        auto& best_scores = _best_scores[depth];
-        best_scores.insert(result.score());
-        update_result(
-          m, *move_state, std::move(result), ellapsed, depth, lower_bound);
-        if (int(best_scores.size()) > _max_pvs) {
-          // remove the lowest score
-          best_scores.erase(best_scores.begin());
-        }
-        if (int(best_scores.size()) == _max_pvs) {
-          _lower_bound[depth] = *best_scores.begin() - Score::of_pawns(1.0);
-        }
+      // Nothing left to search can do better than a short enough mate
+      bool mate_reached = _limits.is_mate_reached(result.score());
+      publish_result(move_state, std::move(result), ellapsed, depth, bound);
+      if (mate_reached) {
+        _mate_result.store(move_state.result_at_depth[depth].load());
+        _should_stop->store(true);
       }
+      finish_depth(worker_id, *task);
+      finish_task();
+      report();
+
+      stats.busy += Time::monotonic() - work_start;
+      stats.tasks++;
     }
+    // Tasks held back for later depths are never queued once the search
+    // stops, the idle workers have to see the stop instead
+    wake_idle_workers();
   };
 
-  bee::OrError<vector<SearchResultInfo::ptr>> search_multi_pv()
+  // The calling thread is worker 0, the others are tasks on the EngineRuntime,
+  // so the search starts no threads of its own. Since any worker can take any task, the search doesn't
+  // need the other workers to start: one that starts after worker 0 is done
+  // returns right away. Worker 0 only waits for the ones already running.
+  void run_workers()
+  {
+    auto& runtime = EngineRuntime::instance();
+    auto ptr = shared_from_this();
+    for (int i = 1; i < _num_workers; i++) {
+      runtime.create_strand()->post([ptr, i]() {
+        {
+          lock_guard<mutex> guard(ptr->_workers_lock);
+          if (ptr->_workers_closed) { return; }
+          ptr->_workers_running++;
+        }
+        ptr->run_worker(i);
+        {
+          lock_guard<mutex> guard(ptr->_workers_lock);
+          ptr->_workers_running--;
+        }
+        ptr->_workers_cond.notify_all();
+      });
+    }
+    run_worker(0);
+
+    std::unique_lock l(_workers_lock);
+    _workers_closed = true;
+    _workers_cond.wait(l, [this] { return _workers_running == 0; });
+  }
+
+  bee::OrError<vector<SearchResultInfo::ptr>> search_multi_pv(
+    MpvSearchStats* stats)
   {
     _start = Time::monotonic();
+    _limiter = SearchLimiter::create(_limits, _should_stop);
 
     MoveVector valid_moves;
     auto scratch = Rules::make_scratch(*_board);
@@ -333,33 +489,51 @@ struct MpvContext : public std::enable_shared_from_this<MpvContext> {
     _legal_moves.reserve(valid_moves.size());
     for (Move m : valid_moves) {
       if (Rules::is_legal_move(*_board, scratch, m)) {
-        _legal_moves.push_back(make_unique<MoveSearchState>(m));
+        _legal_moves.push_back(make_unique<MoveSearchState>(m, _max_depth));
       }
     }
     if (_legal_moves.empty()) {
       _on_update({});
       return bee::Error("No legal moves");
     }
+    _finished_at_depth = vector<int>(_max_depth + 1, 0);
 
-    _lower_bound.resize(_max_depth + 1, Score::min());
-    _best_scores.resize(_max_depth + 1);
+    for (int i = 0; i < std::ssize(_legal_moves); i++) {
+      _outstanding++;
+      push_task(i % _num_workers, Task{i, 1});
+    }
 
-    vector<thread> workers;
-    auto ptr = shared_from_this();
-    for (int i = 0; i < _num_workers; i++) {
-      workers.push_back(thread([ptr]() { ptr->run_worker(); }));
+    run_workers();
+
+    if (stats != nullptr) { stats->workers = _stats; }
+
+    _latest_search_result = best_results(false);
+
+    // The mate can be deeper than the depth every move was searched to, it
+    // goes first anyway since nothing can do better
+    if (auto mate = _mate_result.load()) {
+      auto& results = _latest_search_result;
+      std::erase_if(results, [&](const SearchResultInfo::ptr& r) {
+        return r->best_move == mate->result->best_move;
+      });
+      results.insert(results.begin(), mate->result->clone());
+      results.front()->flip(_player);
+      if (std::ssize(results) > _max_pvs) { results.resize(_max_pvs); }
     }
-    for (auto& w : workers) { w.join(); }
 
     if (_latest_search_result.empty()) {
       return bee::Error("Engine failed to find a move on mpv search");
     }
+    if (_limiter->reached_node_limit()) {
+      for (auto& r : _latest_search_result) { r->nodes = _limiter->nodes(); }
+    }
 
     return std::move(_latest_search_result);
   }
 
  private:
   unique_ptr<Board> _board;
+  const SearchLimits _limits;
   int _max_depth;
   int _max_pvs;
   int _num_workers;
@@ -373,20 +547,45 @@ struct MpvContext : public std::enable_shared_from_this<MpvContext> {
   const Color _player;
   vector<MoveSearchState::ptr> _legal_moves;
   Time _start;
-  mutex _mutex_critical_part;
-  uint64_t _node_count = 0;
-  vector<multiset<Score>> _best_scores;
-  vector<Score> _lower_bound;
+  SearchLimiter::ptr _limiter;
+  std::atomic<uint64_t> _node_count = 0;
+
+  vector<WorkerQueue> _queues;
+  std::atomic<int> _queued = 0;
+  // Tasks queued or running
+  std::atomic<int> _outstanding = 0;
+  mutex _idle_lock;
+  std::condition_variable _idle_cond;
+
+  // How many depths a move can get ahead of the others
+  static constexpr int max_depth_lead = 1;
+
+  // Deepest depth every move was searched to
+  std::atomic<int> _completed_depth = 0;
+  mutex _deferred_lock;
+  vector<int> _finished_at_depth;
+  vector<Task> _deferred;
+
+  std::atomic<MoveResult::ptr> _mate_result;
+
+  mutex _report_lock;
+  std::atomic<uint64_t> _published = 0;
   vector<SearchResultInfo::ptr> _latest_search_result;
 
-  int _current_depth = 1;
+  vector<MpvSearchStats::Worker> _stats;
+
+  // Workers that started on the runtime and haven't returned yet
+  mutex _workers_lock;
+  std::condition_variable _workers_cond;
+  int _workers_running = 0;
+  bool _workers_closed = false;
 };
 
 } // namespace
 
 bee::OrError<vector<SearchResultInfo::ptr>> MpvSearch::search(
   std::unique_ptr<Board>&& board,
-  int max_depth,
+  const SearchLimits& limits,
   int max_pvs,
   std::optional<int> num_workers,
   const shared_ptr<TranspositionTable>& hash_table,
@@ -394,12 +593,13 @@ bee::OrError<vector<SearchResultInfo::ptr>> MpvSearch::search(
   const std::shared_ptr<std::atomic_bool>& should_stop,
   const Experiment& experiment,
   const EvalParameters& eval_params,
-  std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update)
+  std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update,
+  MpvSearchStats* stats)
 {
-  if (max_depth < 1) { return bee::Error("Max depth must be at least 1"); }
+  if (limits.depth < 1) { return bee::Error("Max depth must be at least 1"); }
   auto context = make_shared<MpvContext>(
     std::move(board),
-    max_depth,
+    limits,
     max_pvs,
     num_workers,
     hash_table,
@@ -408,7 +608,7 @@ bee::OrError<vector<SearchResultInfo::ptr>> MpvSearch::search(
     experiment,
     eval_params,
     std::move(on_update));
-  return context->search_multi_pv();
+  return context->search_multi_pv(stats);
 }
 
 } // namespace blackbit
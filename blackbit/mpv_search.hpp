@@ -4,6 +4,7 @@
 #include "board.hpp"
 #include "eval.hpp"
 #include "move_history.hpp"
+#include "search_limits.hpp"
 #include "search_result_info.hpp"
 #include "transposition_table.hpp"
 
@@ -12,10 +13,24 @@
 
 namespace blackbit {
 
+// How each worker spent its time during a search
+struct MpvSearchStats {
+  struct Worker {
+    bee::Span busy = bee::Span::zero();
+    bee::Span idle = bee::Span::zero();
+    int tasks = 0;
+    int steals = 0;
+  };
+
+  std::vector<Worker> workers;
+};
+
 struct MpvSearch {
+  // The workers share the node limit, so only a search with a single worker
+  // is deterministic
   static bee::OrError<std::vector<SearchResultInfo::ptr>> search(
     std::unique_ptr<Board>&& board,
-    int max_depth,
+    const SearchLimits& limits,
     int max_pvs,
     std::optional<int> num_workers,
     const std::shared_ptr<TranspositionTable>& hash_table,
@@ -23,7 +38,8 @@ struct MpvSearch {
     const std::shared_ptr<std::atomic_bool>& should_stop,
     const Experiment& experiment,
     const EvalParameters& eval_params,
-    std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update);
+    std::function<void(std::vector<SearchResultInfo::ptr>&&)>&& on_update,
+    MpvSearchStats* stats = nullptr);
 };
 
 } // namespace blackbit
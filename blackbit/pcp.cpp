@@ -1,21 +1,37 @@
 #include "pcp.hpp"
 
+#include "board.hpp"
 #include "generated_game_record.hpp"
 #include "search_result_info.hpp"
 
 #include "bee/copy.hpp"
+#include "bee/format.hpp"
 #include "stone/stone_reader.hpp"
 #include "yasf/cof.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <unordered_map>
+#include <vector>
 
+using bee::print_line;
 using bee::Span;
+using bee::Time;
 using std::make_shared;
 using std::nullopt;
 using std::optional;
 using std::string;
 using std::unordered_map;
+using std::vector;
 using stone::StoneReader;
 
 namespace blackbit {
@@ -40,6 +56,134 @@ optional<SearchResultInfo::ptr> to_sri(const PCP::entry& entry)
     best.think_time.value_or(Span::zero()));
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// PCPIndex
+//
+
+// Open addressing index from Board::hash_key() to the entries of a PCP, with a
+// blocked bloom filter in front of it so misses only touch one cache line
+struct PCPIndex {
+ public:
+  static bee::OrError<PCPIndex> build(
+    const unordered_map<string, PCP::entry>& entries)
+  {
+    PCPIndex index(entries.size());
+    for (const auto& [fen, entry] : entries) {
+      if (entry.best_moves.empty()) { continue; }
+      Board board;
+      bail_unit(board.set_fen(fen));
+      index._insert(board.hash_key(), entry.best_moves[0]);
+    }
+    index._pv_start.push_back(index._pvs.size());
+    return index;
+  }
+
+  optional<PCPProbe> probe(uint64_t key) const
+  {
+    if (!_may_contain(key)) { return nullopt; }
+    for (uint64_t idx = key & _slot_mask;; idx = (idx + 1) & _slot_mask) {
+      const auto& slot = _slots[idx];
+      if (!slot.used) { return nullopt; }
+      if (slot.key == key) { return slot.probe; }
+    }
+  }
+
+  vector<Move> pv(const PCPProbe& probe) const
+  {
+    return vector<Move>(
+      _pvs.begin() + _pv_start[probe.pv_handle],
+      _pvs.begin() + _pv_start[probe.pv_handle + 1]);
+  }
+
+ private:
+  struct Slot {
+    uint64_t key = 0;
+    PCPProbe probe;
+    bool used = false;
+  };
+
+  struct alignas(64) FilterBlock {
+    uint64_t bits[8] = {};
+  };
+
+  explicit PCPIndex(size_t num_entries)
+      : _slots(std::bit_ceil(num_entries * 2 + 1)),
+        _slot_mask(_slots.size() - 1),
+        _filter(std::bit_ceil(num_entries * bits_per_entry / 512 + 1)),
+        _filter_mask(_filter.size() - 1)
+  {}
+
+  static constexpr size_t bits_per_entry = 16;
+
+  const FilterBlock& _filter_block(uint64_t key) const
+  {
+    return _filter[(key >> 32) & _filter_mask];
+  }
+
+  template <class F> static void _for_each_filter_bit(uint64_t key, F&& f)
+  {
+    for (int i = 0; i < 3; i++) {
+      int bit = (key >> (9 * i)) & 511;
+      f(bit / 64, 1ull << (bit % 64));
+    }
+  }
+
+  bool _may_contain(uint64_t key) const
+  {
+    const auto& block = _filter_block(key);
+    bool found = true;
+    _for_each_filter_bit(key, [&](int word, uint64_t mask) {
+      found &= (block.bits[word] & mask) != 0;
+    });
+    return found;
+  }
+
+  void _insert(uint64_t key, const gr::MoveInfo& best)
+  {
+    uint64_t idx = key & _slot_mask;
+    while (_slots[idx].used) {
+      if (_slots[idx].key == key) { return; }
+      idx = (idx + 1) & _slot_mask;
+    }
+
+    auto& block = _filter[(key >> 32) & _filter_mask];
+    _for_each_filter_bit(
+      key, [&](int word, uint64_t mask) { block.bits[word] |= mask; });
+
+    uint32_t handle = _pv_start.size();
+    _pv_start.push_back(_pvs.size());
+    _pvs.insert(_pvs.end(), best.pv.begin(), best.pv.end());
+
+    _slots[idx] = Slot{
+      .key = key,
+      .probe =
+        PCPProbe{
+          .eval = best.evaluation.value_or(Score::zero()),
+          .best_move = best.move,
+          .depth = int16_t(best.depth.value_or(0)),
+          .pv_handle = handle,
+        },
+      .used = true,
+    };
+  }
+
+  vector<Slot> _slots;
+  uint64_t _slot_mask;
+
+  vector<FilterBlock> _filter;
+  uint64_t _filter_mask;
+
+  vector<Move> _pvs;
+  vector<uint32_t> _pv_start;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// DiskPCP
+//
+
+// Entries are only parsed when looked up. The hash key index needs all of
+// them, it is built on the first probe, so opening stays cheap for callers
+// that only look up FENs or read everything once.
 struct DiskPCP : public PCP {
  public:
   explicit DiskPCP(stone::StoneReader::ptr&& reader)
@@ -60,7 +204,29 @@ struct DiskPCP : public PCP {
 
   virtual bee::OrError<unordered_map<string, entry>> read_all() override
   {
-    bail(values, _reader->read_all());
+    return read_all(*_reader);
+  }
+
+  virtual optional<PCPProbe> probe(uint64_t hash_key) const override
+  {
+    return _get_index().probe(hash_key);
+  }
+
+  virtual vector<Move> probe_pv(const PCPProbe& probe) const override
+  {
+    return _get_index().pv(probe);
+  }
+
+  static bee::OrError<ptr> open(const bee::FilePath& filename)
+  {
+    bail(reader, StoneReader::open(filename));
+    return make_shared<DiskPCP>(std::move(reader));
+  }
+
+  static bee::OrError<unordered_map<string, entry>> read_all(
+    StoneReader& reader)
+  {
+    bail(values, reader.read_all());
 
     unordered_map<string, entry> output;
     for (auto& [fen, str] : values) {
@@ -71,20 +237,39 @@ struct DiskPCP : public PCP {
     return output;
   }
 
-  static bee::OrError<ptr> open(const bee::FilePath& filename)
+ private:
+  // A table that fails to index is probed as if it were empty, the search
+  // can't handle errors
+  const PCPIndex& _get_index() const
   {
-    bail(reader, StoneReader::open(filename));
-    return make_shared<DiskPCP>(std::move(reader));
+    std::call_once(_index_once, [this] {
+      auto index = [&]() -> bee::OrError<PCPIndex> {
+        bail(entries, read_all(*_reader));
+        return PCPIndex::build(entries);
+      }();
+      if (index.is_error()) {
+        print_line("Failed to index pcp, probes will miss: $", index.error());
+        index = PCPIndex::build({});
+      }
+      _index.emplace(std::move(*index));
+    });
+    return *_index;
   }
 
- private:
   stone::StoneReader::ptr _reader;
+
+  mutable std::once_flag _index_once;
+  mutable optional<PCPIndex> _index;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// MemoryPCP
+//
+
 struct MemoryPCP final : public PCP {
  public:
-  explicit MemoryPCP(unordered_map<string, entry>&& entries)
-      : _entries(std::move(entries))
+  MemoryPCP(unordered_map<string, entry>&& entries, PCPIndex&& index)
+      : _entries(std::move(entries)), _index(std::move(index))
   {}
 
   virtual ~MemoryPCP() {}
@@ -102,31 +287,401 @@ struct MemoryPCP final : public PCP {
     return _entries;
   }
 
+  virtual optional<PCPProbe> probe(uint64_t hash_key) const override
+  {
+    return _index.probe(hash_key);
+  }
+
+  virtual vector<Move> probe_pv(const PCPProbe& probe) const override
+  {
+    return _index.pv(probe);
+  }
+
   static bee::OrError<ptr> open(const bee::FilePath& filename)
   {
-    bail(on_disk, DiskPCP::open(filename));
-    bail(entries, on_disk->read_all());
-    return make_shared<MemoryPCP>(std::move(entries));
+    bail(reader, StoneReader::open(filename));
+    bail(entries, DiskPCP::read_all(*reader));
+    bail(index, PCPIndex::build(entries));
+    return make_shared<MemoryPCP>(std::move(entries), std::move(index));
   }
 
  private:
   unordered_map<string, entry> _entries;
+  PCPIndex _index;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// BinaryPCP
+//
+
+// Layout of the binary format, integers are stored in native byte order:
+//  - BinaryHeader
+//  - num_records BinaryRecords, sorted by key
+//  - num_pv_moves Moves, the PVs of all the records back to back
+constexpr char binary_magic[8] = {'B', 'B', 'P', 'C', 'P', 0, 0, 0};
+constexpr uint32_t binary_version = 1;
+
+struct BinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t num_records;
+  uint64_t num_pv_moves;
 };
 
+static_assert(sizeof(BinaryHeader) == 32);
+
+struct BinaryRecord {
+  uint64_t key;
+  int32_t eval_milli;
+  uint32_t pv_offset;
+  uint32_t frequency;
+  uint32_t think_time_ms;
+  int16_t depth;
+  uint16_t ply;
+  uint8_t pv_length;
+  Move move;
+};
+
+static_assert(sizeof(BinaryRecord) == 32);
+static_assert(std::is_trivially_copyable_v<BinaryRecord>);
+
+// Counters and times that don't fit are stored as the largest value instead of
+// wrapping around to a small one
+uint32_t saturate_u32(int64_t value)
+{
+  return uint32_t(
+    std::clamp<int64_t>(value, 0, std::numeric_limits<uint32_t>::max()));
+}
+
+bool has_binary_magic(const std::byte* data, size_t size)
+{
+  return size >= sizeof(binary_magic) &&
+         memcmp(data, binary_magic, sizeof(binary_magic)) == 0;
+}
+
+// Read only mapping of a whole file
+struct MappedFile {
+ public:
+  using ptr = std::shared_ptr<MappedFile>;
+
+  MappedFile(const std::byte* data, size_t size) : _data(data), _size(size) {}
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile()
+  {
+    if (_size > 0) { munmap(const_cast<std::byte*>(_data), _size); }
+  }
+
+  static bee::OrError<ptr> open(const bee::FilePath& filename)
+  {
+    int fd = ::open(filename.to_string().data(), O_RDONLY);
+    if (fd < 0) {
+      return bee::Error::format(
+        "Failed to open '$': $", filename, strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      auto err = errno;
+      close(fd);
+      return bee::Error::format(
+        "Failed to stat '$': $", filename, strerror(err));
+    }
+
+    size_t size = st.st_size;
+    void* data = nullptr;
+    if (size > 0) {
+      data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    auto err = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+      return bee::Error::format(
+        "Failed to map '$': $", filename, strerror(err));
+    }
+
+    return make_shared<MappedFile>(
+      reinterpret_cast<const std::byte*>(data), size);
+  }
+
+  const std::byte* data() const { return _data; }
+  size_t size() const { return _size; }
+
+ private:
+  const std::byte* _data;
+  size_t _size;
+};
+
+// Serves lookups straight from the bytes of a binary PCP, nothing is parsed
+// when opening it. FENs are not stored, lookups by FEN go through the hash key
+// of the position.
+struct BinaryPCP final : public PCP {
+ public:
+  BinaryPCP(
+    std::shared_ptr<const void> storage,
+    const BinaryRecord* records,
+    size_t num_records,
+    const Move* pv_moves,
+    size_t num_pv_moves)
+      : _storage(std::move(storage)),
+        _records(records),
+        _num_records(num_records),
+        _pv_moves(pv_moves),
+        _num_pv_moves(num_pv_moves)
+  {}
+
+  virtual ~BinaryPCP() {}
+
+  virtual bee::OrError<optional<entry>> lookup_raw(const string& fen) override
+  {
+    Board board;
+    bail_unit(board.set_fen(fen));
+    auto record = _find(board.hash_key());
+    if (record == nullptr) { return nullopt; }
+
+    auto think_time = Span::of_millis(record->think_time_ms);
+    // Update times are not kept in the binary format
+    auto now = Time::now();
+    return entry{
+      .fen = fen,
+      .think_time = think_time,
+      .frequency = record->frequency,
+      .ply = record->ply,
+      .best_moves = {gr::MoveInfo{
+        .move = record->move,
+        .pv = _pv(*record),
+        .evaluation = Score::of_milli_pawns(record->eval_milli),
+        .depth = record->depth,
+        .think_time = think_time,
+      }},
+      .last_update = now,
+      .last_start = now,
+    };
+  }
+
+  virtual bee::OrError<unordered_map<string, entry>> read_all() override
+  {
+    return bee::Error("Binary PCP files don't keep the FENs of the entries");
+  }
+
+  virtual optional<PCPProbe> probe(uint64_t hash_key) const override
+  {
+    auto record = _find(hash_key);
+    if (record == nullptr) { return nullopt; }
+    return PCPProbe{
+      .eval = Score::of_milli_pawns(record->eval_milli),
+      .best_move = record->move,
+      .depth = record->depth,
+      .pv_handle = uint32_t(record - _records),
+    };
+  }
+
+  virtual vector<Move> probe_pv(const PCPProbe& probe) const override
+  {
+    return _pv(_records[probe.pv_handle]);
+  }
+
+  static bee::OrError<ptr> open(
+    std::shared_ptr<const void> storage, const std::byte* data, size_t size)
+  {
+    if (size < sizeof(BinaryHeader) || !has_binary_magic(data, size)) {
+      return bee::Error("Not a binary PCP file");
+    }
+    BinaryHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.version != binary_version) {
+      return bee::Error::format(
+        "Unsupported binary PCP version $, expected $",
+        header.version,
+        binary_version);
+    }
+    if (header.record_size != sizeof(BinaryRecord)) {
+      return bee::Error::format(
+        "Unexpected binary PCP record size $", header.record_size);
+    }
+    // The counts come from the file, check them against the bytes left before
+    // multiplying so a corrupted header can't wrap around to the file size
+    size_t remaining = size - sizeof(BinaryHeader);
+    if (
+      header.num_records > remaining / sizeof(BinaryRecord) ||
+      header.num_records > std::numeric_limits<uint32_t>::max()) {
+      return bee::Error::format(
+        "Binary PCP header has $ records, but the file has only $ bytes",
+        header.num_records,
+        size);
+    }
+    remaining -= header.num_records * sizeof(BinaryRecord);
+    if (header.num_pv_moves > remaining / sizeof(Move)) {
+      return bee::Error::format(
+        "Binary PCP header has $ PV moves, but the file has only $ bytes",
+        header.num_pv_moves,
+        size);
+    }
+    if (remaining != header.num_pv_moves * sizeof(Move)) {
+      return bee::Error::format(
+        "Binary PCP has $ bytes, expected $",
+        size,
+        size - remaining + header.num_pv_moves * sizeof(Move));
+    }
+
+    auto records =
+      reinterpret_cast<const BinaryRecord*>(data + sizeof(BinaryHeader));
+    auto pv_moves =
+      reinterpret_cast<const Move*>(records + header.num_records);
+    return make_shared<BinaryPCP>(
+      std::move(storage),
+      records,
+      header.num_records,
+      pv_moves,
+      header.num_pv_moves);
+  }
+
+  static bee::OrError<string> serialize(
+    const unordered_map<string, entry>& entries)
+  {
+    vector<std::pair<BinaryRecord, const gr::MoveInfo*>> records;
+    for (const auto& [fen, entry] : entries) {
+      if (entry.best_moves.empty()) { continue; }
+      Board board;
+      bail_unit(board.set_fen(fen));
+      const auto& best = entry.best_moves[0];
+      auto eval = best.evaluation.value_or(Score::zero());
+      records.emplace_back(
+        BinaryRecord{
+          .key = board.hash_key(),
+          .eval_milli = eval.to_milli_pawns(),
+          .pv_offset = 0,
+          .frequency = saturate_u32(entry.frequency),
+          .think_time_ms = saturate_u32(entry.think_time.to_millis()),
+          .depth = int16_t(best.depth.value_or(0)),
+          .ply = uint16_t(entry.ply),
+          .pv_length = uint8_t(std::min<size_t>(best.pv.size(), 255)),
+          .move = best.move,
+        },
+        &best);
+    }
+
+    // FENs that only differ in the move counters map to the same key, keep the
+    // most frequent
+    std::sort(records.begin(), records.end(), [](const auto& a, const auto& b) {
+      if (a.first.key != b.first.key) { return a.first.key < b.first.key; }
+      return a.first.frequency > b.first.frequency;
+    });
+    auto same_key = [](const auto& a, const auto& b) {
+      return a.first.key == b.first.key;
+    };
+    records.erase(
+      std::unique(records.begin(), records.end(), same_key), records.end());
+
+    vector<Move> pv_moves;
+    for (auto& [record, best] : records) {
+      if (pv_moves.size() > std::numeric_limits<uint32_t>::max()) {
+        return bee::Error("Too many PV moves for the binary PCP format");
+      }
+      record.pv_offset = pv_moves.size();
+      pv_moves.insert(
+        pv_moves.end(), best->pv.begin(), best->pv.begin() + record.pv_length);
+    }
+
+    BinaryHeader header{
+      .magic = {},
+      .version = binary_version,
+      .record_size = sizeof(BinaryRecord),
+      .num_records = records.size(),
+      .num_pv_moves = pv_moves.size(),
+    };
+    memcpy(header.magic, binary_magic, sizeof(binary_magic));
+
+    string output;
+    output.reserve(
+      sizeof(header) + records.size() * sizeof(BinaryRecord) +
+      pv_moves.size() * sizeof(Move));
+    auto append = [&](const void* data, size_t size) {
+      output.append(reinterpret_cast<const char*>(data), size);
+    };
+    append(&header, sizeof(header));
+    for (const auto& [record, _] : records) {
+      append(&record, sizeof(record));
+    }
+    append(pv_moves.data(), pv_moves.size() * sizeof(Move));
+    return output;
+  }
+
+ private:
+  const BinaryRecord* _find(uint64_t key) const
+  {
+    auto end = _records + _num_records;
+    auto it = std::lower_bound(
+      _records, end, key, [](const BinaryRecord& record, uint64_t key) {
+        return record.key < key;
+      });
+    if (it == end || it->key != key) { return nullptr; }
+    return it;
+  }
+
+  // Records are not validated when opening, a record whose PV falls outside
+  // of the PV section is served without a PV
+  vector<Move> _pv(const BinaryRecord& record) const
+  {
+    if (uint64_t(record.pv_offset) + record.pv_length > _num_pv_moves) {
+      return {};
+    }
+    auto begin = _pv_moves + record.pv_offset;
+    return vector<Move>(begin, begin + record.pv_length);
+  }
+
+  std::shared_ptr<const void> _storage;
+  const BinaryRecord* _records;
+  size_t _num_records;
+  const Move* _pv_moves;
+  size_t _num_pv_moves;
+};
+
+bee::OrError<optional<PCP::ptr>> maybe_open_binary(
+  const bee::FilePath& filename)
+{
+  bail(mapped, MappedFile::open(filename));
+  if (!has_binary_magic(mapped->data(), mapped->size())) { return nullopt; }
+  auto data = mapped->data();
+  auto size = mapped->size();
+  bail(pcp, BinaryPCP::open(std::move(mapped), data, size));
+  return pcp;
+}
+
 } // namespace
 
 PCP::~PCP() {}
 
 bee::OrError<PCP::ptr> PCP::open_on_disk(const bee::FilePath& filename)
 {
+  bail(binary, maybe_open_binary(filename));
+  if (binary.has_value()) { return std::move(*binary); }
   return DiskPCP::open(filename);
 }
 
 bee::OrError<PCP::ptr> PCP::open_in_memory(const bee::FilePath& filename)
 {
+  bail(binary, maybe_open_binary(filename));
+  if (binary.has_value()) { return std::move(*binary); }
   return MemoryPCP::open(filename);
 }
 
+bee::OrError<PCP::ptr> PCP::of_binary(string&& data)
+{
+  auto storage = make_shared<const string>(std::move(data));
+  auto bytes = reinterpret_cast<const std::byte*>(storage->data());
+  auto size = storage->size();
+  return BinaryPCP::open(std::move(storage), bytes, size);
+}
+
+bee::OrError<string> PCP::to_binary(const unordered_map<string, entry>& entries)
+{
+  return BinaryPCP::serialize(entries);
+}
+
 bee::OrError<optional<SearchResultInfo::ptr>> PCP::lookup(const string& fen)
 {
   bail(entry, lookup_raw(fen));
@@ -1,16 +1,31 @@
 #pragma once
 
 #include "generated_game_record.hpp"
+#include "move.hpp"
+#include "score.hpp"
 #include "search_result_info.hpp"
 
 #include "stone/stone_reader.hpp"
 
+#include <cstdint>
+#include <type_traits>
 #include <unordered_map>
 
 namespace blackbit {
 
 namespace gr = generated_game_record;
 
+// What the search needs from a PCP entry, cheap to copy around. The PV is only
+// materialized on demand through PCP::probe_pv.
+struct PCPProbe {
+  Score eval = Score::zero();
+  Move best_move = Move::invalid();
+  int16_t depth = 0;
+  uint32_t pv_handle = 0;
+};
+
+static_assert(std::is_trivially_copyable_v<PCPProbe>);
+
 struct PCP {
  public:
   using ptr = std::shared_ptr<PCP>;
@@ -27,10 +42,25 @@ struct PCP {
 
   virtual bee::OrError<std::unordered_map<std::string, entry>> read_all() = 0;
 
+  // Lookup by Board::hash_key(), meant to be used inside the search. Misses are
+  // rejected by a filter that takes a single cache line.
+  virtual std::optional<PCPProbe> probe(uint64_t hash_key) const = 0;
+
+  virtual std::vector<Move> probe_pv(const PCPProbe& probe) const = 0;
+
+  // Both detect files in the binary format, which are memory mapped instead
   static bee::OrError<ptr> open_on_disk(const bee::FilePath& filename);
 
   static bee::OrError<ptr> open_in_memory(const bee::FilePath& filename);
 
+  // Versioned binary format, with fixed size records sorted by
+  // Board::hash_key() followed by the PVs. It doesn't keep the FENs, so
+  // read_all() is not supported on it.
+  static bee::OrError<std::string> to_binary(
+    const std::unordered_map<std::string, entry>& entries);
+
+  static bee::OrError<ptr> of_binary(std::string&& data);
+
  private:
 };
 
@@ -2,18 +2,21 @@
 
 #include "board.hpp"
 #include "command/command_flags.hpp"
+#include "dyn_pcp.hpp"
 #include "engine.hpp"
 #include "eval.hpp"
 #include "generated_game_record.hpp"
+#include "parallel_map.hpp"
 #include "pcp.hpp"
 #include "rules.hpp"
+#include "transposition_table.hpp"
 
 #include "bee/file_reader.hpp"
+#include "bee/file_writer.hpp"
 #include "bee/filesystem.hpp"
 #include "bee/format_memory.hpp"
 #include "bee/format_vector.hpp"
 #include "bee/nref.hpp"
-#include "bee/ref.hpp"
 #include "bee/sort.hpp"
 #include "command/command_builder.hpp"
 #include "stone/stone_reader.hpp"
@@ -24,12 +27,11 @@
 #include <condition_variable>
 #include <csignal>
 #include <filesystem>
-#include <map>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <queue>
-#include <shared_mutex>
 #include <thread>
 #include <unistd.h>
 #include <unordered_map>
@@ -38,7 +40,6 @@ namespace fs = std::filesystem;
 
 using bee::FileSystem;
 using bee::print_line;
-using bee::ref;
 using bee::Span;
 using bee::Time;
 using std::make_shared;
@@ -56,83 +57,176 @@ using std::vector;
 namespace blackbit {
 namespace {
 
-struct GameTree {
- public:
-  struct GameTreeNode {
-   public:
-    GameTreeNode(const string& fen, int ply) : fen(fen), ply(ply) {}
-    const string fen;
-    std::set<string> next_fens;
-    int frequency = 0;
-    const int ply;
+// Path of a game through the positions it went by, computed from the game
+// alone so that games can be processed in parallel before being added to the
+// tree
+struct GamePath {
+  struct Step {
+    uint64_t key;
+    int ply;
   };
 
-  void add_game(const vector<Move>& moves)
+  // moves[i] goes from steps[i] to steps[i+1]. The last move might be missing
+  // when it ended the game.
+  vector<Step> steps;
+  vector<Move> moves;
+
+  static GamePath of_moves(const vector<Move>& moves)
   {
+    GamePath path;
     Board board;
     board.set_initial();
-    auto node = find_or_add(board);
-    for (Move m : moves) {
-      node->frequency++;
-      board.move(m);
-      if (Rules::is_game_over_slow(board)) { break; }
-      node->next_fens.insert(board.to_fen());
-      node = find_or_add(board);
+    path.steps.push_back({board.hash_key(), board.ply()});
+    for (int i = 0; i < std::ssize(moves); i++) {
+      board.move(moves[i]);
+      // A move was played from every position but the last one, so only the
+      // last one can be mate or stalemate
+      bool game_over = i + 1 == std::ssize(moves)
+                         ? Rules::is_game_over_slow(board)
+                         : Rules::is_draw_without_stalemate(board);
+      path.moves.push_back(moves[i]);
+      if (game_over) { break; }
+      path.steps.push_back({board.hash_key(), board.ply()});
     }
+    return path;
   }
+};
 
-  const std::map<string, GameTreeNode> nodes() const { return _nodes; }
+// Tree, really a DAG, of the positions reached in a set of games. Nodes are
+// keyed by Board::hash_key() in an open addressing table. FENs are not kept,
+// they are computed by replaying the games only for the positions that are
+// needed.
+struct GameTree {
+ public:
+  struct Edge {
+    Move move;
+    uint32_t child;
+  };
 
- private:
-  ref<GameTreeNode> find_or_add(const Board& board)
+  struct Node {
+    uint64_t key;
+    int frequency = 0;
+    int ply;
+    vector<Edge> children;
+  };
+
+  GameTree() : _slots(initial_slots, empty_slot) {}
+
+  void add_path(const GamePath& path)
   {
-    auto fen = board.to_fen();
-    auto it = _nodes.find(board.to_fen());
-    if (it == _nodes.end()) {
-      it = _nodes.emplace(fen, GameTreeNode(fen, board.ply())).first;
+    uint32_t node = _find_or_add(path.steps[0]);
+    for (int i = 0; i < std::ssize(path.moves); i++) {
+      _nodes[node].frequency++;
+      if (i + 1 >= std::ssize(path.steps)) { break; }
+      uint32_t child = _find_or_add(path.steps[i + 1]);
+      _add_edge(node, path.moves[i], child);
+      node = child;
     }
-    return it->second;
   }
-  std::map<string, GameTreeNode> _nodes;
-};
 
-struct DynPCP final : public PCP {
- public:
-  using ptr = shared_ptr<DynPCP>;
-
-  virtual ~DynPCP() {}
+  const vector<Node>& nodes() const { return _nodes; }
 
-  virtual bee::OrError<std::optional<entry>> lookup_raw(const std::string& fen)
+  // Replays the tree from the initial position, calling f(node_idx, board) on
+  // every node reachable from it. Children are visited in the order of their
+  // moves, so the board each node is seen with doesn't depend on the order the
+  // games were added.
+  template <class F> void for_each_position(F&& f)
   {
-    std::shared_lock l(_lock);
-    auto it = _positions.find(fen);
-    if (it == _positions.end()) { return nullopt; }
-    return it->second;
+    if (_nodes.empty()) { return; }
+    for (auto& node : _nodes) {
+      std::sort(
+        node.children.begin(), node.children.end(), [](Edge a, Edge b) {
+          return a.move < b.move ||
+                 (a.move == b.move && a.move.promotion() < b.move.promotion());
+        });
+    }
+
+    struct Frame {
+      uint32_t idx;
+      int next_child;
+      Move move;
+      MoveInfo info;
+    };
+
+    vector<bool> visited(_nodes.size(), false);
+    vector<Frame> stack;
+    Board board;
+    board.set_initial();
+    visited[0] = true;
+    f(0, std::as_const(board));
+    stack.push_back({0, 0, Move::invalid(), MoveInfo()});
+    while (!stack.empty()) {
+      auto& frame = stack.back();
+      const auto& children = _nodes[frame.idx].children;
+      if (frame.next_child == std::ssize(children)) {
+        if (stack.size() > 1) { board.undo(frame.move, frame.info); }
+        stack.pop_back();
+        continue;
+      }
+      const auto& edge = children[frame.next_child++];
+      if (visited[edge.child]) { continue; }
+      visited[edge.child] = true;
+      auto info = board.move(edge.move);
+      f(edge.child, std::as_const(board));
+      stack.push_back({edge.child, 0, edge.move, info});
+    }
   }
 
-  virtual bee::OrError<std::unordered_map<std::string, entry>> read_all()
+ private:
+  static constexpr uint32_t empty_slot = std::numeric_limits<uint32_t>::max();
+  static constexpr size_t initial_slots = 1 << 16;
+
+  uint32_t _find_or_add(const GamePath::Step& step)
   {
-    std::shared_lock l(_lock);
-    return _positions;
+    uint64_t mask = _slots.size() - 1;
+    uint64_t slot = step.key & mask;
+    while (_slots[slot] != empty_slot) {
+      auto& node = _nodes[_slots[slot]];
+      if (node.key == step.key) {
+        node.ply = std::min(node.ply, step.ply);
+        return _slots[slot];
+      }
+      slot = (slot + 1) & mask;
+    }
+    uint32_t idx = _nodes.size();
+    _nodes.push_back(Node{.key = step.key, .ply = step.ply});
+    _slots[slot] = idx;
+    if (_nodes.size() * 2 > _slots.size()) { _grow(); }
+    return idx;
   }
 
-  void update(const string& fen, const entry& e)
+  void _grow()
   {
-    std::unique_lock l(_lock);
-    _positions.insert_or_assign(fen, e);
+    vector<uint32_t> slots(_slots.size() * 2, empty_slot);
+    uint64_t mask = slots.size() - 1;
+    for (uint32_t idx = 0; idx < _nodes.size(); idx++) {
+      uint64_t slot = _nodes[idx].key & mask;
+      while (slots[slot] != empty_slot) { slot = (slot + 1) & mask; }
+      slots[slot] = idx;
+    }
+    _slots = std::move(slots);
   }
 
- private:
-  unordered_map<string, entry> _positions;
+  void _add_edge(uint32_t parent, Move move, uint32_t child)
+  {
+    auto& children = _nodes[parent].children;
+    for (const auto& edge : children) {
+      if (edge.child == child) { return; }
+    }
+    children.push_back({move, child});
+  }
 
-  std::shared_mutex _lock;
+  vector<Node> _nodes;
+  vector<uint32_t> _slots;
 };
 
 struct PositionState {
  public:
   using ptr = shared_ptr<PositionState>;
 
-  explicit PositionState(const gr::PCPEntry& entry) : _entry(entry) {}
+  explicit PositionState(const gr::PCPEntry& entry)
+      : _entry(entry), _white_to_move(is_white_to_move(entry.fen))
+  {}
 
   bool has_higher_priority_than(
     const ptr& other, Span initial_thinking_time) const
@@ -165,7 +259,12 @@ struct PositionState {
     _entry.last_start = start_time;
   }
 
-  void add_next(const ptr& state) { _next_states.insert(state); }
+  void add_next(Move move, const ptr& state)
+  {
+    if (_next_states.insert(state).second) {
+      _next_moves.emplace_back(move, state);
+    }
+  }
   void add_prev(const ptr& state) { _prev_states.insert(state); }
 
   const std::set<ptr> next_states() const { return _next_states; }
@@ -187,6 +286,10 @@ struct PositionState {
 
   bool is_busy() const { return _is_busy; }
   void set_is_busy(bool value) { _is_busy = value; }
+
+  // Size of the entry as it was last written to the table
+  size_t serialized_size() const { return _serialized_size; }
+  void set_serialized_size(size_t value) { _serialized_size = value; }
   Span think_time() const { return _entry.think_time; }
 
   bool can_enqueue() const
@@ -211,7 +314,69 @@ struct PositionState {
 
   const std::set<ptr>& prev_states() const { return _prev_states; }
 
+  // Value of the position backed up from the positions after it, negamax style
+  // with white perspective scores. The moves this position's own search found
+  // are valued by the position they lead to when that position has a value,
+  // and any other position after this one with a value is also considered, as
+  // it may have been searched deeper than this position was. Returns whether
+  // the value changed.
+  bool update_backed_value()
+  {
+    optional<Score> value;
+    auto consider = [&](Score score) {
+      if (
+        !value.has_value() ||
+        (_white_to_move ? score > *value : score < *value)) {
+        value = score;
+      }
+    };
+    for (const auto& m : _entry.best_moves) {
+      if (!m.evaluation.has_value()) { continue; }
+      auto next = _next_of_move(m.move);
+      if (next != nullptr && next->_backed_value.has_value()) {
+        consider(*next->_backed_value);
+      } else {
+        consider(*m.evaluation);
+      }
+    }
+    for (const auto& [_, next] : _next_moves) {
+      if (next->_backed_value.has_value()) { consider(*next->_backed_value); }
+    }
+    bool changed = value != _backed_value;
+    _backed_value = value;
+    return changed;
+  }
+
+  optional<Score> backed_value() const { return _backed_value; }
+
+  // Whether the value this position's own search found is too far from the
+  // value backed up from the positions after it
+  bool is_unstable(Score margin) const
+  {
+    if (_entry.best_moves.empty() || !_backed_value.has_value()) {
+      return false;
+    }
+    const auto& eval = _entry.best_moves[0].evaluation;
+    if (!eval.has_value()) { return false; }
+    return (*eval - *_backed_value).abs() > margin;
+  }
+
  private:
+  static bool is_white_to_move(const string& fen)
+  {
+    auto space = fen.find(' ');
+    return space == string::npos || space + 1 >= fen.size() ||
+           fen[space + 1] != 'b';
+  }
+
+  ptr _next_of_move(Move move) const
+  {
+    for (const auto& [m, next] : _next_moves) {
+      if (m == move) { return next; }
+    }
+    return nullptr;
+  }
+
   bool _need_to_redo() const
   {
     for (const auto& next : _next_states) {
@@ -226,10 +391,15 @@ struct PositionState {
 
   gr::PCPEntry _entry;
   std::set<ptr> _next_states;
+  vector<pair<Move, ptr>> _next_moves;
   std::set<ptr> _prev_states;
   Span _next_think_time = Span::zero();
 
+  const bool _white_to_move;
+  optional<Score> _backed_value;
+
   bool _is_busy = false;
+  size_t _serialized_size = 0;
 };
 
 volatile std::atomic<int> sigint_received = 0;
@@ -285,6 +455,361 @@ struct StateQueue {
   std::priority_queue<std::pair<StatePriority, PositionState::ptr>> _queue;
 };
 
+// Several queues, each with its own lock, so that workers taking work don't
+// wait on each other. States are spread over the shards in turn and each
+// worker starts looking at a different shard, so the order across shards is
+// only roughly by priority.
+struct ShardedStateQueue {
+ public:
+  explicit ShardedStateQueue(int num_shards) : _shards(num_shards) {}
+
+  void push(Span next_think_time, const PositionState::ptr& state)
+  {
+    auto& shard = _shards[_next_push.fetch_add(1) % _shards.size()];
+    auto l = unique_lock(shard.lock);
+    shard.queue.push(next_think_time, state);
+    _size++;
+  }
+
+  optional<pair<Span, PositionState::ptr>> pop(int first_shard)
+  {
+    for (size_t i = 0; i < _shards.size(); i++) {
+      auto& shard = _shards[(first_shard + i) % _shards.size()];
+      auto l = unique_lock(shard.lock);
+      if (shard.queue.empty()) { continue; }
+      _size--;
+      return shard.queue.pop();
+    }
+    return nullopt;
+  }
+
+  bool empty() const { return _size.load() == 0; }
+
+  int size() const { return _size.load(); }
+
+ private:
+  struct Shard {
+    mutex lock;
+    StateQueue queue;
+  };
+
+  vector<Shard> _shards;
+  std::atomic<size_t> _next_push = 0;
+  std::atomic<int> _size = 0;
+};
+
+// Results are appended to a journal as soon as they are ready, so that they
+// survive a crash or a SIGINT before the next save. The journal is split in
+// segments, a new one is started on every compaction, and the segments are
+// deleted once the table written by that compaction contains them.
+//
+// Each line is a serialized PCPEntry, a later line for the same position
+// replaces an earlier one. A crash can leave the last line partially written.
+bee::FilePath journal_segment_path(const bee::FilePath& pcp_file, int segment)
+{
+  return pcp_file + (".journal." + std::to_string(segment));
+}
+
+// Segments of the journal that exist on disk, oldest first
+bee::OrError<vector<int>> journal_segments(const bee::FilePath& pcp_file)
+{
+  auto path = pcp_file.to_std_path();
+  auto dir = path.parent_path();
+  if (dir.empty()) { dir = "."; }
+  auto prefix = path.filename().string() + ".journal.";
+
+  vector<int> segments;
+  std::error_code ec;
+  for (const auto& file : fs::directory_iterator(dir, ec)) {
+    auto name = file.path().filename().string();
+    if (!name.starts_with(prefix)) { continue; }
+    auto suffix = name.substr(prefix.size());
+    if (
+      suffix.empty() ||
+      !std::all_of(suffix.begin(), suffix.end(), [](char c) {
+        return c >= '0' && c <= '9';
+      })) {
+      continue;
+    }
+    segments.push_back(std::stoi(suffix));
+  }
+  if (ec) {
+    return bee::Error::format(
+      "Failed to list journal segments: $", ec.message());
+  }
+  std::sort(segments.begin(), segments.end());
+  return segments;
+}
+
+struct JournalWriter {
+ public:
+  explicit JournalWriter(const bee::FilePath& pcp_file) : _pcp_file(pcp_file)
+  {}
+
+  bee::OrError<bee::Unit> open(int segment)
+  {
+    auto l = unique_lock(_mutex);
+    return _open(segment);
+  }
+
+  bee::OrError<bee::Unit> append(const string& serialized_entry)
+  {
+    auto l = unique_lock(_mutex);
+    bail_unit(_writer->write(serialized_entry + "\n"));
+    _bytes += serialized_entry.size() + 1;
+    return _writer->flush();
+  }
+
+  // Starts a new segment, returns the one that was closed. On error the
+  // current segment stays open.
+  bee::OrError<int> rotate()
+  {
+    auto l = unique_lock(_mutex);
+    int closed = _segment;
+    bail_unit(_open(closed + 1));
+    _bytes = 0;
+    return closed;
+  }
+
+  // Bytes appended since the last rotation
+  size_t bytes() const
+  {
+    auto l = unique_lock(_mutex);
+    return _bytes;
+  }
+
+ private:
+  bee::OrError<bee::Unit> _open(int segment)
+  {
+    bail(
+      writer,
+      bee::FileWriter::create(journal_segment_path(_pcp_file, segment)));
+    _writer = std::move(writer);
+    _segment = segment;
+    return bee::ok();
+  }
+
+  const bee::FilePath _pcp_file;
+
+  // The workers append without holding the lock of the WorkManager
+  mutable mutex _mutex;
+  int _segment = 0;
+  size_t _bytes = 0;
+  bee::FileWriter::ptr _writer;
+};
+
+// Applies the results in the journal left by a previous run on top of the
+// entries read from the table. Returns the last segment found.
+//
+// Only the last line of the newest segment can be incomplete, it's the one
+// that was being written when the previous run stopped. It is cut from the
+// file, so that it doesn't end up in the middle of the journal once this run
+// adds segments after it. Anything else that doesn't parse is an error.
+bee::OrError<int> replay_journal(
+  const bee::FilePath& pcp_file,
+  unordered_map<string, PositionState::ptr>& existing_pcp)
+{
+  bail(segments, journal_segments(pcp_file));
+  int replayed = 0;
+  for (int segment : segments) {
+    auto path = journal_segment_path(pcp_file, segment);
+    bail(content, bee::FileReader::read_file(path));
+    size_t begin = 0;
+    while (begin < content.size()) {
+      auto end = content.find('\n', begin);
+      if (end == string::npos) {
+        if (segment != segments.back()) {
+          return bee::Error::format(
+            "Journal segment $ ends with an incomplete line", path.to_string());
+        }
+        print_line("Dropping incomplete journal line in $", path.to_string());
+        std::error_code ec;
+        fs::resize_file(path.to_std_path(), begin, ec);
+        if (ec) {
+          return bee::Error::format(
+            "Failed to truncate journal segment $: $",
+            path.to_string(),
+            ec.message());
+        }
+        break;
+      }
+      auto line = content.substr(begin, end - begin);
+      begin = end + 1;
+      if (line.empty()) { continue; }
+      auto entry = yasf::Cof::deserialize<gr::PCPEntry>(line);
+      if (entry.is_error()) {
+        return bee::Error::format(
+          "Bad line in journal segment $: $", path.to_string(), entry.error());
+      }
+      existing_pcp.insert_or_assign(
+        entry->fen, make_shared<PositionState>(*entry));
+      replayed++;
+    }
+  }
+  if (!segments.empty()) {
+    print_line(
+      "Replayed $ results from $ journal segments", replayed, segments.size());
+  }
+  return segments.empty() ? -1 : segments.back();
+}
+
+// Writes the table to disk from a background thread. The thread keeps its own
+// copy of the table and is only handed the entries that changed since the last
+// save, so taking a snapshot costs nothing to the workers no matter how big
+// the table is. Once the table is written, the journal segments it covers are
+// deleted.
+struct Checkpointer {
+ public:
+  explicit Checkpointer(const bee::FilePath& pcp_file)
+      : _pcp_file(pcp_file), _thread([this]() { _run(); })
+  {}
+
+  ~Checkpointer()
+  {
+    {
+      auto l = unique_lock(_mutex);
+      _stop = true;
+    }
+    _cond.notify_all();
+    _thread.join();
+  }
+
+  // The table written will contain everything in the journal up to
+  // last_journal_segment
+  void save_async(
+    unordered_map<string, string>&& changes, int last_journal_segment)
+  {
+    {
+      auto l = unique_lock(_mutex);
+      _merge(_pending, std::move(changes));
+      _pending_journal_segment =
+        std::max(_pending_journal_segment, last_journal_segment);
+      _requested++;
+    }
+    _cond.notify_all();
+  }
+
+  // Waits for the save to be written, returns the error of the last save, if
+  // any
+  bee::OrError<bee::Unit> save(
+    unordered_map<string, string>&& changes, int last_journal_segment)
+  {
+    save_async(std::move(changes), last_journal_segment);
+    auto l = unique_lock(_mutex);
+    auto requested = _requested;
+    _cond.wait(l, [&]() { return _completed >= requested; });
+    if (_last_error.has_value()) { return *_last_error; }
+    return bee::ok();
+  }
+
+ private:
+  static void _merge(
+    unordered_map<string, string>& into, unordered_map<string, string>&& from)
+  {
+    if (into.empty()) {
+      into = std::move(from);
+      return;
+    }
+    for (auto& [fen, data] : from) {
+      into.insert_or_assign(fen, std::move(data));
+    }
+  }
+
+  void _run()
+  {
+    auto l = unique_lock(_mutex);
+    while (true) {
+      _cond.wait(l, [&]() { return _stop || _completed < _requested; });
+      if (_completed >= _requested) { return; }
+      auto requested = _requested;
+      auto changes = std::move(_pending);
+      _pending.clear();
+      int journal_segment = _pending_journal_segment;
+      l.unlock();
+
+      _apply(std::move(changes));
+      auto result = _write();
+      if (result.is_error()) {
+        print_line("Failed to save opening table: $", result.error());
+      } else {
+        _remove_journal_segments(journal_segment);
+      }
+
+      l.lock();
+      _last_error = nullopt;
+      if (result.is_error()) { _last_error = result.error(); }
+      _completed = requested;
+      _cond.notify_all();
+    }
+  }
+
+  void _apply(unordered_map<string, string>&& changes)
+  {
+    for (auto& [fen, data] : changes) {
+      auto [it, inserted] = _index.emplace(fen, _table.size());
+      if (inserted) {
+        _table.emplace_back(fen, std::move(data));
+      } else {
+        _table[it->second].second = std::move(data);
+      }
+    }
+  }
+
+  bee::OrError<bee::Unit> _write()
+  {
+    auto start = Time::monotonic();
+    auto tmp_file = _pcp_file + ".tmp";
+    bail_unit(stone::StoneWriter::write(tmp_file, _table));
+    std::error_code ec;
+    fs::rename(tmp_file.to_std_path(), _pcp_file.to_std_path(), ec);
+    if (ec) {
+      return bee::Error::format(
+        "Failed to rename $ to $: $",
+        tmp_file.to_string(),
+        _pcp_file.to_string(),
+        ec.message());
+    }
+    print_line(
+      "Wrote opening table of size: $, Took: $",
+      _table.size(),
+      Time::monotonic() - start);
+    return bee::ok();
+  }
+
+  void _remove_journal_segments(int up_to)
+  {
+    auto segments = journal_segments(_pcp_file);
+    if (segments.is_error()) {
+      print_line("$", segments.error());
+      return;
+    }
+    for (int segment : *segments) {
+      if (segment > up_to) { break; }
+      std::error_code ec;
+      fs::remove(journal_segment_path(_pcp_file, segment).to_std_path(), ec);
+    }
+  }
+
+  const bee::FilePath _pcp_file;
+
+  // Only touched by the background thread. The table is kept in the form the
+  // writer takes, so that it is written without being copied, with an index
+  // from the fen to its position in it.
+  vector<pair<string, string>> _table;
+  unordered_map<string, size_t> _index;
+
+  mutex _mutex;
+  std::condition_variable _cond;
+  unordered_map<string, string> _pending;
+  int _pending_journal_segment = -1;
+  int _requested = 0;
+  int _completed = 0;
+  optional<bee::Error> _last_error;
+  bool _stop = false;
+
+  thread _thread;
+};
+
 struct WorkManager {
  public:
   WorkManager(
@@ -292,50 +817,81 @@ struct WorkManager {
     int max_ply,
     Span max_think_time,
     const bee::FilePath& pcp_file,
-    const Span save_table_every,
+    double compact_journal_ratio,
     const Span initial_think_time,
     const optional<int>& max_tasks,
-    const optional<Span>& max_total_time)
+    const optional<Span>& max_total_time,
+    const optional<Score>& backup_margin,
+    int num_workers,
+    int last_journal_segment)
       : _min_frequency(min_frequency),
         _max_ply(max_ply),
         _max_think_time(max_think_time),
         _initial_think_time(initial_think_time),
-        _pcp_file(pcp_file),
-        _save_table_every(save_table_every),
+        _compact_journal_ratio(compact_journal_ratio),
+        _queue(num_workers),
         _pcp(make_shared<DynPCP>()),
+        _journal(pcp_file),
+        _checkpointer(pcp_file),
         _start(Time::monotonic()),
-        _last_save(Time::monotonic()),
+        _last_progress(Time::monotonic()),
         _max_tasks(max_tasks),
-        _max_total_time(max_total_time)
-  {}
+        _max_total_time(max_total_time),
+        _backup_margin(backup_margin)
+  {
+    must_unit(_journal.open(last_journal_segment + 1));
+  }
 
   void add_state(const PositionState::ptr& state)
   {
     auto l = unique_lock(_mutex);
-    _update(state->entry());
+    _update(state, state->entry(), yasf::Cof::serialize(state->entry()));
     _maybe_enqueue(state);
   }
 
+  // The entry is serialized and appended to the journal without holding the
+  // lock, so that the workers don't wait on each other's writes. It is added
+  // to the changes before it is appended, so a save never removes a journal
+  // segment with a result the save doesn't have. The state stays busy until
+  // it's in the journal, so the results of a position are appended in order.
   void finish_state(
     const PositionState::ptr& state,
     Span think_time,
     Time start_time,
     vector<gr::MoveInfo>&& best_moves)
   {
+    gr::PCPEntry entry;
+    {
+      auto l = unique_lock(_mutex);
+      state->update_result(think_time, start_time, std::move(best_moves));
+      entry = state->entry();
+    }
+    auto serialized = yasf::Cof::serialize(entry);
+    {
+      auto l = unique_lock(_mutex);
+      _update(state, entry, string(serialized));
+    }
+    auto appended = _journal.append(serialized);
+    if (appended.is_error()) {
+      print_line("Failed to append to journal: $", appended.error());
+    }
+
     auto l = unique_lock(_mutex);
-    state->update_result(think_time, start_time, std::move(best_moves));
     state->set_is_busy(false);
     _num_busy--;
-    _update(state->entry());
-    _cond.notify_one();
-    for (auto& prev : state->prev_states()) { _maybe_enqueue(prev); }
+    _finished++;
+    _cond.notify_all();
+    if (_backup_margin.has_value()) {
+      _propagate_backed_value(state);
+    } else {
+      for (auto& prev : state->prev_states()) { _maybe_enqueue(prev); }
+    }
     _maybe_enqueue(state);
   }
 
-  optional<std::pair<Span, PositionState::ptr>> dequeue()
+  optional<std::pair<Span, PositionState::ptr>> dequeue(int worker_id)
   {
-    auto l = unique_lock(_mutex);
-    if (_max_tasks.has_value() && _dequeues >= *_max_tasks) {
+    if (_max_tasks.has_value() && _dequeues.fetch_add(1) >= *_max_tasks) {
       print_line("Reached maximum number of tasks");
       return nullopt;
     }
@@ -346,36 +902,20 @@ struct WorkManager {
         return nullopt;
       }
     }
-    must_unit(_maybe_save_table_no_lock());
+    _maybe_compact_and_report();
 
     while (true) {
       if (sigint_received.load() > 0) { return nullopt; }
-      if (!_queue.empty()) { break; }
+      if (auto next = _queue.pop(worker_id)) { return next; }
 
+      auto l = unique_lock(_mutex);
+      if (!_queue.empty()) { continue; }
       if (_num_busy == 0) { return std::nullopt; }
       using namespace std::chrono_literals;
       _cond.wait_for(l, 10s);
     }
-
-    auto [think_time, state] = _queue.pop();
-    _dequeues++;
-
-    auto& entry = state->entry();
-    print_line(
-      "f:$ p:$ t:$ q:$ d:$",
-      entry.frequency,
-      entry.ply,
-      think_time,
-      _queue.size(),
-      _dequeues);
-
-    return make_pair(think_time, state);
   }
 
-  int size() const { return std::ssize(_queue); }
-
-  int dequeues() const { return _dequeues; }
-
   bool is_done() const
   {
     auto l = unique_lock(_mutex);
@@ -385,7 +925,12 @@ struct WorkManager {
   bee::OrError<bee::Unit> save_table()
   {
     auto l = unique_lock(_mutex);
-    return _save_table_no_lock();
+    bail(journal_segment, _journal.rotate());
+    auto changes = std::move(_changed);
+    _changed.clear();
+    l.unlock();
+    _print_progress();
+    return _checkpointer.save(std::move(changes), journal_segment);
   }
 
   PCP::ptr pcp() const { return _pcp; }
@@ -395,8 +940,20 @@ struct WorkManager {
   {
     auto think_time = state->next_think_time(_initial_think_time);
     auto& entry = state->entry();
+    if (_backup_margin.has_value()) {
+      // Only positions that were never searched for long enough, or whose
+      // search disagrees with the positions after them, are worth more time
+      if (state->is_busy()) { return; }
+      bool under_explored = state->think_time() < _initial_think_time;
+      if (!under_explored && !state->is_unstable(*_backup_margin)) {
+        _skipped_stable++;
+        return;
+      }
+    } else if (!state->can_enqueue()) {
+      return;
+    }
     if (
-      state->can_enqueue() && think_time < _max_think_time &&
+      think_time < _max_think_time &&
       entry.ply <= _max_ply && entry.frequency >= _min_frequency) {
       _queue.push(think_time, state);
       state->set_is_busy(true);
@@ -404,34 +961,89 @@ struct WorkManager {
     }
   }
 
-  bee::OrError<bee::Unit> _save_table_no_lock()
+  // Walks up the tree from a position that was just searched, updating the
+  // backed up values that depend on it. Transpositions can make the tree have
+  // cycles, so each position is visited at most once.
+  void _propagate_backed_value(const PositionState::ptr& state)
   {
-    auto start = Time::monotonic();
-    auto tmp_file = _pcp_file + ".tmp";
-    vector<pair<string, string>> data(_positions.begin(), _positions.end());
-    bail_unit(stone::StoneWriter::write(tmp_file, data));
-    fs::rename(tmp_file.to_std_path(), _pcp_file.to_std_path());
+    std::set<PositionState::ptr> visited{state};
+    vector<PositionState::ptr> pending{state};
+    while (!pending.empty()) {
+      auto current = std::move(pending.back());
+      pending.pop_back();
+      if (!current->update_backed_value()) { continue; }
+      for (const auto& prev : current->prev_states()) {
+        if (visited.insert(prev).second) { pending.push_back(prev); }
+      }
+      if (current != state) { _maybe_enqueue(current); }
+    }
+  }
+
+  double _positions_per_hour_no_lock() const
+  {
+    auto hours = (Time::monotonic() - _start).to_float_seconds() / 3600.0;
+    return hours > 0 ? _finished / hours : 0.0;
+  }
+
+  void _print_progress()
+  {
+    auto l = unique_lock(_mutex);
     print_line(
-      "Wrote opening table of size: $, Took: $",
-      data.size(),
-      Time::monotonic() - start);
-    return bee::ok();
+      "queue:$ busy:$ finished:$ pos/h:$",
+      _queue.size(),
+      _num_busy,
+      _finished,
+      _positions_per_hour_no_lock());
+    if (_backup_margin.has_value()) {
+      print_line("Stable positions skipped: $", _skipped_stable);
+    }
   }
 
-  bee::OrError<bee::Unit> _maybe_save_table_no_lock()
+  // Rewriting the table costs as much as the table is big, so it is only done
+  // once the journal has grown to a fraction of the table. That keeps the
+  // writes per result constant however big the table gets, and bounds the
+  // journal that has to be replayed after a crash.
+  //
+  // The changes are handed to the checkpointer, the workers never wait for
+  // the table to be written. They are handed over with the lock held, so that
+  // the checkpointer gets the journal segments in order.
+  void _maybe_compact_and_report()
   {
     auto now = Time::monotonic();
-    if (_last_save + _save_table_every < now) {
-      _last_save = now;
-      return _save_table_no_lock();
+    bool report = false;
+    {
+      auto l = unique_lock(_mutex);
+      if (_journal.bytes() >= _table_bytes * _compact_journal_ratio) {
+        auto journal_segment = _journal.rotate();
+        if (journal_segment.is_error()) {
+          // The changes stay pending until the next compaction
+          print_line(
+            "Failed to rotate journal, skipping compaction: $",
+            journal_segment.error());
+        } else {
+          _checkpointer.save_async(std::move(_changed), *journal_segment);
+          _changed.clear();
+        }
+        report = true;
+      }
+      if (_last_progress + _progress_every < now) {
+        _last_progress = now;
+        report = true;
+      }
     }
-    return bee::ok();
+    if (report) { _print_progress(); }
   };
 
-  void _update(const gr::PCPEntry& entry)
+  void _update(
+    const PositionState::ptr& state,
+    const gr::PCPEntry& entry,
+    string&& serialized)
   {
+    _table_bytes += serialized.size();
+    _table_bytes -= state->serialized_size();
+    state->set_serialized_size(serialized.size());
     _pcp->update(entry.fen, entry);
-    _positions.insert_or_assign(entry.fen, yasf::Cof::serialize(entry));
+    _changed.insert_or_assign(entry.fen, std::move(serialized));
   }
 
   // fields
@@ -439,28 +1051,44 @@ struct WorkManager {
   const int _max_ply;
   const Span _max_think_time;
   const Span _initial_think_time;
-  const bee::FilePath _pcp_file;
 
-  const Span _save_table_every;
+  const double _compact_journal_ratio;
+  const Span _progress_every = Span::of_seconds(10);
 
+  // Guards the states, the queue has its own locks
   mutable mutex _mutex;
   std::condition_variable _cond;
 
-  StateQueue _queue;
+  ShardedStateQueue _queue;
 
   DynPCP::ptr _pcp;
 
-  unordered_map<string, string> _positions;
+  // Entries that changed since the last save
+  unordered_map<string, string> _changed;
+
+  // Serialized size of the table, the journal is compacted into it once it
+  // grows past a fraction of this
+  size_t _table_bytes = 0;
+
+  JournalWriter _journal;
+
+  Checkpointer _checkpointer;
 
   const Time _start;
-  Time _last_save;
+  Time _last_progress;
 
   std::optional<int> _max_tasks;
 
   std::optional<Span> _max_total_time;
 
-  int _dequeues = 0;
+  // When set, values are backed up through the tree and only positions that
+  // differ from their backed up value by more than this are searched again
+  const std::optional<Score> _backup_margin;
+
+  std::atomic<int> _dequeues = 0;
+  int _finished = 0;
   int _num_busy = 0;
+  int _skipped_stable = 0;
 };
 
 void handle_sigint(int)
@@ -478,25 +1106,43 @@ void handle_sigint(int)
   }
 }
 
-void run_worker(shared_ptr<WorkManager> queue)
+void run_worker(
+  shared_ptr<WorkManager> queue,
+  shared_ptr<TranspositionTable> hash_table,
+  int worker_id)
 {
-  auto engine = Engine::create(
+  // All the workers share the table, positions next to each other in the pcp
+  // tree reuse each other's subtrees
+  auto engine = Engine::create_with_shared_table(
     Experiment::base(),
     EvalParameters::default_params(),
     queue->pcp(),
-    1ull << 32,
+    hash_table,
     true);
 
   Board board;
-  while (auto next = queue->dequeue()) {
+  while (auto next = queue->dequeue(worker_id)) {
     auto start_time = Time::now();
     auto [think_time, state] = *next;
     auto& entry = state->entry();
 
     board.set_fen(entry.fen);
 
-    auto result =
-      engine->find_best_moves_mpv_sp(board, 100, 4, think_time, [](auto&&) {});
+    // Continue from where the previous analysis of this position stopped
+    optional<SearchResume> resume;
+    int completed_depth = 0;
+    if (!entry.best_moves.empty()) {
+      completed_depth = entry.best_moves[0].depth.value_or(0);
+      resume = SearchResume{.completed_depth = completed_depth, .pvs = {}};
+      for (const auto& m : entry.best_moves) { resume->pvs.push_back(m.pv); }
+    }
+
+    auto result = engine->find_best_moves_mpv_sp(
+      board,
+      {.depth = 100, .time = think_time},
+      4,
+      [](auto&&) {},
+      std::move(resume));
 
     if (result.is_error()) { continue; }
 
@@ -512,63 +1158,146 @@ void run_worker(shared_ptr<WorkManager> queue)
       });
     }
 
+    if (best_moves.empty()) {
+      // Not even the first depth after the resumed one was completed, the
+      // previous result is still the best we have
+      best_moves = entry.best_moves;
+    } else {
+      auto& best = best_moves[0];
+      int depths = *best.depth - completed_depth;
+      print_line(
+        "resumed_depth:$ depth:$ time:$ time_per_depth:$",
+        completed_depth,
+        *best.depth,
+        *best.think_time,
+        depths > 0 ? *best.think_time / depths : *best.think_time);
+    }
+
     queue->finish_state(state, think_time, start_time, std::move(best_moves));
   }
 }
 
-bee::OrError<bee::Unit> read_games(
-  unordered_map<string, PositionState::ptr>& existing_pcp,
-  const string& games_filename)
+bee::OrError<vector<GamePath>> parse_games(const vector<string>& lines)
+{
+  vector<GamePath> paths;
+  for (const auto& line : lines) {
+    bail(game, yasf::Cof::deserialize<gr::Game>(line));
+    vector<Move> moves;
+    for (auto& m : game.moves) { moves.push_back(m.move); }
+    paths.push_back(GamePath::of_moves(moves));
+  }
+  return paths;
+}
+
+bee::OrError<GameTree> read_game_tree(
+  const string& games_filename, int num_workers)
 {
-  bee::print_line("Reading games...");
   bail(
     games_file,
     bee::FileReader::open(bee::FilePath::of_string(games_filename)));
+
+  // Games are parsed and replayed in parallel, a batch at a time to bound the
+  // memory used, then added to the tree by this thread
+  constexpr int lines_per_task = 256;
+  const int tasks_per_batch = num_workers * 8;
+
   GameTree game_tree;
   int count_games = 0;
   while (!games_file->is_eof()) {
-    bail(line, games_file->read_line());
-    bail(game, yasf::Cof::deserialize<gr::Game>(line));
-    vector<Move> moves;
-    for (auto& m : game.moves) { moves.push_back(m.move); }
-    game_tree.add_game(moves);
-    count_games++;
+    vector<vector<string>> tasks;
+    while (std::ssize(tasks) < tasks_per_batch && !games_file->is_eof()) {
+      vector<string> lines;
+      while (std::ssize(lines) < lines_per_task && !games_file->is_eof()) {
+        bail(line, games_file->read_line());
+        lines.push_back(std::move(line));
+      }
+      tasks.push_back(std::move(lines));
+    }
+
+    optional<bee::Error> error;
+    for (auto& paths : parallel_map::go(tasks, num_workers, parse_games)) {
+      if (paths.is_error()) {
+        error = paths.error();
+        continue;
+      }
+      for (const auto& path : *paths) {
+        game_tree.add_path(path);
+        count_games++;
+      }
+    }
+    if (error.has_value()) { return *error; }
   }
   print_line("Games read: $", count_games);
+  return game_tree;
+}
 
-  auto positions = game_tree.nodes();
-  print_line("Unique positions read: $", positions.size());
+bee::OrError<bee::Unit> read_games(
+  unordered_map<string, PositionState::ptr>& existing_pcp,
+  const string& games_filename,
+  int min_frequency,
+  int max_ply,
+  int num_workers)
+{
+  bee::print_line("Reading games...");
+  bail(game_tree, read_game_tree(games_filename, num_workers));
+  const auto& nodes = game_tree.nodes();
+  print_line("Unique positions read: $", nodes.size());
 
-  auto now = Time::now();
-  for (auto& [fen, info] : positions) {
-    auto it = existing_pcp.find(fen);
-    if (it == existing_pcp.end()) {
-      existing_pcp.emplace(
-        fen,
-        make_shared<PositionState>(gr::PCPEntry{
-          .fen = fen,
-          .think_time = Span::zero(),
-          .frequency = info.frequency,
-          .ply = info.ply,
-          .best_moves = {},
-          .last_update = now,
-          .last_start = now,
-        }));
-    } else {
-      it->second->set_frequency_and_ply(info.frequency, info.ply);
+  unordered_map<uint64_t, PositionState::ptr> existing_by_key;
+  for (const auto& [fen, state] : existing_pcp) {
+    Board board;
+    bail_unit(board.set_fen(fen));
+    existing_by_key.emplace(board.hash_key(), state);
+  }
+
+  // Only positions that can be enqueued, the positions right after them and
+  // the ones already in the pcp are materialized, the rest are never looked at
+  vector<bool> needed(nodes.size(), false);
+  for (uint32_t idx = 0; idx < nodes.size(); idx++) {
+    const auto& node = nodes[idx];
+    if (existing_by_key.contains(node.key)) { needed[idx] = true; }
+    if (node.frequency >= min_frequency && node.ply <= max_ply) {
+      needed[idx] = true;
+      for (const auto& edge : node.children) { needed[edge.child] = true; }
     }
   }
 
+  auto now = Time::now();
+  vector<PositionState::ptr> states(nodes.size());
+  int materialized = 0;
+  game_tree.for_each_position([&](uint32_t idx, const Board& board) {
+    if (!needed[idx]) { return; }
+    const auto& node = nodes[idx];
+    auto it = existing_by_key.find(node.key);
+    if (it != existing_by_key.end()) {
+      it->second->set_frequency_and_ply(node.frequency, node.ply);
+      states[idx] = it->second;
+      return;
+    }
+    auto fen = board.to_fen();
+    auto state = make_shared<PositionState>(gr::PCPEntry{
+      .fen = fen,
+      .think_time = Span::zero(),
+      .frequency = node.frequency,
+      .ply = node.ply,
+      .best_moves = {},
+      .last_update = now,
+      .last_start = now,
+    });
+    existing_pcp.emplace(fen, state);
+    states[idx] = state;
+    materialized++;
+  });
+  print_line("New positions: $", materialized);
+
   // set next positions
-  for (auto& [fen, info] : positions) {
-    auto it = existing_pcp.find(fen);
-    assert(it != existing_pcp.end());
-    auto& state = it->second;
-    for (const auto& next : info.next_fens) {
-      auto next_it = existing_pcp.find(next);
-      assert(next_it != existing_pcp.end());
-      auto& next_state = next_it->second;
-      state->add_next(next_state);
+  for (uint32_t idx = 0; idx < nodes.size(); idx++) {
+    const auto& state = states[idx];
+    if (state == nullptr) { continue; }
+    for (const auto& edge : nodes[idx].children) {
+      const auto& next_state = states[edge.child];
+      if (next_state == nullptr) { continue; }
+      state->add_next(edge.move, next_state);
       next_state->add_prev(state);
     }
   }
@@ -580,12 +1309,14 @@ bee::OrError<bee::Unit> gen_main(
   Span initial_think_time,
   const Span& max_think_time,
   const bee::FilePath& pcp_file,
-  const Span save_table_every,
+  double compact_journal_ratio,
   int min_frequency,
   int max_ply,
   int num_workers,
+  size_t tt_memory_mb,
   const optional<int>& max_tasks,
-  const optional<int>& max_total_time_sec)
+  const optional<int>& max_total_time_sec,
+  const optional<Score>& backup_margin)
 {
   std::signal(SIGINT, handle_sigint);
 
@@ -600,7 +1331,10 @@ bee::OrError<bee::Unit> gen_main(
     }
   }
 
-  bail_unit(read_games(existing_pcp, games_filename));
+  bail(last_journal_segment, replay_journal(pcp_file, existing_pcp));
+
+  bail_unit(read_games(
+    existing_pcp, games_filename, min_frequency, max_ply, num_workers));
 
   optional<Span> max_total_time;
   if (max_total_time_sec.has_value()) {
@@ -614,17 +1348,40 @@ bee::OrError<bee::Unit> gen_main(
     max_ply,
     max_think_time,
     pcp_file,
-    save_table_every,
+    compact_journal_ratio,
     initial_think_time,
     max_tasks,
-    max_total_time);
+    max_total_time,
+    backup_margin,
+    num_workers,
+    last_journal_segment);
+
+  if (backup_margin.has_value()) {
+    // Backed up values are not stored in the pcp, they are recomputed from the
+    // leaves up every time the generation starts
+    vector<PositionState::ptr> by_ply;
+    for (auto& [_, state] : existing_pcp) { by_ply.push_back(state); }
+    std::sort(by_ply.begin(), by_ply.end(), [](const auto& a, const auto& b) {
+      return a->entry().ply > b->entry().ply;
+    });
+    int unstable = 0;
+    for (auto& state : by_ply) {
+      state->update_backed_value();
+      if (state->is_unstable(*backup_margin)) { unstable++; }
+    }
+    print_line("Unstable positions: $", unstable);
+  }
+
   for (auto& [_, entry] : existing_pcp) { manager->add_state(entry); }
 
   bee::print_line("Starting workers...");
 
+  auto hash_table = make_shared<TranspositionTable>(tt_memory_mb << 20);
+  print_line("Transposition table size: $MB", hash_table->size_bytes() >> 20);
+
   vector<thread> workers;
   for (int i = 0; i < num_workers; i++) {
-    workers.emplace_back(run_worker, manager);
+    workers.emplace_back(run_worker, manager, hash_table, i);
   }
 
   for (auto& t : workers) { t.join(); }
@@ -640,6 +1397,36 @@ bee::OrError<bee::Unit> gen_main(
   return bee::ok();
 }
 
+bee::OrError<bee::Unit> convert_main(
+  const bee::FilePath& input_file, const bee::FilePath& output_file)
+{
+  bee::print_line("Reading pcp...");
+  bail(pcp, PCP::open_in_memory(input_file));
+  bail(entries, pcp->read_all());
+
+  bail(data, PCP::to_binary(entries));
+  bail_unit(bee::FileWriter::save_file(output_file, data));
+
+  bail(binary, PCP::of_binary(std::move(data)));
+  int with_moves = 0;
+  for (const auto& [fen, entry] : entries) {
+    if (entry.best_moves.empty()) { continue; }
+    with_moves++;
+    bail(converted, binary->lookup_raw(fen));
+    if (!converted.has_value()) {
+      return bee::Error::format("Position missing after conversion: $", fen);
+    }
+  }
+
+  print_line(
+    "Converted $ entries, $ with a best move, to $",
+    entries.size(),
+    with_moves,
+    output_file);
+
+  return bee::ok();
+}
+
 } // namespace
 
 command::Cmd PCPGeneration::command()
@@ -654,28 +1441,49 @@ command::Cmd PCPGeneration::command()
   auto max_think_time_sec =
     builder.optional("--max-think-time-sec", float_flag);
   auto opening_file = builder.required("--pcp-file", file_path);
-  auto save_table_every =
-    builder.optional_with_default("--save-table-every-sec", float_flag, 60.0);
+  auto compact_journal_ratio = builder.optional_with_default(
+    "--compact-journal-ratio", float_flag, 0.25);
   auto min_frequency =
     builder.optional_with_default("--min-frequency", int_flag, 2);
   auto num_workers =
     builder.optional_with_default("--num-workers", int_flag, 16);
   auto max_ply = builder.optional_with_default("--max-ply", int_flag, 100);
+  auto tt_memory_mb =
+    builder.optional_with_default("--tt-memory-mb", int_flag, 8192);
   auto max_tasks = builder.optional("--max-tasks", int_flag);
   auto max_total_time_sec = builder.optional("--max-total-time-sec", int_flag);
+  auto backup = builder.no_arg("--backup");
+  auto backup_margin_pawns =
+    builder.optional_with_default("--backup-margin", float_flag, 0.25);
   return builder.run([=]() {
+    optional<Score> backup_margin;
+    if (*backup) { backup_margin = Score::of_pawns(*backup_margin_pawns); }
     return gen_main(
       *games_filename,
       Span::of_seconds(*think_time_sec),
       Span::of_seconds((*max_think_time_sec).value_or(1000000)),
       *opening_file,
-      Span::of_seconds(*save_table_every),
+      *compact_journal_ratio,
       *min_frequency,
       *max_ply,
       *num_workers,
+      *tt_memory_mb,
       *max_tasks,
-      *max_total_time_sec);
+      *max_total_time_sec,
+      backup_margin);
   });
 }
 
+command::Cmd PCPGeneration::convert_command()
+{
+  using namespace command;
+  using namespace command::flags;
+  auto file_path = flag_of_value_type<bee::FilePath>();
+  auto builder = CommandBuilder("Convert a pcp to the binary format");
+  auto input_file = builder.required("--pcp-file", file_path);
+  auto output_file = builder.required("--output-file", file_path);
+  return builder.run(
+    [=]() { return convert_main(*input_file, *output_file); });
+}
+
 } // namespace blackbit
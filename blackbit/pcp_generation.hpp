@@ -6,6 +6,7 @@ namespace blackbit {
 
 struct PCPGeneration {
   static command::Cmd command();
+  static command::Cmd convert_command();
 };
 
 } // namespace blackbit
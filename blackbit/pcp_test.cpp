@@ -0,0 +1,167 @@
+#include "pcp.hpp"
+
+#include "board.hpp"
+
+#include "bee/format_vector.hpp"
+#include "bee/testing.hpp"
+
+#include <cstring>
+#include <unordered_map>
+
+using bee::print_line;
+using bee::Span;
+using bee::Time;
+using std::string;
+using std::unordered_map;
+
+namespace blackbit {
+namespace {
+
+const string initial_fen =
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+const string e4_fen =
+  "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1";
+
+Move parse_move(const string& fen, const string& move)
+{
+  Board board;
+  must_unit(board.set_fen(fen));
+  must(m, board.parse_xboard_move_string(move));
+  return m;
+}
+
+PCP::entry make_entry(
+  const string& fen,
+  int64_t frequency,
+  const std::vector<string>& pv,
+  double eval)
+{
+  gr::MoveInfo best{.move = Move::invalid()};
+  Board board;
+  must_unit(board.set_fen(fen));
+  for (const auto& m : pv) {
+    must(move, board.parse_xboard_move_string(m));
+    if (best.pv.empty()) { best.move = move; }
+    best.pv.push_back(move);
+    board.move(move);
+  }
+  best.evaluation = Score::of_pawns(eval);
+  best.depth = 20;
+  best.think_time = Span::of_seconds(3);
+
+  auto now = Time::now();
+  return PCP::entry{
+    .fen = fen,
+    .think_time = Span::of_seconds(3),
+    .frequency = frequency,
+    .ply = 0,
+    .best_moves = {best},
+    .last_update = now,
+    .last_start = now,
+  };
+}
+
+unordered_map<string, PCP::entry> make_entries()
+{
+  unordered_map<string, PCP::entry> entries;
+  auto add = [&](PCP::entry&& e) { entries.emplace(e.fen, std::move(e)); };
+  add(make_entry(initial_fen, 100, {"e2e4", "e7e5", "g1f3"}, 0.3));
+  add(make_entry(e4_fen, 60, {"c7c5", "g1f3"}, 0.25));
+  // Same position as above, only the move counters differ
+  add(make_entry(
+    "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 3",
+    5,
+    {"e7e5"},
+    0.1));
+  auto no_moves = make_entry(
+    "rnbqkbnr/pppppppp/8/8/3P4/8/PPP1PPPP/RNBQKBNR b KQkq - 0 1", 10, {}, 0);
+  no_moves.best_moves.clear();
+  add(std::move(no_moves));
+  return entries;
+}
+
+void show_probe(const PCP& pcp, const string& fen)
+{
+  Board board;
+  must_unit(board.set_fen(fen));
+  auto probe = pcp.probe(board.hash_key());
+  if (!probe.has_value()) {
+    print_line("not found");
+    return;
+  }
+  print_line(
+    "eval:$ move:$ depth:$ pv:$",
+    probe->eval,
+    probe->best_move,
+    probe->depth,
+    pcp.probe_pv(*probe));
+}
+
+TEST(binary_round_trip)
+{
+  must(data, PCP::to_binary(make_entries()));
+  print_line("size:$", data.size());
+  must(pcp, PCP::of_binary(std::move(data)));
+
+  show_probe(*pcp, initial_fen);
+  show_probe(*pcp, e4_fen);
+  show_probe(
+    *pcp, "rnbqkbnr/pppppppp/8/8/3P4/8/PPP1PPPP/RNBQKBNR b KQkq - 0 1");
+  show_probe(
+    *pcp, "rnbqkbnr/pppppppp/8/8/2P5/8/PP1PPPPP/RNBQKBNR b KQkq - 0 1");
+
+  must(entry, pcp->lookup_raw(initial_fen));
+  print_line(
+    "frequency:$ think_time_ms:$ moves:$",
+    entry->frequency,
+    entry->think_time.to_millis(),
+    entry->best_moves.size());
+  must(missing, pcp->lookup_raw("8/8/8/8/8/8/8/K6k w - - 0 1"));
+  print_line("missing:$", missing.has_value());
+
+  print_line("read_all_fails:$", pcp->read_all().is_error());
+}
+
+TEST(binary_rejects_bad_data)
+{
+  must(data, PCP::to_binary(make_entries()));
+  auto open = [](string&& data) {
+    auto pcp = PCP::of_binary(std::move(data));
+    print_line(pcp.is_error() ? pcp.error().msg() : "ok");
+  };
+
+  open(data.substr(0, data.size() - 1));
+
+  auto bad_version = data;
+  bad_version[8] = 2;
+  open(std::move(bad_version));
+
+  // A record count whose size in bytes wraps around to the real one
+  auto wrapped_records = data;
+  uint64_t num_records = (uint64_t(1) << 59) + 2;
+  memcpy(wrapped_records.data() + 16, &num_records, sizeof(num_records));
+  open(std::move(wrapped_records));
+
+  open("not a pcp");
+  open(std::move(data));
+}
+
+TEST(binary_bad_pv_has_no_pv)
+{
+  must(data, PCP::to_binary(make_entries()));
+  // The pv_offset of the first record, after the 32 byte header, the key and
+  // the eval
+  data[32 + 12] = 100;
+  must(pcp, PCP::of_binary(std::move(data)));
+
+  for (const auto& fen : {initial_fen, e4_fen}) {
+    Board board;
+    must_unit(board.set_fen(fen));
+    auto probe = pcp->probe(board.hash_key());
+    print_line(
+      "move:$ pv_length:$", probe->best_move, pcp->probe_pv(*probe).size());
+  }
+}
+
+} // namespace
+} // namespace blackbit
@@ -0,0 +1,348 @@
+#include "perft.hpp"
+
+#include "memory_budget.hpp"
+#include "rules.hpp"
+
+#include "bee/format.hpp"
+#include "bee/time.hpp"
+#include "command/command_builder.hpp"
+
+#include <algorithm>
+#include <thread>
+
+using bee::print_line;
+using bee::Span;
+using bee::Time;
+using std::optional;
+using std::string;
+using std::vector;
+
+namespace blackbit {
+
+namespace {
+
+constexpr uint64_t depth_mask = 0xff;
+
+// Spreads the depths of a position over different slots
+uint64_t slot_key(uint64_t key, int depth)
+{
+  return key ^ (uint64_t(depth) * 0x9e3779b97f4a7c15ull);
+}
+
+constexpr PieceType under_promotions[] = {
+  PieceType::ROOK, PieceType::BISHOP, PieceType::KNIGHT};
+
+// Like in the search, a move is made on the board and is legal if it doesn't
+// leave the king of the side that moved under attack
+bool leaves_king_safe(const Board& board)
+{
+  return !Rules::is_king_under_attack(
+    board, Rules::make_scratch(board), oponent(board.turn));
+}
+
+// The generator only gives queen promotions, which is all the search needs.
+// The other promotions are added here, so that the counts follow the rules.
+void list_legal_moves(Board& board, MoveVector& out)
+{
+  MoveVector moves;
+  Rules::list_moves(board, Rules::make_scratch(board), moves);
+  for (const auto& m : moves) {
+    auto mi = board.move(m);
+    bool legal = leaves_king_safe(board);
+    board.undo(m, mi);
+    if (!legal) { continue; }
+    out.push_back(m);
+    if (m.promotion() == PieceType::QUEEN) {
+      for (auto p : under_promotions) { out.push_back(Move(m.o, m.d, p)); }
+    }
+  }
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// PerftTable
+//
+
+PerftTable::PerftTable(size_t num_slots) : _slots(num_slots) {}
+
+PerftTable::ptr PerftTable::create(size_t size_bytes)
+{
+  return ptr(new PerftTable(std::max<size_t>(size_bytes / sizeof(slot), 1)));
+}
+
+optional<uint64_t> PerftTable::find(uint64_t key, int depth) const
+{
+  auto k = slot_key(key, depth);
+  const auto& s = _slots[k % _slots.size()];
+  auto data = s.data.load(std::memory_order_relaxed);
+  auto check = s.check.load(std::memory_order_relaxed);
+  if ((check ^ data) != k || (data & depth_mask) != uint64_t(depth)) {
+    return std::nullopt;
+  }
+  return data >> 8;
+}
+
+void PerftTable::insert(uint64_t key, int depth, uint64_t nodes)
+{
+  auto k = slot_key(key, depth);
+  auto& s = _slots[k % _slots.size()];
+  auto data = (nodes << 8) | uint64_t(depth);
+  s.data.store(data, std::memory_order_relaxed);
+  s.check.store(k ^ data, std::memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Perft
+//
+
+uint64_t Perft::count(Board& board, int depth, PerftTable* table)
+{
+  if (depth <= 0) { return 1; }
+  if (table != nullptr && depth > 1) {
+    if (auto nodes = table->find(board.hash_key(), depth)) { return *nodes; }
+  }
+
+  MoveVector moves;
+  Rules::list_moves(board, Rules::make_scratch(board), moves);
+
+  uint64_t nodes = 0;
+  for (const auto& m : moves) {
+    bool is_promotion = m.promotion() == PieceType::QUEEN;
+    auto mi = board.move(m);
+    bool legal = leaves_king_safe(board);
+    if (legal) {
+      if (depth == 1) {
+        nodes += is_promotion ? 4 : 1;
+      } else {
+        nodes += count(board, depth - 1, table);
+      }
+    }
+    board.undo(m, mi);
+
+    // Promoting to another piece is legal whenever promoting to a queen is
+    if (legal && is_promotion && depth > 1) {
+      for (auto p : under_promotions) {
+        Move under(m.o, m.d, p);
+        auto under_mi = board.move(under);
+        nodes += count(board, depth - 1, table);
+        board.undo(under, under_mi);
+      }
+    }
+  }
+
+  if (table != nullptr && depth > 1) {
+    table->insert(board.hash_key(), depth, nodes);
+  }
+  return nodes;
+}
+
+vector<Perft::RootMove> Perft::divide(
+  const Board& board,
+  int depth,
+  int num_workers,
+  const PerftTable::ptr& table)
+{
+  Board root_board = board;
+  MoveVector moves;
+  list_legal_moves(root_board, moves);
+
+  vector<RootMove> root_moves;
+  for (const auto& m : moves) {
+    root_moves.push_back({.move = m, .nodes = 0});
+  }
+
+  std::atomic<size_t> next = 0;
+  auto run_worker = [&] {
+    Board worker_board = board;
+    while (true) {
+      auto i = next.fetch_add(1);
+      if (i >= root_moves.size()) { break; }
+      auto& root = root_moves[i];
+      auto mi = worker_board.move(root.move);
+      root.nodes = count(worker_board, depth - 1, table.get());
+      worker_board.undo(root.move, mi);
+    }
+  };
+
+  vector<std::thread> workers;
+  for (int i = 1; i < num_workers; i++) { workers.emplace_back(run_worker); }
+  run_worker();
+  for (auto& worker : workers) { worker.join(); }
+
+  return root_moves;
+}
+
+namespace {
+
+// Positions with well known counts, from the chess programming wiki. The
+// counts are for depths 1, 2, 3 and so on.
+struct SuitePosition {
+  string name;
+  string fen;
+  vector<uint64_t> counts;
+};
+
+const vector<SuitePosition> suite = {
+  {
+    .name = "initial",
+    .fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    .counts = {20, 400, 8902, 197281, 4865609, 119060324},
+  },
+  {
+    .name = "kiwipete",
+    .fen =
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    .counts = {48, 2039, 97862, 4085603, 193690690},
+  },
+  {
+    .name = "position 3",
+    .fen = "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    .counts = {14, 191, 2812, 43238, 674624, 11030083},
+  },
+  {
+    .name = "position 4",
+    .fen = "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    .counts = {6, 264, 9467, 422333, 15833292},
+  },
+  {
+    .name = "position 5",
+    .fen = "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    .counts = {44, 1486, 62379, 2103487, 89941194},
+  },
+};
+
+struct PerftRun {
+  uint64_t nodes;
+  Span elapsed;
+};
+
+PerftRun run_divide(
+  const Board& board,
+  int depth,
+  bool print_moves,
+  int num_workers,
+  const optional<size_t>& table_bytes)
+{
+  // A fresh table for each run, so the times are comparable
+  PerftTable::ptr table;
+  if (table_bytes.has_value()) { table = PerftTable::create(*table_bytes); }
+
+  auto start = Time::monotonic();
+  auto root_moves = Perft::divide(board, depth, num_workers, table);
+  auto elapsed = Time::monotonic() - start;
+
+  uint64_t nodes = 0;
+  for (const auto& root : root_moves) {
+    if (print_moves) { print_line("$: $", root.move, root.nodes); }
+    nodes += root.nodes;
+  }
+  return {.nodes = nodes, .elapsed = elapsed};
+}
+
+double nodes_per_second(const PerftRun& run)
+{
+  return run.nodes / std::max(run.elapsed.to_float_seconds(), 1e-9);
+}
+
+bee::OrError<bee::Unit> run_perft(
+  const string& fen,
+  int depth,
+  bool print_moves,
+  int num_workers,
+  const optional<size_t>& table_bytes)
+{
+  Board board;
+  bail_unit(board.set_fen(fen));
+  auto run = run_divide(board, depth, print_moves, num_workers, table_bytes);
+  print_line(
+    "depth:$ nodes:$ time:$ nodes/s:$",
+    depth,
+    run.nodes,
+    run.elapsed,
+    nodes_per_second(run));
+  return bee::unit;
+}
+
+bee::OrError<bee::Unit> run_suite(
+  int max_depth, int num_workers, const optional<size_t>& table_bytes)
+{
+  int failed = 0;
+  uint64_t total_nodes = 0;
+  Span total_time = Span::zero();
+  for (const auto& position : suite) {
+    Board board;
+    bail_unit(board.set_fen(position.fen));
+    print_line("$: $", position.name, position.fen);
+    int depths = std::min<int>(max_depth, position.counts.size());
+    for (int depth = 1; depth <= depths; depth++) {
+      auto expected = position.counts[depth - 1];
+      auto run = run_divide(board, depth, false, num_workers, table_bytes);
+      bool ok = run.nodes == expected;
+      if (!ok) { failed++; }
+      print_line(
+        "depth:$ nodes:$ expected:$ time:$ nodes/s:$ $",
+        depth,
+        run.nodes,
+        expected,
+        run.elapsed,
+        nodes_per_second(run),
+        ok ? "OK" : "FAILED");
+      total_nodes += run.nodes;
+      total_time += run.elapsed;
+    }
+  }
+  print_line(
+    "Total nodes:$ time:$ nodes/s:$",
+    total_nodes,
+    total_time,
+    nodes_per_second({.nodes = total_nodes, .elapsed = total_time}));
+  if (failed > 0) {
+    return bee::Error::format("$ counts don't match the expected ones", failed);
+  }
+  return bee::unit;
+}
+
+bee::OrError<bee::Unit> perft_main(
+  const string& fen,
+  int depth,
+  bool print_moves,
+  int num_workers,
+  const optional<string>& memory_str,
+  bool suite)
+{
+  if (depth < 1) { return bee::Error("Depth must be at least 1"); }
+  optional<size_t> table_bytes;
+  if (memory_str.has_value()) {
+    bail(memory, MemoryBudget::parse(*memory_str));
+    table_bytes = memory.total_bytes();
+  }
+  if (suite) { return run_suite(depth, num_workers, table_bytes); }
+  return run_perft(fen, depth, print_moves, num_workers, table_bytes);
+}
+
+} // namespace
+
+command::Cmd Perft::command()
+{
+  using namespace command::flags;
+  auto builder = command::CommandBuilder(
+    "Count the leaves of the tree of legal moves, to check the move "
+    "generation and measure its speed");
+  auto fen = builder.optional_with_default(
+    "--fen",
+    string_flag,
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  auto depth = builder.optional_with_default("--depth", int_flag, 5);
+  auto divide = builder.no_arg("--divide");
+  auto num_workers =
+    builder.optional_with_default("--num-workers", int_flag, 1);
+  auto memory = builder.optional("--memory", string_flag);
+  auto run_suite_flag = builder.no_arg("--suite");
+  return builder.run([=] {
+    return perft_main(
+      *fen, *depth, *divide, *num_workers, *memory, *run_suite_flag);
+  });
+}
+
+} // namespace blackbit
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "board.hpp"
+#include "move.hpp"
+
+#include "command/cmd.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace blackbit {
+
+// Leaf counts of positions already counted, keyed by Board::hash_key and the
+// remaining depth. Safe to share between threads, like TranspositionTable each
+// slot keeps the key xor'ed with its data, so a slot that was torn by
+// concurrent writes just looks like a miss.
+struct PerftTable {
+ public:
+  using ptr = std::shared_ptr<PerftTable>;
+
+  static ptr create(size_t size_bytes);
+
+  std::optional<uint64_t> find(uint64_t key, int depth) const;
+
+  void insert(uint64_t key, int depth, uint64_t nodes);
+
+ private:
+  struct slot {
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> data;
+  };
+
+  explicit PerftTable(size_t num_slots);
+
+  std::vector<slot> _slots;
+};
+
+// Counts the leaves of the tree of legal moves, to check the move generation
+// against known counts and to measure how fast it is
+struct Perft {
+ public:
+  struct RootMove {
+    Move move;
+    uint64_t nodes;
+  };
+
+  // Moves are made and undone on the board, like in the search, and are legal
+  // if they don't leave the king under attack. The last ply only checks that
+  // and counts the moves, without generating anything below them. The table
+  // is optional and only holds positions more than one ply from the leaves.
+  // All the promotions are counted, not only the queen ones Rules::list_moves
+  // gives.
+  static uint64_t count(Board& board, int depth, PerftTable* table);
+
+  // Count for each root move, in the order they are generated. The root moves
+  // are split between the workers.
+  static std::vector<RootMove> divide(
+    const Board& board,
+    int depth,
+    int num_workers,
+    const PerftTable::ptr& table);
+
+  static command::Cmd command();
+};
+
+} // namespace blackbit
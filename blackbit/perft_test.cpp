@@ -0,0 +1,80 @@
+#include "perft.hpp"
+
+#include "bee/testing.hpp"
+
+#include <string>
+
+using bee::print_line;
+using std::string;
+
+namespace blackbit {
+namespace {
+
+void run_counts(const string& fen, int max_depth)
+{
+  Board board;
+  must_unit(board.set_fen(fen));
+  print_line(fen);
+  for (int depth = 1; depth <= max_depth; depth++) {
+    print_line("depth:$ nodes:$", depth, Perft::count(board, depth, nullptr));
+  }
+}
+
+TEST(initial)
+{
+  run_counts("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4);
+}
+
+TEST(castling_and_passant)
+{
+  run_counts(
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3);
+  run_counts("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4);
+}
+
+TEST(promotions)
+{
+  run_counts(
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3);
+  run_counts("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3);
+}
+
+TEST(castling_rules)
+{
+  // Castling through squares only a pawn attacks
+  run_counts(
+    "r3k2r/p1ppPpb1/1n2pnp1/1b2N3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b KQkq - 0 1", 2);
+  // Taking a rook on the other side's first line keeps its castling rights
+  run_counts(
+    "r3k2r/Pppp1ppp/1b3nbN/nPB5/B1P1P3/q4N2/P2P2PP/r2Q1RK1 w kq - 0 1", 2);
+}
+
+TEST(divide)
+{
+  Board board;
+  must_unit(board.set_fen(
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+  // Deep enough for the table to be used below the root moves
+  auto plain = Perft::divide(board, 3, 1, nullptr);
+  uint64_t total = 0;
+  for (const auto& root : plain) {
+    print_line("$: $", root.move, root.nodes);
+    total += root.nodes;
+  }
+  print_line("total: $", total);
+
+  // Threads and the table must not change any count
+  auto hashed = Perft::divide(board, 3, 4, PerftTable::create(1 << 16));
+  uint64_t hashed_total = 0;
+  bool same = hashed.size() == plain.size();
+  for (size_t i = 0; i < hashed.size(); i++) {
+    hashed_total += hashed[i].nodes;
+    same = same && hashed[i].move == plain[i].move &&
+           hashed[i].nodes == plain[i].nodes;
+  }
+  print_line("total with threads and table: $", hashed_total);
+  print_line("same with threads and table: $", same);
+}
+
+} // namespace
+} // namespace blackbit
@@ -54,8 +54,6 @@ int run(int argc, char** argv)
 
       board.move(*m);
 
-      if (board.is_history_full()) break;
-
       moves.push_back(gr::MoveInfo{.move = *m});
 
       if (Rules::is_game_over_slow(board)) { break; }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "bee/file_descriptor.hpp"
+
+#include <mutex>
+#include <optional>
+#include <queue>
+
+namespace blackbit {
+
+// Passes values from other threads to the async scheduler thread. Every push
+// writes to the fd, whose read end is watched by the scheduler, which then
+// pops all that is queued.
+template <class T> struct QueueBridge {
+ public:
+  std::optional<T> pop()
+  {
+    auto lock = std::unique_lock(_mutex);
+    if (_local_queue.empty()) { return std::nullopt; }
+    auto ret = std::move(_local_queue.front());
+    _local_queue.pop();
+    return ret;
+  }
+
+  void push(T&& info)
+  {
+    auto lock = std::unique_lock(_mutex);
+    _local_queue.push(std::move(info));
+    _fd->write("r");
+  }
+
+  QueueBridge(const bee::FileDescriptor::shared_ptr& fd) : _fd(fd) {}
+
+ private:
+  std::mutex _mutex;
+  std::queue<T> _local_queue;
+  bee::FileDescriptor::shared_ptr _fd;
+};
+
+} // namespace blackbit
@@ -1,6 +1,7 @@
 #include "rules.hpp"
 
 #include "eval_scratch.hpp"
+#include "material.hpp"
 #include "pieces.hpp"
 
 #include "bee/format_optional.hpp"
@@ -445,11 +446,27 @@ struct CombinedRules {
     return out;
   }
 
+  // The squares the king can't castle through. The scratch attacks only have
+  // the pawn captures of pieces, but the king can't go through a square a pawn
+  // attacks either.
+  static BitBoard castle_attacked_bb(
+    const Board& board, const EvalScratch& scratch, Color color)
+  {
+    const Color op = oponent(color);
+    BitBoard attacked = scratch.attacks_bb.get(op);
+    if (board.castle_flags.can_castle(color)) {
+      for (const auto& place : board.pieces(op, PieceType::PAWN)) {
+        attacked |= BitBoard::pawn_captures[op][place];
+      }
+    }
+    return attacked;
+  }
+
   void list_moves(
     const Board& board, const EvalScratch& scratch, MoveVector& moves) const
   {
     const Color color = board.turn;
-    const BitBoard attacked = scratch.attacks_bb.get(oponent(color));
+    const BitBoard attacked = castle_attacked_bb(board, scratch, color);
     BitBoard rooks = board.bbPeca[color][PieceType::ROOK];
 
     pawn_rules.list_all_moves(board, color, attacked, rooks, moves);
@@ -467,7 +484,7 @@ struct CombinedRules {
     PieceType type) const
   {
     const Color color = b.turn;
-    const BitBoard attacked = scratch.attacks_bb.get(oponent(color));
+    const BitBoard attacked = castle_attacked_bb(b, scratch, color);
     BitBoard rooks = b.bbPeca[color][PieceType::ROOK];
     switch (type) {
     case PieceType::PAWN:
@@ -560,49 +577,6 @@ struct CombinedRules {
   KingRules king_rules;
 };
 
-enum class PiecesLeft {
-  KingOnly,
-  KingOneKnight,
-  KingOneBishop,
-  Other,
-};
-
-bool is_draw_by_insuficient_material(const Board& board)
-{
-  auto pieces_left = [&](Color color) {
-    const auto& p = board.pieces(color);
-    if (
-      p[PieceType::QUEEN].size() > 0 || p[PieceType::ROOK].size() > 0 ||
-      p[PieceType::PAWN].size() > 0 || p[PieceType::KING].size() != 1) {
-      return PiecesLeft::Other;
-    }
-
-    if (p[PieceType::KNIGHT].size() == 0 && p[PieceType::BISHOP].size() == 0) {
-      return PiecesLeft::KingOnly;
-    }
-    if (p[PieceType::KNIGHT].size() == 1 && p[PieceType::BISHOP].size() == 0) {
-      return PiecesLeft::KingOneKnight;
-    }
-    if (p[PieceType::KNIGHT].size() == 0 && p[PieceType::BISHOP].size() == 1) {
-      return PiecesLeft::KingOneBishop;
-    }
-    return PiecesLeft::Other;
-  };
-
-  auto white_left = pieces_left(Color::White);
-  if (white_left == PiecesLeft::Other) { return false; }
-
-  auto black_left = pieces_left(Color::Black);
-  if (black_left == PiecesLeft::Other) { return false; }
-
-  if (
-    white_left == PiecesLeft::KingOnly || black_left == PiecesLeft::KingOnly) {
-    return true;
-  }
-
-  return false;
-}
-
 bool has_legal_moves(const Board& board, const EvalScratch& scratch)
 {
   MoveVector moves;
@@ -681,13 +655,19 @@ GameResult Rules::result(const Board& board, const EvalScratch& scratch)
 }
 
 bool Rules::is_draw_without_stalemate(const Board& board)
+{
+  return is_draw_without_stalemate(board, board.history.size());
+}
+
+bool Rules::is_draw_without_stalemate(const Board& board, int search_root)
 {
   if (
-    board.repeated() || board.moves_since_last_catpure_or_pawn_move() >= 100) {
+    board.is_repetition_draw(search_root) ||
+    board.moves_since_last_catpure_or_pawn_move() >= 100) {
     return true;
   }
 
-  return is_draw_by_insuficient_material(board);
+  return MaterialTable::is_insufficient_material(board);
 }
 
 BitBoard Rules::attacks_bb(const Board& board, Color color)
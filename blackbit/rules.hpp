@@ -24,6 +24,10 @@ struct Rules {
 
   static bool is_draw_without_stalemate(const Board& board);
 
+  // Same as above, but repeating a position reached at or after history index
+  // `search_root` already counts as a draw
+  static bool is_draw_without_stalemate(const Board& board, int search_root);
+
   static GameResult result(const Board& board, const EvalScratch& scratch);
 
   static GameResult result_slow(const Board& board);
@@ -0,0 +1,115 @@
+#include "search_limits.hpp"
+
+#include "bee/format.hpp"
+#include "bee/string_util.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+using bee::format;
+using bee::Time;
+using std::string;
+using std::vector;
+
+namespace blackbit {
+
+namespace {
+
+// How often the limits are checked while none of them is close. Checking the
+// time is the expensive part, and a thousand nodes take well under a
+// millisecond.
+constexpr uint64_t check_interval = 1 << 12;
+
+constexpr uint64_t never = std::numeric_limits<uint64_t>::max();
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// SearchLimits
+//
+
+bool SearchLimits::is_mate_reached(Score score) const
+{
+  if (!mate_in.has_value() || !score.is_mate() || !score.is_positive()) {
+    return false;
+  }
+  // moves_to_mate counts plies
+  return (score.moves_to_mate() + 1) / 2 <= *mate_in;
+}
+
+string SearchLimits::to_string() const
+{
+  vector<string> parts;
+  parts.push_back(format("depth:$", depth));
+  if (nodes.has_value()) { parts.push_back(format("nodes:$", *nodes)); }
+  if (time.has_value()) { parts.push_back(format("time:$", *time)); }
+  if (mate_in.has_value()) { parts.push_back(format("mate_in:$", *mate_in)); }
+  return bee::join(parts, " ");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SearchLimiter
+//
+
+SearchLimiter::SearchLimiter(
+  const SearchLimits& limits,
+  const std::shared_ptr<std::atomic_bool>& should_stop)
+    : _max_nodes(limits.nodes),
+      _max_time(limits.time),
+      _start(Time::monotonic()),
+      _should_stop(should_stop)
+{}
+
+SearchLimiter::ptr SearchLimiter::create(
+  const SearchLimits& limits,
+  const std::shared_ptr<std::atomic_bool>& should_stop)
+{
+  return ptr(new SearchLimiter(limits, should_stop));
+}
+
+EngineCore::NodeCallback SearchLimiter::node_callback(
+  EngineCore::NodeCallback inner)
+{
+  // The core calls at its first node, so there is one node to count then
+  uint64_t last = 1;
+  uint64_t to_inner = 1;
+  return [self = shared_from_this(),
+          inner = std::move(inner),
+          last,
+          to_inner]() mutable -> uint64_t {
+    auto nodes = self->_nodes.fetch_add(last) + last;
+    uint64_t next = never;
+    if (self->_max_nodes.has_value()) {
+      if (nodes >= *self->_max_nodes) {
+        // Returning 0 would also stop the core from calling again, so the
+        // rest of an uninterruptible depth 1 would go uncounted. The search is
+        // stopped through should_stop instead, and every node past the limit
+        // is still counted.
+        self->_reached_node_limit.store(true);
+        self->_should_stop->store(true);
+        last = 1;
+        return 1;
+      }
+      next = std::min(check_interval, *self->_max_nodes - nodes);
+    }
+    if (self->_max_time.has_value()) {
+      if (Time::monotonic().diff(self->_start) >= *self->_max_time) {
+        return 0;
+      }
+      next = std::min(next, check_interval);
+    }
+    if (inner != nullptr) {
+      to_inner -= last;
+      if (to_inner == 0) {
+        to_inner = inner();
+        if (to_inner == 0) { return 0; }
+      }
+      next = std::min(next, to_inner);
+    }
+    last = next;
+    return next;
+  };
+}
+
+} // namespace blackbit
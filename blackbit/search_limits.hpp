@@ -0,0 +1,81 @@
+#pragma once
+
+#include "engine_core.hpp"
+#include "score.hpp"
+
+#include "bee/span.hpp"
+#include "bee/time.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace blackbit {
+
+// When a search ends, unless it is stopped before. A search limited only by
+// depth, nodes and mate is deterministic, the same binary finds the same
+// result on any machine and under any load.
+struct SearchLimits {
+  int depth = 100;
+
+  // Counted over all the depths. The search stops after exactly this many,
+  // except that depth 1 is always completed.
+  std::optional<uint64_t> nodes;
+
+  // Counted from when the search starts running, not while it waits for a
+  // thread
+  std::optional<bee::Span> time;
+
+  // Stops once the side to move has a mate in at most this many moves
+  std::optional<int> mate_in;
+
+  bool is_deterministic() const { return !time.has_value(); }
+
+  // Score from the side to move's point of view
+  bool is_mate_reached(Score score) const;
+
+  std::string to_string() const;
+};
+
+// Enforces the node and time limits from inside the search, through the node
+// callbacks of its cores. The cores of a search share one limiter, and the
+// node limit is on the total of all of them, exact only with a single core.
+struct SearchLimiter : public std::enable_shared_from_this<SearchLimiter> {
+ public:
+  using ptr = std::shared_ptr<SearchLimiter>;
+
+  // The time limit starts counting here. Reaching the node limit sets
+  // should_stop, the cores then stop at their next node unless they are
+  // searching depth 1.
+  static ptr create(
+    const SearchLimits& limits,
+    const std::shared_ptr<std::atomic_bool>& should_stop);
+
+  // For one core. The inner callback, when given, is still called after as
+  // many nodes as it asks for, and can stop the search too.
+  EngineCore::NodeCallback node_callback(
+    EngineCore::NodeCallback inner = nullptr);
+
+  // Exact once the node limit was reached, including the nodes searched past it
+  // to complete depth 1, otherwise only up to the last call of each core
+  uint64_t nodes() const { return _nodes.load(); }
+
+  bool reached_node_limit() const { return _reached_node_limit.load(); }
+
+ private:
+  SearchLimiter(
+    const SearchLimits& limits,
+    const std::shared_ptr<std::atomic_bool>& should_stop);
+
+  const std::optional<uint64_t> _max_nodes;
+  const std::optional<bee::Span> _max_time;
+  const bee::Time _start;
+  const std::shared_ptr<std::atomic_bool> _should_stop;
+
+  std::atomic<uint64_t> _nodes = 0;
+  std::atomic_bool _reached_node_limit = false;
+};
+
+} // namespace blackbit
@@ -1,7 +1,6 @@
 #include "self_play.hpp"
 
 #include "bee/format_vector.hpp"
-#include "bee/span.hpp"
 #include "engine.hpp"
 #include "experiment_framework.hpp"
 #include "generated_game_record.hpp"
@@ -10,7 +9,6 @@
 #include <memory>
 
 using bee::print_line;
-using bee::Span;
 using std::make_unique;
 using std::shared_ptr;
 using std::string;
@@ -25,22 +23,32 @@ struct BotState {
 
   static ptr create(
     size_t cache_size,
-    Span time_per_move,
+    const shared_ptr<TranspositionTable>& shared_table,
+    const SearchLimits& limits,
     const EngineParams& params,
-    int max_depth,
     bool clear_cache_before_move)
   {
-    return ptr(new BotState(
-      cache_size, time_per_move, params, max_depth, clear_cache_before_move));
+    auto engine = shared_table != nullptr
+                    ? EngineInProcess::create_with_shared_table(
+                        params.experiment,
+                        params.eval_params,
+                        nullptr,
+                        shared_table,
+                        clear_cache_before_move)
+                    : EngineInProcess::create(
+                        params.experiment,
+                        params.eval_params,
+                        nullptr,
+                        cache_size,
+                        clear_cache_before_move);
+    return ptr(new BotState(std::move(engine), limits));
   }
 
   void set_fen(const string& fen) { _board.set_fen(fen); }
 
   bee::OrError<SearchResultInfo::ptr> move()
   {
-    bail(
-      result,
-      _engine->find_best_move(_board, _max_depth, _time_per_move, nullptr));
+    bail(result, _engine->find_best_move(_board, _limits, nullptr));
     _board.move(result->best_move);
     return std::move(result);
   }
@@ -48,27 +56,14 @@ struct BotState {
   void user_move(const Move& m) { _board.move(m); }
 
  private:
-  BotState(
-    size_t cache_size,
-    Span time_per_move,
-    const EngineParams& params,
-    int max_depth,
-    bool clear_cache_before_move)
-      : _engine(EngineInProcess::create(
-          params.experiment,
-          params.eval_params,
-          nullptr,
-          cache_size,
-          clear_cache_before_move)),
-        _time_per_move(time_per_move),
-        _max_depth(max_depth)
+  BotState(EngineInProcess::ptr&& engine, const SearchLimits& limits)
+      : _engine(std::move(engine)), _limits(limits)
   {}
 
   unique_ptr<EngineInProcess> _engine;
   Board _board;
 
-  const Span _time_per_move;
-  const int _max_depth;
+  const SearchLimits _limits;
 };
 
 struct BotPair {
@@ -107,15 +102,15 @@ SelfPlayResult self_play_one_game(const GameParams& game_params)
 {
   auto white_bot = BotState::create(
     game_params.hash_size,
-    game_params.time_per_move,
+    game_params.white_table,
+    game_params.limits,
     game_params.white_params,
-    game_params.max_depth,
     game_params.clear_cache_before_move);
   auto black_bot = BotState::create(
     game_params.hash_size,
-    game_params.time_per_move,
+    game_params.black_table,
+    game_params.limits,
     game_params.black_params,
-    game_params.max_depth,
     game_params.clear_cache_before_move);
 
   auto bot_pair = BotPair{.white_bot = white_bot, .black_bot = black_bot};
@@ -4,6 +4,10 @@
 #include "eval.hpp"
 #include "experiment_framework.hpp"
 #include "generated_game_record.hpp"
+#include "search_limits.hpp"
+#include "transposition_table.hpp"
+
+#include <memory>
 
 namespace gr = generated_game_record;
 
@@ -18,10 +22,14 @@ struct GameParams {
   std::string starting_fen;
   EngineParams white_params;
   EngineParams black_params;
-  bee::Span time_per_move;
+  SearchLimits limits;
   const size_t hash_size;
-  const int max_depth;
   const bool clear_cache_before_move;
+
+  // When set, the engine uses this table, shared with other engines, instead
+  // of one of hash_size of its own
+  std::shared_ptr<TranspositionTable> white_table = nullptr;
+  std::shared_ptr<TranspositionTable> black_table = nullptr;
 };
 
 struct SelfPlayResult {
@@ -12,7 +12,6 @@
 using namespace async;
 
 using bee::print_err_line;
-using bee::Span;
 using std::make_unique;
 using std::nullopt;
 using std::optional;
@@ -27,13 +26,13 @@ struct GameRunner : public std::enable_shared_from_this<GameRunner> {
  public:
   GameRunner(
     const string& fen,
-    const Span time_per_move,
+    const SearchLimits& limits,
     EngineInterface::ptr&& white_engine,
     EngineInterface::ptr&& black_engine)
       : _white_engine(std::move(white_engine)),
         _black_engine(std::move(black_engine)),
         _fen(fen),
-        _time_per_move(time_per_move),
+        _limits(limits),
         _board(make_unique<Board>())
   {}
 
@@ -54,8 +53,8 @@ struct GameRunner : public std::enable_shared_from_this<GameRunner> {
       _board->set_fen(_fen);
       co_bail_unit(_white_engine->set_fen(_fen));
       co_bail_unit(_black_engine->set_fen(_fen));
-      co_bail_unit(_white_engine->set_time_per_move(_time_per_move));
-      co_bail_unit(_black_engine->set_time_per_move(_time_per_move));
+      co_bail_unit(_white_engine->set_limits(_limits));
+      co_bail_unit(_black_engine->set_limits(_limits));
       while (true) {
         auto m = co_await get_playing_engine()->find_move();
         auto ret = _handle_move(std::move(m));
@@ -124,7 +123,7 @@ struct GameRunner : public std::enable_shared_from_this<GameRunner> {
   EngineInterface::ptr _black_engine;
 
   string _fen;
-  Span _time_per_move;
+  SearchLimits _limits;
   unique_ptr<Board> _board;
 
   vector<gr::MoveInfo> _moves;
@@ -140,7 +139,7 @@ struct GameRunner : public std::enable_shared_from_this<GameRunner> {
 
 Task<bee::OrError<SelfPlayResultAsync>> self_play_one_game(
   const string starting_fen,
-  const Span time_per_move,
+  const SearchLimits limits,
   const EngineFactory white_factory,
   const EngineFactory black_factory)
 {
@@ -148,7 +147,7 @@ Task<bee::OrError<SelfPlayResultAsync>> self_play_one_game(
   co_bail(black_engine, black_factory());
   auto game_runner = make_shared<GameRunner>(
     starting_fen,
-    time_per_move,
+    limits,
     std::move(white_engine),
     std::move(black_engine));
   co_return co_await game_runner->start();
@@ -4,6 +4,7 @@
 #include "game_result.hpp"
 #include "generated_game_record.hpp"
 #include "move.hpp"
+#include "search_limits.hpp"
 
 #include "async/task.hpp"
 
@@ -27,7 +28,7 @@ using EngineFactory = std::function<bee::OrError<EngineInterface::ptr>()>;
 
 async::Task<bee::OrError<SelfPlayResultAsync>> self_play_one_game(
   const std::string starting_fen,
-  const bee::Span time_per_move,
+  const SearchLimits limits,
   const EngineFactory white_bot,
   const EngineFactory black_bot);
 
@@ -75,7 +75,7 @@ void TerminoEngine::set_board(const Board& board)
   *_board = board;
   _engine->start_mpv_search_sp(
     board,
-    100,
+    {.depth = 100},
     10,
     [queue,
      search_id = _current_search_id](vector<SearchResultInfo::ptr>&& results) {
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "bee/error.hpp"
+#include "bee/queue.hpp"
 #include "board.hpp"
 #include "engine.hpp"
+#include "queue_bridge.hpp"
 #include "termino/element.hpp"
 #include "termino/text_box.hpp"
 
@@ -10,32 +12,6 @@
 
 namespace blackbit {
 
-template <class T> struct QueueBridge {
- public:
-  std::optional<T> pop()
-  {
-    auto lock = std::unique_lock(_mutex);
-    if (_local_queue.empty()) { return std::nullopt; }
-    auto ret = std::move(_local_queue.front());
-    _local_queue.pop();
-    return ret;
-  }
-
-  void push(T&& info)
-  {
-    auto lock = std::unique_lock(_mutex);
-    _local_queue.push(std::move(info));
-    _fd->write("r");
-  }
-
-  QueueBridge(const bee::FileDescriptor::shared_ptr& fd) : _fd(fd) {}
-
- private:
-  std::mutex _mutex;
-  std::queue<T> _local_queue;
-  bee::FileDescriptor::shared_ptr _fd;
-};
-
 struct TerminoEngine : public std::enable_shared_from_this<TerminoEngine> {
  private:
   struct ResultItem {
@@ -0,0 +1,69 @@
+#include "time_manager.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+using bee::Span;
+
+namespace blackbit {
+
+void TimeManager::set_time_control(int mps, Span base, Span inc)
+{
+  _mps = mps;
+  _base = base;
+  _inc = inc;
+}
+
+void TimeManager::set_max_time(Span max_time) { _max_time = max_time; }
+
+void TimeManager::set_time_remaining(Span time_remaining)
+{
+  _time_remaining = time_remaining;
+}
+
+Span TimeManager::_think_time() const
+{
+  const Span absolute_minimum_time_to_think = Span::of_millis(50);
+  const Span time_buffer = Span::of_millis(10);
+  Span think_time = Span::of_seconds(1);
+  if (_mps > 0 && _inc == Span::zero()) {
+    think_time = _base / _mps;
+  } else if (_mps == 0 && _base > Span::zero()) {
+    think_time =
+      std::max(std::min(_time_remaining, _inc), (_time_remaining / 40));
+  } else if (_max_time > Span::zero()) {
+    think_time = _max_time;
+  }
+  think_time += _banked_time / banked_time_share;
+  if ((_time_remaining > Span::zero()) && think_time > _time_remaining) {
+    think_time = _time_remaining;
+  }
+  think_time =
+    std::max(absolute_minimum_time_to_think, think_time - time_buffer);
+  assert(think_time > Span::zero() && "Why?");
+  return think_time;
+}
+
+Span TimeManager::start_move()
+{
+  auto think_time = _think_time();
+  _banked_time -= std::min(_banked_time, _banked_time / banked_time_share);
+  return think_time;
+}
+
+Span TimeManager::finish_move(Span think_time, Span used)
+{
+  if (used * 10 >= think_time * 9) { return Span::zero(); }
+  auto saved = think_time - used;
+  _saved_this_game += saved;
+  if (_mps > 0 && _inc == Span::zero()) { _banked_time += saved; }
+  return saved;
+}
+
+void TimeManager::reset()
+{
+  _saved_this_game = Span::zero();
+  _banked_time = Span::zero();
+}
+
+} // namespace blackbit
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "bee/span.hpp"
+
+namespace blackbit {
+
+// Decides how long the bot thinks on each move from the clock it plays with.
+// With a fixed number of moves per session, the time a move doesn't use is
+// banked and a share of the bank is added to each following move. With an
+// increment or sudden death the time to think already follows the time
+// remaining, so nothing is banked.
+struct TimeManager {
+ public:
+  void set_time_control(int mps, bee::Span base, bee::Span inc);
+  void set_max_time(bee::Span max_time);
+  void set_time_remaining(bee::Span time_remaining);
+
+  bee::Span time_remaining() const { return _time_remaining; }
+
+  // Time to think on the next move, including its share of the bank
+  bee::Span start_move();
+
+  // Returns the time saved by the move, if it was played early enough to
+  // count as saving time
+  bee::Span finish_move(bee::Span think_time, bee::Span used);
+
+  // Starts a new game, the bank is emptied
+  void reset();
+
+  bee::Span saved_this_game() const { return _saved_this_game; }
+  bee::Span banked_time() const { return _banked_time; }
+
+ private:
+  bee::Span _think_time() const;
+
+  // Share of the banked time that is added to each move
+  static constexpr int banked_time_share = 4;
+
+  bee::Span _time_remaining = bee::Span::zero();
+
+  int _mps = 0;
+  bee::Span _base = bee::Span::zero();
+  bee::Span _inc = bee::Span::zero();
+
+  bee::Span _max_time = bee::Span::zero();
+
+  bee::Span _banked_time = bee::Span::zero();
+  bee::Span _saved_this_game = bee::Span::zero();
+};
+
+} // namespace blackbit
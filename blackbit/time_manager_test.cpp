@@ -0,0 +1,78 @@
+#include "time_manager.hpp"
+
+#include "bee/testing.hpp"
+
+using bee::print_line;
+using bee::Span;
+
+namespace blackbit {
+namespace {
+
+// Plays moves that each use the given share of the time to think, in
+// percent, and shows how much time each one gets, in milliseconds
+void play(TimeManager& time, int num_moves, int percent_used)
+{
+  for (int i = 0; i < num_moves; i++) {
+    auto think_time = time.start_move();
+    auto saved = time.finish_move(think_time, think_time * percent_used / 100);
+    print_line(
+      "think:$ saved:$ banked:$",
+      think_time.to_millis(),
+      saved.to_millis(),
+      time.banked_time().to_millis());
+  }
+}
+
+TEST(moves_per_session)
+{
+  TimeManager time;
+  time.set_time_control(40, Span::of_seconds(400), Span::zero());
+  time.set_time_remaining(Span::of_seconds(400));
+  print_line("Moves played early are banked");
+  play(time, 3, 10);
+  print_line("Moves using all the time draw from the bank");
+  play(time, 3, 100);
+  print_line("saved this game:$", time.saved_this_game().to_millis());
+  time.reset();
+  print_line("After reset");
+  play(time, 1, 100);
+}
+
+TEST(increment)
+{
+  TimeManager time;
+  time.set_time_control(0, Span::of_seconds(60), Span::of_seconds(2));
+  time.set_time_remaining(Span::of_seconds(60));
+  print_line("Nothing is banked, the time remaining already has it");
+  play(time, 3, 10);
+  time.set_time_remaining(Span::of_seconds(200));
+  play(time, 1, 100);
+}
+
+TEST(sudden_death)
+{
+  TimeManager time;
+  time.set_time_control(0, Span::of_seconds(300), Span::zero());
+  time.set_time_remaining(Span::of_seconds(300));
+  play(time, 2, 10);
+  time.set_time_remaining(Span::of_seconds(1));
+  play(time, 1, 100);
+  time.set_time_remaining(Span::of_millis(30));
+  play(time, 1, 100);
+}
+
+TEST(max_time)
+{
+  TimeManager time;
+  time.set_max_time(Span::of_seconds(5));
+  play(time, 2, 10);
+}
+
+TEST(no_clock)
+{
+  TimeManager time;
+  play(time, 1, 100);
+}
+
+} // namespace
+} // namespace blackbit
@@ -5,6 +5,7 @@
 #include "eval.hpp"
 #include "experiment_framework.hpp"
 #include "rules.hpp"
+#include "search_limits.hpp"
 #include "search_result_info.hpp"
 #include "training_features.hpp"
 
@@ -14,6 +15,7 @@
 #include "bee/format_optional.hpp"
 #include "bee/format_vector.hpp"
 #include "bee/pretty_print.hpp"
+#include "bee/queue.hpp"
 #include "bee/sort.hpp"
 #include "bee/string_util.hpp"
 #include "bee/util.hpp"
@@ -91,7 +93,7 @@ struct WorkResult {
 };
 
 void run_worker(
-  int depth,
+  const SearchLimits& limits,
   shared_ptr<bee::Queue<Work>> work_queue,
   shared_ptr<bee::Queue<bee::OrError<WorkResult>>> result_queue,
   function<EvalParameters()> training_params_factory,
@@ -106,12 +108,11 @@ void run_worker(
     experiment, EvalParameters::default_params(), nullptr, 1 << 16, true);
 
   auto run_search =
-    [&engine, depth](
+    [&engine, &limits](
       const Board& board,
       EvalParameters&& eval_params) -> bee::OrError<SearchResultInfo::ptr> {
     engine->set_eval_params(std::move(eval_params));
-    auto timeout = Span::of_seconds(0.1);
-    return engine->find_best_move(board, depth, timeout, nullptr);
+    return engine->find_best_move(board, limits, nullptr);
   };
 
   FeatureProvider::vector_type out_features;
@@ -461,7 +462,7 @@ struct SamplePool {
 
 bee::OrError<bee::Unit> training_main(
   const string& positions_file,
-  const int training_depth,
+  const SearchLimits& training_limits,
   const int num_workers,
   const string& save_model_filename,
   const optional<string>& load_model_filename,
@@ -478,6 +479,7 @@ bee::OrError<bee::Unit> training_main(
     max_training_time = Span::of_hours(*max_training_hours);
     print_line("Will train for at most $", *max_training_time);
   }
+  print_line("Labels searched with limits: $", training_limits);
 
   auto feature_names = FeatureProvider::feature_names();
 
@@ -506,7 +508,7 @@ bee::OrError<bee::Unit> training_main(
   for (int i = 0; i < num_workers; i++) {
     workers.emplace_back(
       run_worker,
-      training_depth,
+      training_limits,
       work_queue,
       result_queue,
       training_params_factory,
@@ -629,10 +631,9 @@ bee::OrError<bee::Unit> training_main(
 
 bee::OrError<bee::Unit> evaluate_main(
   const string& positions_file,
-  const double seconds_per_move,
+  const SearchLimits& limits,
   const int num_workers,
   const int num_rounds,
-  const int max_depth,
   const string& result_filename,
   const string& load_model_filename,
   bool use_null_model_for_baseline)
@@ -668,11 +669,10 @@ bee::OrError<bee::Unit> evaluate_main(
 
   return CompareEngines::compare(
     positions_file,
-    seconds_per_move,
+    limits,
     num_rounds,
     num_workers,
     1,
-    max_depth,
     result_filename,
     create_base_params,
     create_test_params);
@@ -703,10 +703,11 @@ bee::OrError<bee::Unit> benchmark_main(const string& load_model_filename)
 
     const int repeat = 100;
 
+    // Measures the speed, so the search is limited by time
+    const SearchLimits limits{.depth = 50, .time = Span::of_seconds(1)};
+
     for (int i = 0; i < repeat; i++) {
-      bail(
-        result,
-        engine->find_best_move(board, 50, Span::of_seconds(1), nullptr));
+      bail(result, engine->find_best_move(board, limits, nullptr));
 
       nodes += result->nodes;
       depth_sum += result->depth;
@@ -753,6 +754,8 @@ Cmd training_command()
   auto positions_file = builder.required("--positions-file", string_flag);
   auto training_depth =
     builder.optional_with_default("--training-depth", int_flag, 6);
+  auto training_nodes =
+    builder.optional_with_default("--training-nodes", int_flag, 100000);
   auto num_workers = builder.optional_with_default("--workers", int_flag, 8);
   auto save_model_filename = builder.optional_with_default(
     "--save-model-file", string_flag, default_model_name);
@@ -762,7 +765,7 @@ Cmd training_command()
   return builder.run([=] {
     return training_main(
       *positions_file,
-      *training_depth,
+      {.depth = *training_depth, .nodes = *training_nodes},
       *num_workers,
       *save_model_filename,
       *load_model_filename,
@@ -777,6 +780,7 @@ Cmd evaluate_command()
   auto positions_file = builder.required("--positions-file", string_flag);
   auto seconds_per_move =
     builder.optional_with_default("--seconds-per-move", float_flag, 2.0);
+  auto nodes_per_move = builder.optional("--nodes-per-move", int_flag);
   auto num_workers = builder.optional_with_default("--workers", int_flag, 14);
   auto num_rounds =
     builder.optional_with_default("--num-rounds", int_flag, 10000);
@@ -786,12 +790,18 @@ Cmd evaluate_command()
   auto use_null_model_for_baseline = builder.no_arg("--null-model-baseline");
   auto max_depth = builder.optional_with_default("--max-depth", int_flag, 50);
   return builder.run([=] {
+    // A node limit makes the games repeatable, so it replaces the time limit
+    SearchLimits limits{.depth = *max_depth};
+    if (auto nodes = *nodes_per_move; nodes.has_value()) {
+      limits.nodes = *nodes;
+    } else {
+      limits.time = Span::of_seconds(*seconds_per_move);
+    }
     return evaluate_main(
       *positions_file,
-      *seconds_per_move,
+      limits,
       *num_workers,
       *num_rounds,
-      *max_depth,
       *result_filename,
       *load_model_filename,
       *use_null_model_for_baseline);
@@ -1,5 +1,7 @@
 #include "transposition_table.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 
 namespace blackbit {
@@ -23,17 +25,25 @@ inline size_t next_prime(size_t N)
   return N;
 }
 
+std::atomic<size_t> allocated = 0;
+std::atomic<size_t> peak_allocated = 0;
+
 } // namespace
 
 TranspositionTable::TranspositionTable(size_t size) { set_size(size); }
 TranspositionTable::~TranspositionTable()
 {
   for (auto& t : hash_table) { free(t); }
+  allocated -= size_bytes();
 }
 
 void TranspositionTable::set_size(size_t size)
 {
+  if (hash_table[Color::White] != nullptr) { allocated -= size_bytes(); }
   hash_size = next_prime(size / sizeof(hash_bucket) / 2);
+  auto now = allocated += size_bytes();
+  auto peak = peak_allocated.load();
+  while (peak < now && !peak_allocated.compare_exchange_weak(peak, now)) {}
 
   for (auto& t : hash_table) {
     if (t) free(t);
@@ -44,4 +54,29 @@ void TranspositionTable::set_size(size_t size)
 
 void TranspositionTable::clear() { mask++; }
 
+void TranspositionTable::new_search()
+{
+  int users = std::max(_num_users.load(std::memory_order_relaxed), 1);
+  auto started = _searches_started.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (started % users == 0) {
+    _generation.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void TranspositionTable::add_user() { _num_users++; }
+
+void TranspositionTable::remove_user() { _num_users--; }
+
+size_t TranspositionTable::size_bytes() const
+{
+  return hash_size * sizeof(hash_bucket) * AllColors.size();
+}
+
+size_t TranspositionTable::allocated_bytes() { return allocated.load(); }
+
+size_t TranspositionTable::peak_allocated_bytes()
+{
+  return peak_allocated.load();
+}
+
 } // namespace blackbit
@@ -4,14 +4,26 @@
 #include "score.hpp"
 
 #include <algorithm>
-#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <optional>
 
 namespace blackbit {
 
+// Lock free table, safe to share between threads and engines. Each slot keeps
+// the key xor'ed with its data, so a slot that was torn by concurrent writes
+// just looks like a miss.
+//
+// Entries are aged instead of being cleared between searches, so that a table
+// shared between engines keeps the entries the other engines are using. When
+// a bucket is full, the shallowest entry is replaced, counting entries from
+// older searches as shallower. Engines sharing the table register as users,
+// so that the entries age once per round of searches of all the users instead
+// of once per search of each one.
 struct TranspositionTable {
  public:
   struct hash_slot {
-    uint64_t hash_key;
     Score lower_bound = Score::min();
     Score upper_bound = Score::max();
     int32_t depth;
@@ -21,15 +33,37 @@ struct TranspositionTable {
  private:
   uint64_t mask = 0;
   static constexpr size_t BUCKET_SIZE = 4;
-  struct hash_bucket {
-    hash_slot slot[BUCKET_SIZE];
+
+  // How much depth an entry loses for each search it is older than the current
+  // one, when picking an entry to replace
+  static constexpr int AGE_DEPTH_PENALTY = 8;
+
+  // Older entries all get the same penalty, which is more than any depth
+  static constexpr uint32_t MAX_AGE = 32;
+
+  // Generations are kept in 24 bits of the info, they only wrap after 2^24
+  // searches
+  static constexpr uint32_t GENERATION_MASK = 0xffffff;
+
+  struct packed_slot {
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> bounds;
+    std::atomic<uint64_t> info;
   };
 
-  std::array<std::mutex, 256> _segment_locks;
+  struct hash_bucket {
+    packed_slot slot[BUCKET_SIZE];
+  };
 
   size_t hash_size;
   ColorArray<hash_bucket*> hash_table{{nullptr, nullptr}};
 
+  std::atomic<uint32_t> _generation = 0;
+
+  // See new_search
+  std::atomic<int> _num_users = 0;
+  std::atomic<uint64_t> _searches_started = 0;
+
   uint64_t get_board_hash(const Board& board) const
   {
     return board.hash_key() ^ mask;
@@ -40,18 +74,68 @@ struct TranspositionTable {
     return &hash_table[board.turn][get_board_hash(board) % hash_size];
   }
 
-  inline hash_slot* find_key(const Board& board, hash_bucket* bucket)
+  static uint64_t pack_bounds(Score lower_bound, Score upper_bound)
   {
-    auto key = get_board_hash(board);
-    for (uint32_t i = 0; i < BUCKET_SIZE; ++i) {
-      if (bucket->slot[i].hash_key == key) {
-        for (int j = i; j > 0; --j) {
-          std::swap(bucket->slot[j - 1], bucket->slot[j]);
-        }
-        return &bucket->slot[0];
-      }
-    }
-    return 0;
+    return uint64_t(uint32_t(lower_bound.to_milli_pawns())) |
+           (uint64_t(uint32_t(upper_bound.to_milli_pawns())) << 32);
+  }
+
+  static uint64_t pack_info(int depth, Move move, uint32_t generation)
+  {
+    uint32_t move_bits = 0;
+    static_assert(sizeof(Move) == 3);
+    memcpy(&move_bits, &move, sizeof(Move));
+    return uint64_t(uint16_t(depth)) | (uint64_t(move_bits) << 16) |
+           (uint64_t(generation & GENERATION_MASK) << 40);
+  }
+
+  static int info_depth(uint64_t info) { return int16_t(info & 0xffff); }
+
+  static uint32_t info_generation(uint64_t info)
+  {
+    return (info >> 40) & GENERATION_MASK;
+  }
+
+  // Depth of the entry, less the penalty for how many searches old it is
+  static int aged_depth(uint64_t info, uint32_t generation)
+  {
+    uint32_t age = (generation - info_generation(info)) & GENERATION_MASK;
+    return info_depth(info) - AGE_DEPTH_PENALTY * int(std::min(age, MAX_AGE));
+  }
+
+  static hash_slot unpack(uint64_t bounds, uint64_t info)
+  {
+    Move move;
+    uint32_t move_bits = (info >> 16) & 0xffffff;
+    memcpy(&move, &move_bits, sizeof(Move));
+    return {
+      .lower_bound = Score::of_milli_pawns(int32_t(bounds & 0xffffffff)),
+      .upper_bound = Score::of_milli_pawns(int32_t(bounds >> 32)),
+      .depth = info_depth(info),
+      .move = move,
+    };
+  }
+
+  struct loaded_slot {
+    uint64_t bounds;
+    uint64_t info;
+    bool matches;
+  };
+
+  static loaded_slot load(const packed_slot& slot, uint64_t key)
+  {
+    auto bounds = slot.bounds.load(std::memory_order_relaxed);
+    auto info = slot.info.load(std::memory_order_relaxed);
+    auto check = slot.check.load(std::memory_order_relaxed);
+    return {bounds, info, (check ^ bounds ^ info) == key};
+  }
+
+  static void store(
+    packed_slot& slot, uint64_t key, uint64_t bounds, uint64_t info)
+  {
+    slot.bounds.store(bounds, std::memory_order_relaxed);
+    slot.info.store(info, std::memory_order_relaxed);
+    slot.check.store(key ^ bounds ^ info, std::memory_order_relaxed);
   }
 
   /* insert the given position in the hash */
@@ -62,34 +146,39 @@ struct TranspositionTable {
     Score upper_bound,
     Move move)
   {
+    auto key = get_board_hash(board);
+    auto generation = _generation.load(std::memory_order_relaxed);
     hash_bucket* bucket = get_bucket(board);
-    hash_slot* cand = find_key(board, bucket);
 
-    if (cand == nullptr) {
-      for (int i = BUCKET_SIZE - 1; i > 0; --i) {
-        bucket->slot[i] = bucket->slot[i - 1];
+    packed_slot* cand = nullptr;
+    int cand_value = 0;
+    for (auto& slot : bucket->slot) {
+      auto loaded = load(slot, key);
+      if (loaded.matches) {
+        auto current = unpack(loaded.bounds, loaded.info);
+        if (aged_depth(loaded.info, generation) > depth) {
+          return;
+        } else if (current.depth == depth) {
+          lower_bound = std::max(lower_bound, current.lower_bound);
+          upper_bound = std::min(upper_bound, current.upper_bound);
+        }
+        cand = &slot;
+        break;
       }
-      cand = &bucket->slot[0];
-    } else {
-      if (cand->depth > depth) {
-        return;
-      } else if (cand->depth == depth) {
-        lower_bound = std::max(lower_bound, cand->lower_bound);
-        upper_bound = std::min(upper_bound, cand->upper_bound);
+
+      int value = loaded.info == 0 ? std::numeric_limits<int>::min()
+                                   : aged_depth(loaded.info, generation);
+      if (cand == nullptr || value < cand_value) {
+        cand = &slot;
+        cand_value = value;
       }
     }
 
-    cand->hash_key = get_board_hash(board);
-    cand->lower_bound = lower_bound;
-    cand->upper_bound = upper_bound;
-    cand->depth = depth;
-    cand->move = move;
-  }
-
-  std::mutex& _mutex_for(const Board& board)
-  {
-    auto key = get_board_hash(board);
-    return _segment_locks[key % _segment_locks.size()];
+    store(
+      *cand,
+      key,
+      pack_bounds(lower_bound, upper_bound),
+      pack_info(depth, move, generation));
   }
 
  public:
@@ -98,12 +187,15 @@ struct TranspositionTable {
 
   void set_size(size_t size);
 
-  inline hash_slot* find(const Board& board)
+  inline std::optional<hash_slot> find(const Board& board)
   {
-    std::lock_guard<std::mutex> _guard(_mutex_for(board));
-
+    auto key = get_board_hash(board);
     hash_bucket* bucket = get_bucket(board);
-    return find_key(board, bucket);
+    for (const auto& slot : bucket->slot) {
+      auto loaded = load(slot, key);
+      if (loaded.matches) { return unpack(loaded.bounds, loaded.info); }
+    }
+    return std::nullopt;
   }
 
   inline void insert(
@@ -113,11 +205,29 @@ struct TranspositionTable {
     Score upper_bound,
     Move move)
   {
-    std::lock_guard<std::mutex> _guard(_mutex_for(board));
     _hash_insert(board, depth, lower_bound, upper_bound, move);
   }
 
+  // Invalidates all the entries, only call it while the table is not in use
   void clear();
+
+  // Marks the start of a new search, entries from previous searches are kept
+  // but are the first ones to be replaced. With several users, the entries
+  // only age once every user has started a search.
+  void new_search();
+
+  // Engines sharing the table register for as long as they use it
+  void add_user();
+  void remove_user();
+
+  // Size of the table in bytes
+  size_t size_bytes() const;
+
+  // Bytes held by all the tables of the process
+  static size_t allocated_bytes();
+
+  // Most bytes the tables of the process have held at once
+  static size_t peak_allocated_bytes();
 };
 
 } // namespace blackbit
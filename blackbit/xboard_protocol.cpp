@@ -69,6 +69,7 @@ bee::OrError<Span> parse_base(const string& repr)
 bee::OrError<bee::Unit> xboard_main(
   bool enable_test,
   bool use_mpv,
+  int mpv_lines,
   int cache_size,
   const optional<string>& pcp_path)
 {
@@ -91,6 +92,7 @@ bee::OrError<bee::Unit> xboard_main(
     enable_test ? Experiment::test_with_seed(0) : Experiment::base(),
     EvalParameters::default_params(),
     use_mpv,
+    mpv_lines,
     cache_size,
     std::move(pcp));
 
@@ -244,10 +246,14 @@ command::Cmd XboardProtocol::command()
     command::CommandBuilder("Run the bot with the xboard protocol");
   auto enable_test = builder.no_arg("--enable-test");
   auto enable_mpv = builder.no_arg("--enable-mpv");
+  // With --enable-mpv, more than one line lets the bot play a move early when
+  // it is far ahead of the second best one
+  auto mpv_lines = builder.optional_with_default("--mpv-lines", int_flag, 1);
   auto cache_size = builder.optional_with_default("--cache-size", int_flag, 30);
   auto pcp = builder.optional("--pcp-file", string_flag);
   return builder.run([=]() {
-    return xboard_main(*enable_test, *enable_mpv, *cache_size, *pcp);
+    return xboard_main(
+      *enable_test, *enable_mpv, *mpv_lines, *cache_size, *pcp);
   });
 }
 